@@ -6,6 +6,10 @@
 ***********************************************/
 
 #include <qwt_plot.h>
+#include <qwt_scale_map.h>
+#include <qwt_plot_directpainter.h>
+#include <cmath>
+#include <algorithm>
 
 #include "graphcurve.h"
 #include "../../storage.h"
@@ -35,14 +39,57 @@ void GraphCurve::init()
     setData(m_data);
 }
 
+void GraphCurve::drawSeries(QPainter *painter, const QwtScaleMap &xMap, const QwtScaleMap &yMap,
+                            const QRectF &canvasRect, int from, int to) const
+{
+    // Whole curve is drawn, decimate it to few points per pixel
+    if(from == 0 && to < 0)
+    {
+        const double x1 = (std::min)(xMap.s1(), xMap.s2());
+        const double x2 = (std::max)(xMap.s1(), xMap.s2());
+        const int pixels = qRound(fabs(xMap.p2() - xMap.p1()));
+
+        m_data->setLevelOfDetail(x1, x2, pixels);
+        QwtPlotCurve::drawSeries(painter, xMap, yMap, canvasRect, from, to);
+        m_data->clearLevelOfDetail();
+        return;
+    }
+
+    QwtPlotCurve::drawSeries(painter, xMap, yMap, canvasRect, from, to);
+}
+
 void GraphCurve::setSampleSize(quint32 size)
 {
     m_data->setSampleSize(size);
 }
 
-void GraphCurve::dataPosChanged(quint32 pos)
+bool GraphCurve::dataPosChanged(quint32 pos, double x_min)
+{
+    if(!m_data->dataPosChanged(pos))
+        return false;
+
+    // Removed points and the line to them must be left of the canvas
+    return !m_data->hasRemoved() || m_data->size() == 0 || m_data->sample(0).x() <= x_min;
+}
+
+bool GraphCurve::reloadIfStale()
 {
-    m_data->dataPosChanged(pos);
+    if(!m_data->isStale())
+        return false;
+
+    m_data->reloadData(true);
+    return true;
+}
+
+void GraphCurve::drawAppended(QwtPlotDirectPainter *painter)
+{
+    const int count = m_data->getAppended();
+    const int size = m_data->size();
+    if(count <= 0 || !isVisible())
+        return;
+
+    // start from the last old point, so that the line is connected
+    painter->drawSeries(this, (std::max)(0, size - count - 1), size - 1);
 }
 
 qint32 GraphCurve::getMax()
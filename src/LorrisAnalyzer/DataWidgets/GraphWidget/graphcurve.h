@@ -15,6 +15,7 @@
 #include "../datawidget.h"
 
 class Storage;
+class QwtPlotDirectPainter;
 
 class GraphCurve : public QObject, public QwtPlotCurve
 {
@@ -32,7 +33,13 @@ public:
     void init();
 
     void setSampleSize(quint32 size);
-    void dataPosChanged(quint32 pos);
+    // Returns true if points appended by this call can be painted over
+    // the current canvas, which shows x axis from x_min
+    bool dataPosChanged(quint32 pos, double x_min);
+    // Reads values again if filter conditions changed, returns true if it did
+    bool reloadIfStale();
+    // Draws only points appended by last dataPosChanged()
+    void drawAppended(QwtPlotDirectPainter *painter);
 
     qint32 getMin();
     qint32 getMax();
@@ -58,6 +65,10 @@ public slots:
     void addPoint(qreal index, qreal val);
     void clear();
 
+protected:
+    void drawSeries(QPainter *painter, const QwtScaleMap& xMap, const QwtScaleMap& yMap,
+                    const QRectF& canvasRect, int from, int to) const;
+
 private:
     GraphData *m_data;
     qint32 m_sample_size;
@@ -6,10 +6,13 @@
 ***********************************************/
 
 #include <utility>
+#include <algorithm>
+#include <cmath>
 
 #include "graphdata.h"
 #include "../datawidget.h"
 #include "../../storage.h"
+#include "../numbercolumn.h"
 
 GraphData::GraphData(Storage *storage, data_widget_info &info, qint32 sample_size, quint8 data_type) :
     QwtSeriesData<QPointF>()
@@ -20,12 +23,23 @@ GraphData::GraphData(Storage *storage, data_widget_info &info, qint32 sample_siz
     m_sample_size = sample_size;
     m_data_type = data_type;
 
-    m_data_start = 0;
-    m_data_end = 0;
     m_last_index = 0;
     m_min = m_max = 0.0;
 
+    m_cache_start = m_cache_end = 0;
+    m_filter_rev = 0;
+    m_slice_begin = m_slice_end = 0;
+    m_win_start = m_win_end = 0;
+    m_win_valid = false;
+    m_first_seq = 0;
+    m_appended = -1;
+    m_removed = false;
+    m_lod_active = false;
+
     m_script_based = false;
+
+    m_field_missing = false;
+    resolveField();
 }
 
 GraphData::~GraphData()
@@ -36,48 +50,90 @@ GraphData::~GraphData()
 void GraphData::clear()
 {
     m_data.clear();
-    m_data_start = m_data_end = 0;
+    m_slice_begin = m_slice_end = 0;
+    m_win_valid = false;
+    m_min_queue.clear();
+    m_max_queue.clear();
     m_min = m_max = 0.0;
 }
 
+void GraphData::invalidateCache()
+{
+    m_cache_seq.clear();
+    m_cache_val.clear();
+    m_cache_start = m_cache_end = 0;
+    m_slice_begin = m_slice_end = 0;
+    m_win_valid = false;
+}
+
 void GraphData::reloadData(bool force)
 {
     if(m_script_based)
         return;
 
-    if(force) {
-        quint32 idx = m_last_index;
-        clear();
-        dataPosChanged(idx);
-    } else {
-        dataPosChanged(m_last_index);
-    }
+    if(force)
+        invalidateCache();
+    dataPosChanged(m_last_index);
+}
+
+// Named field can move or change its type when the structure is edited
+void GraphData::resolveField()
+{
+    m_field_missing = false;
+    if(m_info.field.isEmpty())
+        return;
+
+    const packet_field *field = m_info.resolveField(m_storage ? m_storage->getPacket() : NULL);
+    if(field)
+        m_data_type = field->type;
+    else
+        m_field_missing = true;
+}
+
+bool GraphData::isStale() const
+{
+    return !m_script_based && !m_info.filter.isNull() &&
+            m_info.filter->getRevision() != m_filter_rev;
 }
 
 QPointF GraphData::sample(size_t i) const
 {
-    return m_data[i];
+    if(m_lod_active)
+        return m_lod[i];
+
+    if(m_script_based)
+        return m_data[i];
+
+    i += m_slice_begin;
+    return QPointF(double(m_cache_seq[i] - m_first_seq), m_cache_val[i]);
 }
 
 size_t GraphData::size() const
 {
-    return m_data.size();
+    if(m_lod_active)
+        return m_lod.size();
+
+    if(m_script_based)
+        return m_data.size();
+    return m_slice_end - m_slice_begin;
 }
 
 QRectF GraphData::boundingRect() const
 {
-    if(m_data.empty())
+    if(size() == 0)
         return QRect();
-    else
-        return QRect(m_data.front().x(), m_max, m_data.back().x() - m_data.front().x(), abs(m_max) + abs(m_min));
+
+    const double first = sample(0).x();
+    const double last = sample(size()-1).x();
+    return QRect(first, m_max, last - first, abs(m_max) + abs(m_min));
 }
 
 quint32 GraphData::getMaxX()
 {
-    if(m_data.empty())
+    if(size() == 0)
         return 0;
 
-    return m_data.back().x();
+    return sample(size()-1).x();
 }
 
 void GraphData::setSampleSize(quint32 size)
@@ -98,127 +154,318 @@ void GraphData::setDataType(quint8 type)
 void GraphData::setInfo(data_widget_info &info)
 {
     m_info = info;
+    resolveField();
     reloadData(true);
 }
 
-QPointF GraphData::getPointAtIdx(quint32 idx)
+void GraphData::setFormula(const QString &f)
 {
-    analyzer_data cur(m_storage->get(idx), m_storage->getPacket());
+    m_eval.setFormula(f);
+    reloadData(true);
+}
 
-    if(!m_info.filter->isOkay(&cur) || m_info.pos >= (quint32)cur.getData().size())
-        return QPointF(-1, 0);
+// Drops packets further than one window from [seq_start, seq_end)
+void GraphData::trimCache(quint64 seq_start, quint64 seq_end)
+{
+    const quint64 margin = (std::max)(seq_end - seq_start, (quint64)COLUMN_BLOCK);
 
-    QVariant num = DataWidget::getNumFromPacket(&cur, m_info.pos, m_data_type);
-    if(!num.isValid())
-        return QPointF(-1, 0);
+    if(seq_start > m_cache_start + margin)
+    {
+        m_cache_start = seq_start - margin;
 
-    double n = num.toDouble();
-    if(m_eval.isActive())
-        n = m_eval.evaluate(QString::number(n, 'f')).toDouble();
+        size_t drop = 0;
+        while(drop < m_cache_seq.size() && m_cache_seq[drop] < m_cache_start)
+            ++drop;
 
-    setMinMax(n);
+        m_cache_seq.erase(m_cache_seq.begin(), m_cache_seq.begin() + drop);
+        m_cache_val.erase(m_cache_val.begin(), m_cache_val.begin() + drop);
+        m_slice_begin -= drop;
+        m_slice_end -= drop;
+    }
 
-    return QPointF(idx, n);
+    if(m_cache_end > seq_end + margin)
+    {
+        m_cache_end = seq_end + margin;
+        while(!m_cache_seq.empty() && m_cache_seq.back() >= m_cache_end)
+        {
+            m_cache_seq.pop_back();
+            m_cache_val.pop_back();
+        }
+    }
 }
 
-void GraphData::dataPosChanged(quint32 index)
+// Reads packets [from, to) into the cache, in front of it or after it
+void GraphData::fillCache(quint64 from, quint64 to, bool front)
 {
+    // Only matching packets have to be read
+    const bool indexed = m_info.filter->isIndexed(from, to);
+    if(indexed)
+    {
+        m_matches.clear();
+        m_info.filter->getMatches(from, to, m_matches);
+    }
+
+    const bool big_endian = m_cur.getPacket() && m_cur.getPacket()->big_endian;
+    const size_t total = indexed ? m_matches.size() : size_t(to - from);
+
+    std::vector<quint64> seqs;
+    std::vector<double> vals;
+
+    // Values of whole block are extracted at once
+    for(size_t block = 0; block < total; block += COLUMN_BLOCK)
+    {
+        const quint32 count = (quint32)(std::min)(size_t(COLUMN_BLOCK), total - block);
+
+        m_views.resize(count);
+        for(quint32 i = 0; i < count; ++i)
+        {
+            const quint64 seq = indexed ? m_matches[block + i] : from + block + i;
+            m_views[i] = m_storage->get(seq - m_first_seq);
+        }
+
+        if(!indexed)
+            m_info.filter->isOkayBatch(&m_cur, &m_views[0], count, m_mask);
+
+        m_values.resize(count);
+        m_valid.resize(count);
+        NumberColumn::toDouble(&m_views[0], count, m_info.pos, m_data_type, big_endian,
+                               &m_values[0], &m_valid[0]);
+
+        for(quint32 i = 0; i < count; ++i)
+        {
+            if(!m_valid[i] || (!indexed && !m_mask[i]))
+                continue;
+
+            seqs.push_back(indexed ? m_matches[block + i] : from + block + i);
+            vals.push_back(m_eval.isActive() ? m_eval.evaluate(m_values[i]) : m_values[i]);
+        }
+    }
+
+    if(front)
+    {
+        m_cache_seq.insert(m_cache_seq.begin(), seqs.begin(), seqs.end());
+        m_cache_val.insert(m_cache_val.begin(), vals.begin(), vals.end());
+        m_cache_start = from;
+    }
+    else
+    {
+        m_cache_seq.insert(m_cache_seq.end(), seqs.begin(), seqs.end());
+        m_cache_val.insert(m_cache_val.end(), vals.begin(), vals.end());
+        m_cache_end = to;
+    }
+}
+
+void GraphData::pushMinMax(size_t pos)
+{
+    const seq_value v(m_cache_seq[pos], m_cache_val[pos]);
+
+    while(!m_min_queue.empty() && m_min_queue.back().second >= v.second)
+        m_min_queue.pop_back();
+    m_min_queue.push_back(v);
+
+    while(!m_max_queue.empty() && m_max_queue.back().second <= v.second)
+        m_max_queue.pop_back();
+    m_max_queue.push_back(v);
+}
+
+void GraphData::popMinMax(quint64 seq_start)
+{
+    while(!m_min_queue.empty() && m_min_queue.front().first < seq_start)
+        m_min_queue.pop_front();
+    while(!m_max_queue.empty() && m_max_queue.front().first < seq_start)
+        m_max_queue.pop_front();
+}
+
+bool GraphData::dataPosChanged(quint32 index)
+{
+    m_appended = -1;
+    m_removed = false;
+
     if(m_info.filter.isNull() || m_storage->isEmpty())
     {
+        if(!m_info.filter.isNull() && m_info.filter->getRevision() != m_filter_rev)
+        {
+            m_filter_rev = m_info.filter->getRevision();
+            resolveField();
+        }
+        invalidateCache();
         clear();
-        return;
+        return false;
     }
 
     m_last_index = index;
+    m_cur.setPacket(m_storage->getPacket());
+
+    // Conditions or endianness changed, cached values are wrong
+    if(m_info.filter->getRevision() != m_filter_rev)
+    {
+        invalidateCache();
+        m_filter_rev = m_info.filter->getRevision();
+        resolveField();
+    }
+
+    if(m_field_missing)
+    {
+        clear();
+        return false;
+    }
+
+    // x coordinates of all points move when packets are evicted
+    const bool shifted = m_first_seq != m_storage->getFirstSeq();
+    m_first_seq = m_storage->getFirstSeq();
 
-    // FIXME: this can be solved better, somehow
-    if(m_data_end == index+1 && m_storage->isFull())
+    // drop evicted packets
+    size_t evicted = 0;
+    while(!m_cache_seq.empty() && m_cache_seq.front() < m_first_seq)
     {
-        m_data.clear();
-        m_data_start = 0;
-        m_data_end = 0;
+        m_cache_seq.pop_front();
+        m_cache_val.pop_front();
+        ++evicted;
     }
+    m_cache_start = (std::max)(m_cache_start, m_first_seq);
+    m_cache_end = (std::max)(m_cache_end, m_cache_start);
+    m_slice_begin -= (std::min)(evicted, m_slice_begin);
+    m_slice_end -= (std::min)(evicted, m_slice_end);
 
     // calc new range
     const quint32 start = (m_sample_size < index) ? index - m_sample_size : 0;
-    const quint32 end = (std::min)(index+1, m_storage->getMaxIdx()+1);
-
-    if(start >= m_data_end || end <= m_data_start) {
-        m_data.clear();
-        for(quint32 i = start; i < end; ++i) {
-            auto p = getPointAtIdx(i);
-            if((qint64)p.x() >= 0)
-                m_data.push_back(p);
-        }
-    } else {
-        if(start > m_data_start)
-            removeDataBefore(start);
-        if(end < m_data_end)
-            removeDataAfter(end-1);
-
-        // fill before prev range
-        if(start < m_data_start) {
-            const quint32 start_limit = (std::min)(m_data_start-1, m_storage->getMaxIdx());
-            for(quint32 i = start_limit; i >= start; --i) {
-                auto p = getPointAtIdx(i);
-                if((qint64)p.x() >= 0)
-                    m_data.push_front(p);
-
-                if(i == 0)
-                    break;
-            }
-        }
+    const quint32 end = (std::min)(index+1, m_storage->getSize());
+    const quint64 seq_start = m_first_seq + start;
+    const quint64 seq_end = m_first_seq + (std::max)(start, end);
 
-        // fill after prev range
-        const quint32 end_limit = (std::max)(m_data_end, start);
-        for(quint32 i = end_limit; i < end; ++i) {
-            auto p = getPointAtIdx(i);
-            if((qint64)p.x() >= 0.0)
-                m_data.push_back(p);
-        }
+    // Window moved forward, this is the usual case while receiving
+    const bool slide = m_win_valid && seq_start >= m_win_start &&
+                       seq_start <= m_win_end && seq_end >= m_win_end;
+
+    // Jumped away, reading the gap would be wasted work
+    if(seq_start > m_cache_end || seq_end < m_cache_start)
+    {
+        invalidateCache();
+        m_cache_start = m_cache_end = seq_start;
     }
 
-    /*qreal lastx = -1;
-    for(size_t i = 0; i < m_data.size(); ++i)
+    if(seq_start < m_cache_start)
+        fillCache(seq_start, m_cache_start, true);
+    if(seq_end > m_cache_end)
+        fillCache(m_cache_end, seq_end, false);
+
+    if(slide)
     {
-        Q_ASSERT(m_data[i].x() > lastx);
-        lastx = m_data[i].x();
+        const size_t old_begin = m_slice_begin;
+        const size_t old_end = m_slice_end;
+
+        while(m_slice_begin < m_slice_end && m_cache_seq[m_slice_begin] < seq_start)
+            ++m_slice_begin;
+        popMinMax(seq_start);
+
+        for(; m_slice_end < m_cache_seq.size() && m_cache_seq[m_slice_end] < seq_end; ++m_slice_end)
+            pushMinMax(m_slice_end);
+
+        if(!shifted)
+        {
+            m_appended = m_slice_end - old_end;
+            m_removed = (m_slice_begin != old_begin);
+        }
+    }
+    else
+    {
+        m_slice_begin = std::lower_bound(m_cache_seq.begin(), m_cache_seq.end(), seq_start) - m_cache_seq.begin();
+        m_slice_end = std::lower_bound(m_cache_seq.begin() + m_slice_begin, m_cache_seq.end(), seq_end) - m_cache_seq.begin();
+
+        m_min_queue.clear();
+        m_max_queue.clear();
+        for(size_t i = m_slice_begin; i < m_slice_end; ++i)
+            pushMinMax(i);
     }
-    Q_ASSERT(m_data.size() == (end - start));*/
 
-    m_data_start = start;
-    m_data_end = end;
+    trimCache(seq_start, seq_end);
+
+    m_win_start = seq_start;
+    m_win_end = seq_end;
+    m_win_valid = true;
+
+    m_min = m_min_queue.empty() ? 0.0 : m_min_queue.front().second;
+    m_max = m_max_queue.empty() ? 0.0 : m_max_queue.front().second;
+    return m_appended >= 0;
 }
 
-void GraphData::removeDataAfter(quint32 index)
+size_t GraphData::lowerBoundX(double x) const
 {
-    for(size_t i = 0; i < m_data.size(); ++i)
+    size_t lo = 0, hi = size();
+    while(lo < hi)
     {
-        if((qint64)m_data[i].x() > index)
-        {
-            m_data.erase(m_data.begin()+i, m_data.end());
-            return;
-        }
+        const size_t mid = lo + (hi - lo)/2;
+        if(sample(mid).x() < x)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo;
 }
 
-void GraphData::removeDataBefore(quint32 index)
+bool GraphData::setLevelOfDetail(double x1, double x2, int pixels)
 {
-    for(size_t i = 0; i < m_data.size(); ++i)
+    m_lod_active = false;
+
+    if(pixels <= 0 || x2 <= x1 || size() <= size_t(pixels)*LOD_POINTS_PER_PX)
+        return false;
+
+    // One point on each side, so that lines continue past the canvas edge
+    size_t lo = lowerBoundX(x1);
+    size_t hi = lowerBoundX(x2);
+    if(lo != 0)
+        --lo;
+    if(hi < size())
+        ++hi;
+
+    if(hi - lo <= size_t(pixels)*LOD_POINTS_PER_PX)
+        return false;
+
+    m_lod.clear();
+
+    const double scale = pixels / (x2 - x1);
+    size_t i = lo;
+    while(i < hi)
     {
-        if((qint64)m_data[i].x() >= index)
+        const size_t first = i;
+        size_t last = i, min_i = i, max_i = i;
+        double min = sample(i).y();
+        double max = min;
+
+        const qint64 col = (qint64)floor((sample(i).x() - x1)*scale);
+        for(++i; i < hi; ++i)
         {
-            m_data.erase(m_data.begin(), m_data.begin()+i);
-            return;
+            const QPointF p = sample(i);
+            if((qint64)floor((p.x() - x1)*scale) != col)
+                break;
+
+            last = i;
+            if(p.y() < min)
+            {
+                min = p.y();
+                min_i = i;
+            }
+            else if(p.y() > max)
+            {
+                max = p.y();
+                max_i = i;
+            }
         }
+
+        // keep original order of the points
+        const size_t idx[4] = { first, (std::min)(min_i, max_i), (std::max)(min_i, max_i), last };
+        for(int k = 0; k < 4; ++k)
+            if(k == 0 || idx[k] != idx[k-1])
+                m_lod.push_back(sample(idx[k]));
     }
 
-    m_data.clear();
+    m_lod_active = true;
+    return true;
 }
 
 void GraphData::setMinMax(double val)
 {
-    if(m_data.empty())
+    if(size() == 0)
         m_min = m_max = val;
     else
     {
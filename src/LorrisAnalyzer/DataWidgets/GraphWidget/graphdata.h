@@ -10,6 +10,7 @@
 
 #include <qwt_series_data.h>
 #include <deque>
+#include <vector>
 
 #include "../datawidget.h"
 #include "../../../misc/formulaevaluation.h"
@@ -17,9 +18,21 @@
 class Storage;
 struct data_widget_info;
 
+// Values of analyzer-fed curve are kept in columnar cache: sequence
+// numbers (see StorageData::firstSeq()) of matching packets and their
+// values after formula. The cache covers contiguous range of packets and
+// is extended lazily as the visible window moves, so scrolling and
+// changing sample size only slice it. Packets further than one window
+// from the visible ones are dropped from it. Whole cache is dropped when
+// filter, its conditions, position, data type or formula changes. Named
+// field is looked up again when the conditions or structure change.
+//
+// Script-based curves store points added by addPoint() in m_data.
 class GraphData : public QwtSeriesData<QPointF>
 {
 public:
+    enum { LOD_POINTS_PER_PX = 4, COLUMN_BLOCK = 4096 };
+
     typedef std::deque<QPointF> DataMap;
     typedef std::deque<QPointF>::iterator DataMapItr;
 
@@ -38,24 +51,42 @@ public:
     quint32 getMaxX();
     void clear();
     void reloadData(bool force);
+    // True if filter conditions changed since the cache was filled
+    bool isStale() const;
 
     void setSampleSize(quint32 size);
-    void dataPosChanged(quint32 index);
+    // Returns true if points were only appended to the end of visible
+    // range since last call, their count is in getAppended(). Points
+    // could also be removed from the start, see hasRemoved().
+    bool dataPosChanged(quint32 index);
+    int getAppended() const { return m_appended; }
+    bool hasRemoved() const { return m_removed; }
 
     void setDataType(quint8 type);
     quint8 getDataType() { return m_data_type; }
     void setInfo(data_widget_info&);
 
     QString getFormula() { return m_eval.getFormula(); }
-    void setFormula(const QString& f) { m_eval.setFormula(f); }
+    void setFormula(const QString& f);
+
+    // Level of detail for drawing. If there are more than LOD_POINTS_PER_PX
+    // points per pixel in x range, sample() returns only first, minimal,
+    // maximal and last point of each pixel column (M4 decimation) until
+    // clearLevelOfDetail() is called, so spikes stay visible. Returns
+    // false if decimation is not needed.
+    bool setLevelOfDetail(double x1, double x2, int pixels);
+    void clearLevelOfDetail() { m_lod_active = false; }
 
 private:
-    void removeDataAfter(quint32 index);
-    void removeDataBefore(quint32 index);
-    inline DataMapItr insertData(DataMapItr hint, quint32 idx, double val);
     inline void setMinMax(double val);
 
-    QPointF getPointAtIdx(quint32 idx);
+    size_t lowerBoundX(double x) const;
+    void invalidateCache();
+    void resolveField();
+    void pushMinMax(size_t pos);
+    void popMinMax(quint64 seq_start);
+    void fillCache(quint64 from, quint64 to, bool front);
+    void trimCache(quint64 seq_start, quint64 seq_end);
 
     FormulaEvaluation m_eval;
     bool m_script_based;
@@ -66,11 +97,42 @@ private:
     quint32 m_sample_size;
     quint8 m_data_type;
 
-    DataMap m_data;
-    quint32 m_data_start;
-    quint32 m_data_end;
+    DataMap m_data; // only script-based
     quint32 m_last_index;
 
+    // cache covers packets [m_cache_start, m_cache_end)
+    std::deque<quint64> m_cache_seq;
+    std::deque<double> m_cache_val;
+    quint64 m_cache_start;
+    quint64 m_cache_end;
+    quint32 m_filter_rev;
+    bool m_field_missing; // named field is not in packet structure
+    analyzer_data m_cur;
+    std::vector<quint64> m_matches;
+    std::vector<packet_view> m_views;
+    std::vector<double> m_values;
+    std::vector<quint8> m_valid;
+    std::vector<quint8> m_mask;
+
+    // visible part of the cache, packets [m_win_start, m_win_end)
+    size_t m_slice_begin;
+    size_t m_slice_end;
+    quint64 m_win_start;
+    quint64 m_win_end;
+    bool m_win_valid;
+    quint64 m_first_seq;
+    int m_appended;
+    bool m_removed;
+
+    // Sliding window min/max. Values in m_min_queue are increasing,
+    // in m_max_queue decreasing, front is the current min/max.
+    typedef std::pair<quint64, double> seq_value;
+    std::deque<seq_value> m_min_queue;
+    std::deque<seq_value> m_max_queue;
+
+    std::vector<QPointF> m_lod;
+    bool m_lod_active;
+
     double m_min, m_max;
 };
 
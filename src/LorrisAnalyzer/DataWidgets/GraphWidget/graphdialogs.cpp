@@ -7,15 +7,17 @@
 
 #include <QMessageBox>
 #include <QColorDialog>
+#include <algorithm>
 
 #include "../datawidget.h"
+#include "../../packet.h"
 #include "graphdialogs.h"
 #include "graphwidget.h"
 #include "graphcurve.h"
 #include "ui_graphcurveadddialog.h"
 #include "ui_graphcurveeditwidget.h"
 
-GraphCurveAddDialog::GraphCurveAddDialog(QWidget *parent, std::vector<GraphCurveInfo*> *curves, bool edit) :
+GraphCurveAddDialog::GraphCurveAddDialog(QWidget *parent, std::vector<GraphCurveInfo*> *curves, bool edit, analyzer_packet *packet) :
     QDialog(parent),ui(new Ui::GraphCurveAddDialog),
     edit_widget_ui(new Ui::GraphCurveEditWidget)
 {
@@ -53,6 +55,15 @@ GraphCurveAddDialog::GraphCurveAddDialog(QWidget *parent, std::vector<GraphCurve
     for(quint8 i = 0; i < NUM_COUNT; ++i)
         edit_widget_ui->dataTypeBox->addItem(dataTypes[i]);
 
+    edit_widget_ui->fieldBox->addItem(tr("Dropped position"), -1);
+    if(packet)
+    {
+        const std::vector<packet_field>& fields = packet->layout.fields();
+        for(size_t i = 0; i < fields.size(); ++i)
+            edit_widget_ui->fieldBox->addItem(fields[i].name, (int)fields[i].type);
+    }
+    connect(edit_widget_ui->fieldBox, SIGNAL(currentIndexChanged(int)), SLOT(fieldChanged(int)));
+
     m_curves = curves;
 
     ui->setRadio->setEnabled(!m_curves->empty());
@@ -115,6 +126,13 @@ quint8 GraphCurveAddDialog::getDataType()
     return edit_widget_ui->dataTypeBox->currentIndex();
 }
 
+QString GraphCurveAddDialog::getField()
+{
+    if(edit_widget_ui->fieldBox->currentIndex() <= 0)
+        return QString();
+    return edit_widget_ui->fieldBox->currentText();
+}
+
 int GraphCurveAddDialog::getAxis()
 {
     return edit_widget_ui->axisBox->currentIndex();
@@ -175,9 +193,22 @@ void GraphCurveAddDialog::curveChanged(int idx)
     edit_widget_ui->axisBox->setCurrentIndex(curve->yAxis());
     edit_widget_ui->widthEdit->setValue(curve->pen().width());
 
+    const QString& field = m_curves->at(idx)->info.field;
+    const int fieldIdx = field.isEmpty() ? 0 : edit_widget_ui->fieldBox->findText(field);
+    edit_widget_ui->fieldBox->setCurrentIndex((std::max)(0, fieldIdx));
+
     setButtonColor(curve->pen().color());
 }
 
+void GraphCurveAddDialog::fieldChanged(int idx)
+{
+    // Named field has its own type
+    const int type = edit_widget_ui->fieldBox->itemData(idx).toInt();
+    if(type >= 0)
+        edit_widget_ui->dataTypeBox->setCurrentIndex(type);
+    edit_widget_ui->dataTypeBox->setEnabled(type < 0);
+}
+
 void GraphCurveAddDialog::selectColor()
 {
     QColor color = QColorDialog::getColor(m_color, this);
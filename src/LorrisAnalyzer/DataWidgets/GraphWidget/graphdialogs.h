@@ -11,6 +11,7 @@
 #include <QDialog>
 
 struct GraphCurveInfo;
+struct analyzer_packet;
 class QAbstractButton;
 
 namespace Ui {
@@ -25,12 +26,15 @@ Q_SIGNALS:
     void apply();
 
 public:
-    explicit GraphCurveAddDialog(QWidget *parent, std::vector<GraphCurveInfo*> *curves, bool edit);
+    // Named fields are taken from packet, which can be NULL
+    GraphCurveAddDialog(QWidget *parent, std::vector<GraphCurveInfo*> *curves, bool edit, analyzer_packet *packet);
     ~GraphCurveAddDialog();
 
     QString getName();
     QColor getColor();
     quint8 getDataType();
+    // Empty if the curve uses dropped position
+    QString getField();
     QString getEditName();
     QString getFormula();
     int getAxis();
@@ -43,6 +47,7 @@ private slots:
     void newOrEditCurve(bool newCurve);
     void tryAccept();
     void curveChanged(int idx);
+    void fieldChanged(int idx);
     void selectColor();
     void buttonBoxClicked(QAbstractButton *btn);
 
@@ -13,6 +13,7 @@
 #include "graphwidget.h"
 #include "graphcurve.h"
 #include "graphdata.h"
+#include "../numbercolumn.h"
 
 GraphExport::GraphExport(std::vector<GraphCurveInfo*> *curves, QWidget *parent) :
     QDialog(parent), ui(new Ui::GraphExport)
@@ -150,71 +151,42 @@ QByteArray GraphExport::generateBin()
     const quint32 start = ui->sampleStartBox->value();
     const quint32 end = ui->sampleEndBox->value();
 
-    for(quint32 i = start; i < end && i < c->getSize(); ++i)
+    const quint8 type = c->getDataType();
+    const quint32 size = NumberColumn::typeSize(type);
+    if(size == 0)
+        return bin;
+
+    const quint32 last = (std::min)(end, (quint32)c->getSize());
+
+    std::vector<double> vals;
+    std::vector<char> raw;
+
+    // Values are converted in blocks, see NumberColumn
+    for(quint32 block = start; block < last; block += EXPORT_BLOCK)
     {
-        emit updateProgress((i - start )*100/(end - start));
+        emit updateProgress((block - start)*100/(end - start));
+
+        const quint32 count = (std::min)((quint32)EXPORT_BLOCK, last - block);
+        vals.resize(count);
+        raw.resize(count*size);
+        for(quint32 i = 0; i < count; ++i)
+            vals[i] = c->sample(block + i).y();
+        NumberColumn::fromDouble(&vals[0], count, type, big, &raw[0]);
+
+        if(!ui->indexBox->isChecked())
+        {
+            buff.write(&raw[0], raw.size());
+            continue;
+        }
 
-        if(ui->indexBox->isChecked())
+        for(quint32 i = 0; i < count; ++i)
         {
-            quint64 idx = i;
+            quint64 idx = block + i;
             Utils::swapEndian(idx);
             if(!big)
                 Utils::swapEndian(((char*)&idx)+(sizeof(idx)-idxW), idxW);
             buff.write(((char*)&idx)+(sizeof(idx)-idxW), idxW);
-        }
-
-        qreal s = c->sample(i).y();
-        switch(c->getDataType())
-        {
-            case NUM_FLOAT:
-            {
-                float f = s;
-                buff.write((char*)&f, sizeof(f));
-                break;
-            }
-            case NUM_DOUBLE:
-                buff.write((char*)&s, sizeof(s));
-                break;
-            default:
-            {
-                QVariant var(s);
-                switch(c->getDataType())
-                {
-                    case NUM_UINT8:
-                    case NUM_INT8:
-                    {
-                        quint8 y = var.toInt();
-                        if(big) Utils::swapEndian((char*)&y, sizeof(y));
-                        buff.write((char*)&y, sizeof(y));
-                        break;
-                    }
-                    case NUM_UINT16:
-                    case NUM_INT16:
-                    {
-                        quint16 y = var.toInt();
-                        if(big) Utils::swapEndian((char*)&y, sizeof(y));
-                        buff.write((char*)&y, sizeof(y));
-                        break;
-                    }
-                    case NUM_UINT32:
-                    case NUM_INT32:
-                    {
-                        quint32 y = var.toInt();
-                        if(big) Utils::swapEndian((char*)&y, sizeof(y));
-                        buff.write((char*)&y, sizeof(y));
-                        break;
-                    }
-                    case NUM_UINT64:
-                    case NUM_INT64:
-                    {
-                        quint64 y = var.toLongLong();
-                        if(big) Utils::swapEndian((char*)&y, sizeof(y));
-                        buff.write((char*)&y, sizeof(y));
-                        break;
-                    }
-                }
-                break;
-            }
+            buff.write(&raw[i*size], size);
         }
     }
     buff.close();
@@ -25,6 +25,8 @@ Q_SIGNALS:
     void updateProgress(int val);
     
 public:
+    enum { EXPORT_BLOCK = 4096 };
+
     explicit GraphExport(std::vector<GraphCurveInfo*> *curves, QWidget *parent = 0);
     ~GraphExport();
 
@@ -13,6 +13,7 @@
 #include <QColorDialog>
 #include <qwt_plot_canvas.h>
 #include <qwt_plot_grid.h>
+#include <qwt_plot_directpainter.h>
 #include <QMimeData>
 
 #include "graphwidget.h"
@@ -31,6 +32,11 @@ W_TR(QT_TRANSLATE_NOOP("DataWidget", "Graph"))
 
 static const int sampleValues[SAMPLE_ACT_COUNT] = { -1, -2, -3, 10, 50, 100, 200, 500, 1000 };
 
+// Auto-scroll leaves 1/AUTOSCROLL_AHEAD of the x axis free ahead of
+// the newest point, points which come until it fills are painted
+// without replot
+static const int AUTOSCROLL_AHEAD = 8;
+
 GraphWidget::GraphWidget(QWidget *parent) : DataWidget(parent)
 {
     m_graph = new Graph(this);
@@ -56,7 +62,6 @@ void GraphWidget::setUp(Storage *storage)
 {
     DataWidget::setUp(storage);
 
-    m_storage = storage;
     m_doReplot = false;
     m_indexChange = UINT32_MAX;
 
@@ -129,6 +134,8 @@ void GraphWidget::setUp(Storage *storage)
     m_replotTimer = new QTimer(this);
     m_replotTimer->start(m_refreshRateMs);
 
+    m_directPainter = new QwtPlotDirectPainter(this);
+
     connect(m_editCurve,  SIGNAL(triggered()),        SLOT(editCurve()));
     connect(exportAct,    SIGNAL(triggered()),        SLOT(exportData()));
     connect(bgAct,        SIGNAL(triggered()),        SLOT(changeBackground()));
@@ -225,6 +232,9 @@ void GraphWidget::saveWidgetInfo(DataFileParser *file)
         file->writeBlockIdentifier("graphWCurveDataInfoV2");
         saveDataInfo(file, info->info);
 
+        file->writeBlockIdentifier("graphWCurveField");
+        file->writeString(info->info.field);
+
         // data type
         file->writeBlockIdentifier("graphWCurveDataType");
         quint8 type = info->curve->getDataType();
@@ -342,7 +352,11 @@ void GraphWidget::loadWidgetInfo(DataFileParser *file)
 
         // data info
         if(file->seekToNextBlock("graphWCurveDataInfoV2", "graphWCurve"))
+        {
             loadDataInfo(file, info);
+            if(file->seekToNextBlock("graphWCurveField", "graphWCurve"))
+                info.field = file->readString();
+        }
         else if(file->seekToNextBlock("graphWCurveDataInfo", "graphWCurve"))
             loadOldDataInfo(file, info);
         else
@@ -517,7 +531,7 @@ void GraphWidget::dropEvent(QDropEvent *event)
 
         if(m_add_dialog)
             delete m_add_dialog;
-        m_add_dialog = new GraphCurveAddDialog(this, &m_curves, false);
+        m_add_dialog = new GraphCurveAddDialog(this, &m_curves, false, m_storage ? m_storage->getPacket() : NULL);
         connect(m_add_dialog, SIGNAL(accepted()), this, SLOT(acceptCurveChanges()));
         m_add_dialog->open();
     }
@@ -526,7 +540,10 @@ void GraphWidget::dropEvent(QDropEvent *event)
 void GraphWidget::applyCurveChanges()
 {
     if(!m_add_dialog->forceEdit())
+    {
         setInfo(m_dropData.second, m_dropData.first);
+        m_info.field = m_add_dialog->getField();
+    }
 
     if(!m_add_dialog->edit())
     {
@@ -582,6 +599,11 @@ void GraphWidget::applyCurveChanges()
             info->info = m_info;
             m_info.filter->connectWidget(this, false);
         }
+        else if(info->info.field != m_add_dialog->getField())
+        {
+            info->info.field = m_add_dialog->getField();
+            info->curve->setDataInfo(info->info);
+        }
         info->curve->setDataType(m_add_dialog->getDataType());
         info->curve->setFormula(m_add_dialog->getFormula());
     }
@@ -611,38 +633,71 @@ void GraphWidget::updateVisibleArea()
 
 void GraphWidget::tryReplot()
 {
+    // Filter conditions were edited, matching packets are different
+    for(size_t i = 0; i < m_curves.size(); ++i)
+        if(m_curves[i]->curve->reloadIfStale())
+            m_doReplot = true;
+
     if(m_indexChange != UINT32_MAX) {
+        // When points were only appended and axes stay the same,
+        // just the new points are painted over the current canvas
+        bool appendOnly = !m_doReplot;
+
+        const double x_min = m_graph->XlowerBound();
         const size_t size = m_curves.size();
         for(size_t i = 0; i < size; ++i) {
-            m_curves[i]->curve->dataPosChanged(m_indexChange);
+            if(!m_curves[i]->curve->dataPosChanged(m_indexChange, x_min))
+                appendOnly = false;
         }
-        m_doReplot = size != 0;
+
+        if(m_enableAutoScroll && autoScroll())
+            appendOnly = false;
+
+        if(appendOnly) {
+            for(size_t i = 0; i < size; ++i)
+                m_curves[i]->curve->drawAppended(m_directPainter);
+        }
+        else
+            m_doReplot = size != 0;
 
         m_indexChange = UINT32_MAX;
     }
 
     if(m_doReplot)
     {
-        if(m_enableAutoScroll && !m_curves.empty())
-        {
-            qint32 size = 0;
-
-            for(quint8 i = 0; i < m_curves.size(); ++i)
-            {
-                const qint32 c_size = m_curves[i]->curve->getMaxX();
-                if(c_size > size)
-                    size = c_size;
-            }
-
-            const qint32 x_max = abs(m_graph->XupperBound() - m_graph->XlowerBound());
-            m_graph->setAxisScale(QwtPlot::xBottom, size - x_max, size);
-        }
+        if(m_enableAutoScroll)
+            autoScroll();
 
         m_graph->replot();
         m_doReplot = false;
     }
 }
 
+bool GraphWidget::autoScroll()
+{
+    if(m_curves.empty())
+        return false;
+
+    qint32 size = 0;
+    for(quint8 i = 0; i < m_curves.size(); ++i)
+    {
+        const qint32 c_size = m_curves[i]->curve->getMaxX();
+        if(c_size > size)
+            size = c_size;
+    }
+
+    // Scale moves only when the newest point leaves the visible range
+    const double lower = m_graph->XlowerBound();
+    const double upper = m_graph->XupperBound();
+    if(size >= lower && size <= upper)
+        return false;
+
+    const qint32 x_max = abs(upper - lower);
+    const qint32 ahead = x_max/AUTOSCROLL_AHEAD;
+    m_graph->setAxisScale(QwtPlot::xBottom, size + ahead - x_max, size + ahead);
+    return true;
+}
+
 void GraphWidget::sampleSizeChanged(int val)
 {
     if(val != -2 && sampleValues[m_sample_size_idx] == val)
@@ -696,7 +751,7 @@ void GraphWidget::editCurve()
     if(m_add_dialog)
         delete m_add_dialog;
 
-    m_add_dialog = new GraphCurveAddDialog(this, &m_curves, true);
+    m_add_dialog = new GraphCurveAddDialog(this, &m_curves, true, m_storage ? m_storage->getPacket() : NULL);
     m_add_dialog->open();
 
     connect(m_add_dialog, SIGNAL(accepted()), SLOT(acceptCurveChanges()));
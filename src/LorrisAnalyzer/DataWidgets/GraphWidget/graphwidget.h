@@ -17,6 +17,7 @@ class Graph;
 class GraphCurveAddDialog;
 class GraphCurve;
 class QTimer;
+class QwtPlotDirectPainter;
 
 #define SAMPLE_ACT_COUNT 9
 
@@ -75,11 +76,12 @@ private slots:
 private:
     void updateRemoveMapping();
     void setRefreshRate(int rateMs);
+    // Moves x axis if the newest point is not visible, returns true if it did
+    bool autoScroll();
 
     Graph *m_graph;
     GraphCurveAddDialog *m_add_dialog;
     std::pair<quint32, DataFilter*> m_dropData;
-    Storage *m_storage;
 
     QVBoxLayout *m_drop_layout;
     std::vector<QLabel*> m_drop_labels;
@@ -101,6 +103,7 @@ private:
     quint32 m_indexChange;
     int m_refreshRateMs;
     QTimer *m_replotTimer;
+    QwtPlotDirectPainter *m_directPainter;
 
     std::vector<GraphCurveInfo*> m_curves;
     bool m_doReplot;
@@ -152,7 +152,7 @@ QString PythonEngine::dataChanged(analyzer_data *data, quint32 index)
         return QString();
 
     QVariantList args;
-    args << data->getData();
+    args << data->getView().toByteArray();
 
     quint8 res = 0;
     if(data->getDeviceId(res)) args << res;
@@ -379,7 +379,7 @@ QByteArray PythonFunctions::getData(quint32 idx) const
     if(idx >= m_engine->getStorage()->getSize())
         return QByteArray();
 
-    return *m_engine->getStorage()->get(idx);
+    return m_engine->getStorage()->get(idx).toByteArray();
 }
 
 quint32 PythonFunctions::getDataCount() const
@@ -387,6 +387,16 @@ quint32 PythonFunctions::getDataCount() const
     return m_engine->getStorage()->getSize();
 }
 
+QVariant PythonFunctions::getField(quint32 idx, const QString &name) const
+{
+    Storage *storage = m_engine->getStorage();
+    if(idx >= storage->getSize())
+        return QVariant();
+
+    analyzer_data data(storage->get(idx), storage->getPacket());
+    return DataWidget::getField(&data, name);
+}
+
 void PythonFunctions::playErrorSound()
 {
     Utils::playErrorSound();
@@ -88,6 +88,7 @@ void QtScriptEngine::prepareNewContext()
     QScriptValue resizeW = m_engine->newFunction(&QtScriptEngine_private::__resizeWidget);
     QScriptValue getData = m_engine->newFunction(&QtScriptEngine_private::__getData);
     QScriptValue getDataCount = m_engine->newFunction(&QtScriptEngine_private::__getDataCount);
+    QScriptValue getField = m_engine->newFunction(&QtScriptEngine_private::__getField);
     QScriptValue playErrorSound = m_engine->newFunction(&QtScriptEngine_private::__playErrorSound);
     QScriptValue setMaxPacketNumber = m_engine->newFunction(&QtScriptEngine_private::__setMaxPacketNumber);
     QScriptValue setInterval = m_engine->newFunction(&QtScriptEngine_private::__setInterval);
@@ -124,6 +125,7 @@ void QtScriptEngine::prepareNewContext()
     m_global.setProperty("resizeWidget", resizeW);
     m_global.setProperty("getData", getData);
     m_global.setProperty("getDataCount", getDataCount);
+    m_global.setProperty("getField", getField);
     m_global.setProperty("playErrorSound", playErrorSound);
     m_global.setProperty("setMaxPacketNumber", setMaxPacketNumber);
     m_global.setProperty("setInterval", setInterval);
@@ -230,10 +232,10 @@ QString QtScriptEngine::dataChanged(analyzer_data *data, quint32 index)
     if(!m_on_data.isFunction() || !m_engine->agent())
         return "";
 
-    const QByteArray& pkt_data = data->getData();
+    const char *pkt_data = data->data();
 
-    QScriptValue jsData = m_engine->newArray(pkt_data.size());
-    for(qint32 i = 0; i < pkt_data.size(); ++i)
+    QScriptValue jsData = m_engine->newArray(data->size());
+    for(quint32 i = 0; i < data->size(); ++i)
         jsData.setProperty(i, QScriptValue(m_engine, (quint8)pkt_data[i]));
 
     QScriptValueList args;
@@ -504,7 +506,7 @@ QScriptValue QtScriptEngine_private::newTimer()
     return newQObject(m_base->newTimer());
 }
 
-QByteArray *QtScriptEngine_private::getData(quint32 idx) const
+packet_view QtScriptEngine_private::getData(quint32 idx) const
 {
     return m_base->getStorage()->get(idx);
 }
@@ -785,10 +787,10 @@ QScriptValue QtScriptEngine_private::__getData(QScriptContext *context, QScriptE
     if(idx >= count)
         return QScriptValue();
 
-    QByteArray *data = eng->getData(idx);
-    QScriptValue jsData = eng->newArray(data->size());
-    for(int i = 0; i < data->size(); ++i)
-        jsData.setProperty(i, QScriptValue(eng, (quint8)data->at(i)));
+    const packet_view data = eng->getData(idx);
+    QScriptValue jsData = eng->newArray(data.size);
+    for(quint32 i = 0; i < data.size; ++i)
+        jsData.setProperty(i, QScriptValue(eng, (quint8)data.data[i]));
     return jsData;
 }
 
@@ -797,6 +799,24 @@ QScriptValue QtScriptEngine_private::__getDataCount(QScriptContext */*context*/,
     return ((QtScriptEngine_private*)engine)->getDataCount();
 }
 
+QScriptValue QtScriptEngine_private::__getField(QScriptContext *context, QScriptEngine *engine)
+{
+    if(context->argumentCount() != 2 || !context->argument(0).isNumber())
+        return QScriptValue();
+
+    QtScriptEngine_private *eng = (QtScriptEngine_private*)engine;
+
+    quint32 idx = context->argument(0).toUInt32();
+    if(idx >= eng->getDataCount())
+        return QScriptValue();
+
+    analyzer_data data(eng->getData(idx), eng->m_base->getStorage()->getPacket());
+    QVariant val = DataWidget::getField(&data, context->argument(1).toString());
+    if(!val.isValid())
+        return QScriptValue();
+    return QScriptValue(eng, val.toDouble());
+}
+
 QScriptValue QtScriptEngine_private::__playErrorSound(QScriptContext *, QScriptEngine *)
 {
     Utils::playErrorSound();
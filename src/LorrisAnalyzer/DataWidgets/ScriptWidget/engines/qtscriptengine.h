@@ -50,7 +50,7 @@ private:
     int getHeight();
     QScriptValue newTimer();
     quint32 getDataCount() const;
-    QByteArray *getData(quint32 idx) const;
+    packet_view getData(quint32 idx) const;
 
     static QScriptValue __clearTerm(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __appendTerm(QScriptContext *context, QScriptEngine *engine);
@@ -69,6 +69,7 @@ private:
     static QScriptValue __resizeWidget(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __getData(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __getDataCount(QScriptContext *context, QScriptEngine *engine);
+    static QScriptValue __getField(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __playErrorSound(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __setMaxPacketNumber(QScriptContext *context, QScriptEngine *engine);
     static QScriptValue __setInterval(QScriptContext *context, QScriptEngine *engine);
@@ -13,6 +13,7 @@
 #include "engines/qtscriptengine.h"
 #include "../../../ui/terminal.h"
 #include "../../widgetarea.h"
+#include "../../storage.h"
 
 REGISTER_DATAWIDGET(WIDGET_SCRIPT, Script, NULL)
 W_TR(QT_TRANSLATE_NOOP("DataWidget", "Script"))
@@ -116,6 +117,17 @@ void ScriptWidget::newData(analyzer_data *data, quint32 index)
         m_terminal->appendText(res);
 }
 
+void ScriptWidget::handleBatch(analyzer_data *data, const std::vector<quint32>& indexes)
+{
+    // Scripts get every packet
+    analyzer_data cur(data->getPacket());
+    for(size_t i = 0; i < indexes.size(); ++i)
+    {
+        cur.setData(m_storage->get(indexes[i]));
+        newData(&cur, indexes[i]);
+    }
+}
+
 void ScriptWidget::saveWidgetInfo(DataFileParser *file)
 {
     DataWidget::saveWidgetInfo(file);
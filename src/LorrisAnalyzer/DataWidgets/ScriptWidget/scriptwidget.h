@@ -59,6 +59,7 @@ protected slots:
 
 protected:
      void newData(analyzer_data *data, quint32 index);
+     void handleBatch(analyzer_data *data, const std::vector<quint32>& indexes);
      void moveEvent(QMoveEvent *);
      void resizeEvent(QResizeEvent *);
      void titleDoubleClick();
@@ -19,6 +19,7 @@
 #include "datawidget.h"
 #include "../../WorkTab/WorkTab.h"
 #include "../widgetarea.h"
+#include "../storage.h"
 #include "../../misc/datafileparser.h"
 #include "../datafilter.h"
 #include "../../ui/floatinginputdialog.h"
@@ -31,12 +32,15 @@ DataWidget::DataWidget(QWidget *parent) :
     m_copy_widget = NULL;
 
     m_lockAction = NULL;
+    m_fieldMenu = NULL;
+    m_field_type = -1;
     m_sep_line = NULL;
     m_error_label = NULL;
     m_id = 0;
 
     m_widgetType = 0;
     m_widgetControlled = -1;
+    m_storage = NULL;
 
     m_error_label = NULL;
     m_error_blink_timer = NULL;
@@ -103,8 +107,10 @@ void DataWidget::setId(quint32 id)
     m_closeLabel->setId(id);
 }
 
-void DataWidget::setUp(Storage */*storage*/)
+void DataWidget::setUp(Storage *storage)
 {
+    m_storage = storage;
+
     setAcceptDrops(true);
     contextMenu = new QMenu(this);
 
@@ -117,6 +123,14 @@ void DataWidget::setUp(Storage */*storage*/)
     connect(setTitleAct, SIGNAL(triggered()), this, SLOT(setTitleTriggered()));
     contextMenu->addAction(setTitleAct);
 
+    // Widgets which show one number can be bound to a named field
+    if(metaObject()->indexOfSlot("setDataType(int)") != -1)
+    {
+        m_fieldMenu = contextMenu->addMenu(tr("Field"));
+        connect(m_fieldMenu, SIGNAL(aboutToShow()),      SLOT(fillFieldMenu()));
+        connect(m_fieldMenu, SIGNAL(triggered(QAction*)), SLOT(fieldTriggered(QAction*)));
+    }
+
     contextMenu->addSeparator();
     setContextMenuPolicy(Qt::DefaultContextMenu);
 
@@ -126,6 +140,74 @@ void DataWidget::setUp(Storage */*storage*/)
     connect(&m_gestures,  SIGNAL(gestureCompleted(int)),  SLOT(gestureCompleted(int)));
 }
 
+void DataWidget::fillFieldMenu()
+{
+    m_fieldMenu->clear();
+
+    analyzer_packet *packet = m_storage ? m_storage->getPacket() : NULL;
+    if(!packet || packet->layout.fields().empty())
+    {
+        m_fieldMenu->addAction(tr("No fields in packet structure"))->setEnabled(false);
+        return;
+    }
+
+    // Filter comes from drag&drop, field only changes the position
+    const std::vector<packet_field>& fields = packet->layout.fields();
+    for(size_t i = 0; i < fields.size(); ++i)
+    {
+        QAction *act = m_fieldMenu->addAction(fields[i].name);
+        act->setData((int)i);
+        act->setEnabled(isAssigned() && !isLocked());
+        act->setCheckable(true);
+        act->setChecked(isAssigned() && m_info.field == fields[i].name);
+    }
+}
+
+void DataWidget::fieldTriggered(QAction *act)
+{
+    analyzer_packet *packet = m_storage ? m_storage->getPacket() : NULL;
+    const int idx = act->data().toInt();
+    if(!packet || idx < 0 || idx >= (int)packet->layout.fields().size())
+        return;
+
+    const packet_field& field = packet->layout.fields()[idx];
+    m_info.field = field.name;
+    m_info.pos = field.pos;
+    m_field_type = field.type;
+    QMetaObject::invokeMethod(this, "setDataType", Q_ARG(int, field.type));
+
+    emit updateForMe();
+}
+
+// Named field can move or change its type when the structure is edited
+bool DataWidget::resolveField()
+{
+    if(m_info.field.isEmpty())
+        return true;
+
+    const packet_field *field = m_info.resolveField(m_storage ? m_storage->getPacket() : NULL);
+    if(!field)
+        return false;
+
+    if(field->type != m_field_type)
+    {
+        m_field_type = field->type;
+        QMetaObject::invokeMethod(this, "setDataType", Q_ARG(int, field->type));
+    }
+    return true;
+}
+
+const packet_field *data_widget_info::resolveField(analyzer_packet *packet)
+{
+    if(field.isEmpty() || !packet)
+        return NULL;
+
+    const packet_field *f = packet->layout.field(field);
+    if(f)
+        pos = f->pos;
+    return f;
+}
+
 void DataWidget::setTitleVisibility(bool visible)
 {
     m_closeLabel->setVisible(visible);
@@ -505,12 +587,17 @@ void DataWidget::dragMove(QMouseEvent *e, DataWidget *widget)
 
 void DataWidget::newData(analyzer_data *data, quint32 /*index*/)
 {
-    if(!isUpdating() || !isAssigned() || m_info.pos >= (quint32)data->getData().length())
+    if(!isUpdating() || !isAssigned() || !resolveField() || m_info.pos >= data->size())
         return;
 
     processData(data);
 }
 
+void DataWidget::handleBatch(analyzer_data *data, const std::vector<quint32>& indexes)
+{
+    newData(data, indexes.back());
+}
+
 void DataWidget::processData(analyzer_data */*data*/)
 {
 
@@ -590,6 +677,9 @@ void DataWidget::saveWidgetInfo(DataFileParser *file)
     file->writeBlockIdentifier("widgetDataInfoV2");
     saveDataInfo(file, m_info);
 
+    file->writeBlockIdentifier("widgetField");
+    file->writeString(m_info.field);
+
     // locked
     file->writeBlockIdentifier("widgetLocked");
     *file << isLocked();
@@ -614,6 +704,9 @@ void DataWidget::loadWidgetInfo(DataFileParser *file)
     {
         loadDataInfo(file, m_info);
         m_state |= STATE_ASSIGNED;
+
+        if(file->seekToNextBlock("widgetField", BLOCK_WIDGET))
+            m_info.field = file->readString();
     }
     else if(file->seekToNextBlock("widgetDataInfo", BLOCK_WIDGET))
     {
@@ -1090,6 +1183,14 @@ QVariant DataWidget::getNumFromPacket(analyzer_data *data, quint32 pos, quint8 t
     return res;
 }
 
+QVariant DataWidget::getField(analyzer_data *data, const QString &name)
+{
+    const packet_field *field = data->getPacket()->layout.field(name);
+    if(!field)
+        return QVariant();
+    return getNumFromPacket(data, field->pos, field->type);
+}
+
 QStringList DataWidget::getScriptEvents() {
     return QStringList();
 }
@@ -71,22 +71,28 @@ struct data_widget_info
 {
     quint32 pos;
     QtObjectPointer<DataFilter> filter;
+    QString field; // named field of packet structure, pos is taken from it
+
+    // Updates pos from the named field, returns NULL if the structure
+    // does not have it. Returns NULL if field is empty.
+    const packet_field *resolveField(analyzer_packet *packet);
 
     const data_widget_info& operator =(const data_widget_info& other)
     {
         pos = other.pos;
         filter = other.filter.data();
+        field = other.field;
         return *this;
     }
 
     bool operator==(const data_widget_info& other)
     {
-        return (other.pos == pos && other.filter.data() == filter.data());
+        return (other.pos == pos && other.filter.data() == filter.data() && other.field == field);
     }
 
     bool operator!=(const data_widget_info& other)
     {
-        return (other.pos != pos || other.filter.data() != filter.data());
+        return !(*this == other);
     }
 };
 
@@ -156,6 +162,7 @@ public:
     {
         m_info.filter = f;
         m_info.pos = pos;
+        m_info.field.clear();
     }
     const data_widget_info& getInfo() { return m_info; }
 
@@ -163,6 +170,8 @@ public:
     virtual void loadWidgetInfo(DataFileParser *file);
 
     static QVariant getNumFromPacket(analyzer_data *data, quint32 pos, quint8 type);
+    // Value of named field from packet's structure, see packet_field
+    static QVariant getField(analyzer_data *data, const QString& name);
 
     void setUpdating(bool update)
     {
@@ -194,6 +203,9 @@ public:
 
 public slots:
     virtual void newData(analyzer_data *data, quint32);
+    // Packets matched by filter since last update. Widgets which show
+    // only the latest value use just the last one, which is in data.
+    virtual void handleBatch(analyzer_data *data, const std::vector<quint32>& indexes);
     void setTitle(QString title);
     void lockTriggered();
     void remove();
@@ -256,6 +268,7 @@ protected:
     void setUseErrorLabel(bool use);
 
     quint8 m_widgetType;
+    Storage *m_storage;
     data_widget_info m_info;
     qint32 m_widgetControlled;
 
@@ -268,6 +281,8 @@ protected:
 
 private slots:
     void setTitleTriggered();
+    void fillFieldMenu();
+    void fieldTriggered(QAction *act);
     void gestureCompleted(int gesture);
     void blinkErrorLabel();
 
@@ -282,12 +297,15 @@ private:
     void startAnimation(const QRect& target);
 
     void copyWidget(QMouseEvent *ev);
+    bool resolveField();
 
     QPoint m_clickPos;
     quint8 m_dragAction;
     DataWidget *m_copy_widget;
 
     QAction *m_lockAction;
+    QMenu *m_fieldMenu;
+    int m_field_type; // type of m_info.field passed to setDataType(), -1 if none
     CloseLabel *m_closeLabel;
     QLabel *m_title_label;
     QLabel *m_icon_widget;
@@ -0,0 +1,215 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <string.h>
+#include <vector>
+#include <limits>
+#include <QtEndian>
+
+#include "numbercolumn.h"
+#include "datawidget.h"
+#include "../../misc/utils.h"
+
+#if defined(PROCESSOR_X86) && defined(Q_CC_GNU)
+  #include <tmmintrin.h>
+  #define NUMBERCOLUMN_SSSE3
+#endif
+
+namespace {
+
+template <typename U>
+void gather(const packet_view *packets, quint32 count, quint32 pos, U *out, quint8 *valid)
+{
+    for(quint32 i = 0; i < count; ++i)
+    {
+        const packet_view& p = packets[i];
+        if(quint64(pos) + sizeof(U) <= p.size)
+            memcpy(&out[i], p.data + pos, sizeof(U));
+        else
+            out[i] = 0;
+
+        if(valid)
+            valid[i] = (pos < p.size);
+    }
+}
+
+#ifdef NUMBERCOLUMN_SSSE3
+// Compiled for SSSE3 even if the rest is not, used only if the CPU has it
+__attribute__((target("ssse3")))
+quint32 swapSSSE3(char *data, quint32 count, quint8 size)
+{
+    static const char masks[3][16] = {
+        { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+        { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+        { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 },
+    };
+
+    const __m128i mask = _mm_loadu_si128((const __m128i*)masks[size == 2 ? 0 : (size == 4 ? 1 : 2)]);
+    const quint32 per_reg = 16 / size;
+
+    quint32 i = 0;
+    for(; i + per_reg <= count; i += per_reg)
+    {
+        __m128i *itr = (__m128i*)(data + i*size);
+        _mm_storeu_si128(itr, _mm_shuffle_epi8(_mm_loadu_si128(itr), mask));
+    }
+    return i;
+}
+
+bool hasSSSE3()
+{
+    static const bool res = __builtin_cpu_supports("ssse3");
+    return res;
+}
+#endif
+
+template <typename U>
+void swapAll(U *data, quint32 count)
+{
+    quint32 i = 0;
+#ifdef NUMBERCOLUMN_SSSE3
+    if(hasSSSE3())
+        i = swapSSSE3((char*)data, count, sizeof(U));
+#endif
+    for(; i < count; ++i)
+        data[i] = qbswap(data[i]);
+}
+
+template <>
+void swapAll<quint8>(quint8 *, quint32)
+{
+}
+
+// U is unsigned type of the same size as T, the bytes are moved as U
+template <typename T, typename U>
+void readDouble(const packet_view *packets, quint32 count, quint32 pos,
+                bool big_endian, double *out, quint8 *valid)
+{
+    std::vector<U> raw(count);
+    gather(packets, count, pos, &raw[0], valid);
+    if(big_endian)
+        swapAll(&raw[0], count);
+
+    for(quint32 i = 0; i < count; ++i)
+    {
+        T val;
+        memcpy(&val, &raw[i], sizeof(T));
+        out[i] = val;
+    }
+}
+
+template <typename T, typename U>
+void writeDouble(const double *in, quint32 count, bool big_endian, char *out)
+{
+    U *raw = (U*)out;
+    for(quint32 i = 0; i < count; ++i)
+    {
+        // Conversion of negative double to unsigned type is undefined,
+        // integers go through qint64
+        const T val = std::numeric_limits<T>::is_integer ? (T)(qint64)in[i] : (T)in[i];
+        memcpy(&raw[i], &val, sizeof(T));
+    }
+
+    if(big_endian)
+        swapAll(raw, count);
+}
+
+} // anonymous namespace
+
+quint8 NumberColumn::typeSize(quint8 type)
+{
+    switch(type)
+    {
+        case NUM_UINT8:
+        case NUM_INT8:
+            return 1;
+        case NUM_UINT16:
+        case NUM_INT16:
+            return 2;
+        case NUM_UINT32:
+        case NUM_INT32:
+        case NUM_FLOAT:
+            return 4;
+        case NUM_UINT64:
+        case NUM_INT64:
+        case NUM_DOUBLE:
+            return 8;
+    }
+    return 0;
+}
+
+void NumberColumn::toDouble(const packet_view *packets, quint32 count, quint32 pos,
+                            quint8 type, bool big_endian, double *out, quint8 *valid)
+{
+    if(count == 0)
+        return;
+
+    switch(type)
+    {
+        case NUM_UINT8:  readDouble<quint8,  quint8> (packets, count, pos, big_endian, out, valid); break;
+        case NUM_UINT16: readDouble<quint16, quint16>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_UINT32: readDouble<quint32, quint32>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_UINT64: readDouble<quint64, quint64>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_INT8:   readDouble<qint8,   quint8> (packets, count, pos, big_endian, out, valid); break;
+        case NUM_INT16:  readDouble<qint16,  quint16>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_INT32:  readDouble<qint32,  quint32>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_INT64:  readDouble<qint64,  quint64>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_FLOAT:  readDouble<float,   quint32>(packets, count, pos, big_endian, out, valid); break;
+        case NUM_DOUBLE: readDouble<double,  quint64>(packets, count, pos, big_endian, out, valid); break;
+        default:
+            memset(out, 0, count*sizeof(double));
+            if(valid)
+                memset(valid, 0, count);
+            break;
+    }
+}
+
+void NumberColumn::toNative(const packet_view *packets, quint32 count, quint32 pos,
+                            quint8 type, bool big_endian, char *out, quint8 *valid)
+{
+    switch(typeSize(type))
+    {
+        case 1: gather(packets, count, pos, (quint8*)out, valid); break;
+        case 2: gather(packets, count, pos, (quint16*)out, valid); break;
+        case 4: gather(packets, count, pos, (quint32*)out, valid); break;
+        case 8: gather(packets, count, pos, (quint64*)out, valid); break;
+        default:
+            if(valid)
+                memset(valid, 0, count);
+            return;
+    }
+
+    if(big_endian)
+        swapBytes(out, count, typeSize(type));
+}
+
+void NumberColumn::fromDouble(const double *in, quint32 count, quint8 type, bool big_endian, char *out)
+{
+    switch(type)
+    {
+        case NUM_UINT8:  writeDouble<quint8,  quint8> (in, count, big_endian, out); break;
+        case NUM_UINT16: writeDouble<quint16, quint16>(in, count, big_endian, out); break;
+        case NUM_UINT32: writeDouble<quint32, quint32>(in, count, big_endian, out); break;
+        case NUM_UINT64: writeDouble<quint64, quint64>(in, count, big_endian, out); break;
+        case NUM_INT8:   writeDouble<qint8,   quint8> (in, count, big_endian, out); break;
+        case NUM_INT16:  writeDouble<qint16,  quint16>(in, count, big_endian, out); break;
+        case NUM_INT32:  writeDouble<qint32,  quint32>(in, count, big_endian, out); break;
+        case NUM_INT64:  writeDouble<qint64,  quint64>(in, count, big_endian, out); break;
+        case NUM_FLOAT:  writeDouble<float,   quint32>(in, count, big_endian, out); break;
+        case NUM_DOUBLE: writeDouble<double,  quint64>(in, count, big_endian, out); break;
+    }
+}
+
+void NumberColumn::swapBytes(char *data, quint32 count, quint8 size)
+{
+    switch(size)
+    {
+        case 2: swapAll((quint16*)data, count); break;
+        case 4: swapAll((quint32*)data, count); break;
+        case 8: swapAll((quint64*)data, count); break;
+    }
+}
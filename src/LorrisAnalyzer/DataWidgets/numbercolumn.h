@@ -0,0 +1,44 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef NUMBERCOLUMN_H
+#define NUMBERCOLUMN_H
+
+#include <QtGlobal>
+
+#include "../storagedata.h"
+
+// Bulk version of DataWidget::getNumFromPacket(), reads one number field
+// from many packets at once. Values are first gathered to contiguous
+// array, byte order of the whole array is then swapped at once (with
+// SSSE3 if the CPU has it) and converted.
+//
+// type is one of NumberTypes. valid can be NULL, valid[i] is set to 0
+// if packet i does not reach pos, values which do not fit whole to the
+// packet are read as 0, same as analyzer_data::read().
+class NumberColumn
+{
+public:
+    static quint8 typeSize(quint8 type);
+
+    static void toDouble(const packet_view *packets, quint32 count, quint32 pos,
+                         quint8 type, bool big_endian, double *out, quint8 *valid = NULL);
+
+    // out must have count*typeSize(type) bytes, byte order is swapped
+    // if big_endian is set, same as in analyzer_data::read()
+    static void toNative(const packet_view *packets, quint32 count, quint32 pos,
+                         quint8 type, bool big_endian, char *out, quint8 *valid = NULL);
+
+    // Converts values to type in given byte order, used by export
+    static void fromDouble(const double *in, quint32 count, quint8 type,
+                           bool big_endian, char *out);
+
+    // Swaps byte order of count values of given size in place
+    static void swapBytes(char *data, quint32 count, quint8 size);
+};
+
+#endif // NUMBERCOLUMN_H
@@ -7,6 +7,7 @@
 
 #include <QScrollArea>
 #include <QApplication>
+#include <algorithm>
 
 #include "datafilter.h"
 #include "../misc/utils.h"
@@ -21,6 +22,8 @@ DataFilter::DataFilter(quint8 type, quint32 id, QString name, QObject *parent) :
     m_layout = NULL;
     m_area = NULL;
     m_lastIdx = 0;
+    m_index_start = m_index_end = 0;
+    m_revision = 0;
 }
 
 DataFilter::~DataFilter()
@@ -58,6 +61,7 @@ void DataFilter::connectWidget(DataWidget *w, bool exclusive)
     disconnect(w, 0, this, 0);
 
     connect(this, SIGNAL(newData(analyzer_data*,quint32)), w, SLOT(newData(analyzer_data*,quint32)));
+    connect(this, SIGNAL(newBatch(analyzer_data*,std::vector<quint32>)), w, SLOT(handleBatch(analyzer_data*,std::vector<quint32>)));
     connect(w,    SIGNAL(updateForMe()),                      SLOT(updateForWidget()));
     connect(w,    SIGNAL(mouseStatus(bool,data_widget_info,qint32)), SLOT(widgetMouseStatus(bool,data_widget_info,qint32)));
 }
@@ -78,7 +82,7 @@ void DataFilter::sendLastData()
 
 void DataFilter::clearLastData()
 {
-    m_lastData.setData(NULL);
+    m_lastData.clearData();
 }
 
 void DataFilter::handleData(analyzer_data *data, quint32 idx)
@@ -87,12 +91,102 @@ void DataFilter::handleData(analyzer_data *data, quint32 idx)
         return;
 
     m_layout->SetData(data);
-    m_lastData.copy(data);
+
+    // Own copy, the packet might get evicted from storage
+    m_lastData.copyData(data);
     m_lastIdx = idx;
 
     emit newData(data, idx);
 }
 
+void DataFilter::isOkayBatch(analyzer_data *data, const packet_view *packets,
+                             quint32 count, std::vector<quint8> &mask)
+{
+    mask.resize(count);
+    for(quint32 i = 0; i < count; ++i)
+    {
+        data->setData(packets[i]);
+        mask[i] = isOkay(data);
+    }
+}
+
+void DataFilter::matchBatch(analyzer_data *data, const std::vector<packet_view>& packets,
+                            quint32 first_idx, quint64 first_seq)
+{
+    if(packets.empty())
+        return;
+
+    isOkayBatch(data, packets.data(), packets.size(), m_mask);
+
+    for(quint32 i = 0; i < packets.size(); ++i)
+    {
+        indexPacket(first_seq + i, m_mask[i]);
+
+        if(m_mask[i] && m_layout)
+            m_batch.push_back(first_idx + i);
+    }
+}
+
+void DataFilter::resetIndex(quint64 seq)
+{
+    m_matches.clear();
+    m_index_start = m_index_end = seq;
+}
+
+void DataFilter::trimIndex(quint64 first_seq)
+{
+    if(m_index_end < first_seq)
+    {
+        resetIndex(first_seq);
+        return;
+    }
+
+    while(!m_matches.empty() && m_matches.front() < first_seq)
+        m_matches.pop_front();
+    m_index_start = (std::max)(m_index_start, first_seq);
+}
+
+void DataFilter::indexPacket(quint64 seq, bool match)
+{
+    // Some packets were not indexed, start again from this one
+    if(seq != m_index_end)
+        resetIndex(seq);
+
+    if(match)
+        m_matches.push_back(seq);
+    m_index_end = seq + 1;
+}
+
+void DataFilter::indexPacketFront(quint64 seq, bool match)
+{
+    Q_ASSERT(seq + 1 == m_index_start);
+
+    if(match)
+        m_matches.push_front(seq);
+    m_index_start = seq;
+}
+
+void DataFilter::getMatches(quint64 start, quint64 end, std::vector<quint64>& out) const
+{
+    std::deque<quint64>::const_iterator first = std::lower_bound(m_matches.begin(), m_matches.end(), start);
+    std::deque<quint64>::const_iterator last = std::lower_bound(first, m_matches.end(), end);
+    out.insert(out.end(), first, last);
+}
+
+void DataFilter::sendBatch(analyzer_data *data)
+{
+    if(m_batch.empty())
+        return;
+
+    m_layout->SetData(data);
+
+    m_lastData.copyData(data);
+    m_lastIdx = m_batch.back();
+
+    emit newBatch(data, m_batch);
+    m_batch.clear();
+}
+
 void DataFilter::setHeader(analyzer_header *header)
 {
     if(m_layout)
@@ -219,6 +313,23 @@ bool ConditionFilter::isOkay(analyzer_data *data)
     return !m_conditions.empty();
 }
 
+void ConditionFilter::isOkayBatch(analyzer_data *data, const packet_view *packets,
+                                  quint32 count, std::vector<quint8> &mask)
+{
+    mask.assign(count, !m_conditions.empty());
+    for(quint32 i = 0; i < m_conditions.size(); ++i)
+        m_conditions[i]->filterBatch(data, packets, count, mask);
+}
+
+bool ConditionFilter::canIndexInBackground() const
+{
+    // Script engine can be used only from GUI thread
+    for(quint32 i = 0; i < m_conditions.size(); ++i)
+        if(m_conditions[i]->getType() == COND_SCRIPT)
+            return false;
+    return true;
+}
+
 void ConditionFilter::removeCondition(FilterCondition *c)
 {
     for(std::vector<FilterCondition*>::iterator itr = m_conditions.begin(); itr != m_conditions.end(); ++itr)
@@ -287,6 +398,19 @@ FilterCondition *FilterCondition::createCondition(quint8 type)
     }
 }
 
+void FilterCondition::filterBatch(analyzer_data *data, const packet_view *packets,
+                                  quint32 count, std::vector<quint8> &mask)
+{
+    for(quint32 i = 0; i < count; ++i)
+    {
+        if(!mask[i])
+            continue;
+
+        data->setData(packets[i]);
+        mask[i] = isOkay(data);
+    }
+}
+
 void FilterCondition::save(DataFileParser *file)
 {
     file->writeBlockIdentifier("filterCondition");
@@ -355,7 +479,7 @@ void CmdFilterCondition::load(DataFileParser *file)
 bool ByteFilterCondition::isOkay(analyzer_data *data)
 {
     try {
-        if(m_pos < (quint32)data->getData().length())
+        if(m_pos < data->size())
             return data->getUInt8(m_pos) == m_byte;
     }
     catch(const char*) {
@@ -394,14 +518,21 @@ ScriptFilterCondition::ScriptFilterCondition(int engine) : FilterCondition(COND_
     m_script = QObject::tr("// Return true if okay, false to filter out\n"
                   "function dataPass(data, dev, cmd) {\n"
                   "    return false;\n"
-                  "}\n");
+                  "}\n"
+                  "\n"
+                  "// Optionally, many packets can be checked in one call:\n"
+                  "// function dataPassBatch(data, offsets, devs, cmds)\n"
+                  "// data is a string with bytes of all packets, use data.charCodeAt(i).\n"
+                  "// Packet i is from offsets[i] to offsets[i+1]. Return array of booleans.\n");
     m_engine.pushContext();
+    m_array = m_engine.newArray();
 }
 
 void ScriptFilterCondition::setScript(const QString &script)
 {
     m_error.clear();
     m_script = script;
+    m_func = m_batchFunc = QScriptValue();
 
     m_engine.popContext();
     QScriptContext *ctx = m_engine.pushContext();
@@ -414,6 +545,7 @@ void ScriptFilterCondition::setScript(const QString &script)
     }
 
     m_func = ctx->activationObject().property("dataPass");
+    m_batchFunc = ctx->activationObject().property("dataPassBatch");
     if(!m_func.isFunction())
     {
         m_error = QObject::tr("Could not find dataPass function!");
@@ -439,14 +571,15 @@ bool ScriptFilterCondition::isOkay(analyzer_data *data)
     if(!m_func.isFunction())
         return false;
 
-    const QByteArray& pkt_data = data->getData();
+    const char *pkt_data = data->data();
 
-    QScriptValue jsData = m_engine.newArray(pkt_data.size());
-    for(qint32 i = 0; i < pkt_data.size(); ++i)
-        jsData.setProperty(i, QScriptValue(&m_engine, (quint8)pkt_data[i]));
+    // The array is reused, this only truncates it
+    m_array.setProperty("length", QScriptValue(&m_engine, data->size()));
+    for(quint32 i = 0; i < data->size(); ++i)
+        m_array.setProperty(i, QScriptValue(&m_engine, (quint8)pkt_data[i]));
 
     QScriptValueList args;
-    args.push_back(jsData);
+    args.push_back(m_array);
 
     quint8 res = 0;
     if(data->getDeviceId(res)) args << res;
@@ -459,6 +592,51 @@ bool ScriptFilterCondition::isOkay(analyzer_data *data)
     return val.toBool();
 }
 
+void ScriptFilterCondition::filterBatch(analyzer_data *data, const packet_view *packets,
+                                        quint32 count, std::vector<quint8> &mask)
+{
+    if(!m_batchFunc.isFunction())
+    {
+        FilterCondition::filterBatch(data, packets, count, mask);
+        return;
+    }
+
+    QScriptValue offsets = m_engine.newArray(count+1);
+    QScriptValue devs = m_engine.newArray(count);
+    QScriptValue cmds = m_engine.newArray(count);
+
+    // Bytes go to script as one string, it is much faster to create
+    // than array with property for every byte
+    QByteArray bytes;
+    quint32 off = 0;
+    quint8 res = 0;
+    for(quint32 i = 0; i < count; ++i)
+    {
+        offsets.setProperty(i, QScriptValue(&m_engine, off));
+        bytes.append(packets[i].data, packets[i].size);
+        off += packets[i].size;
+
+        data->setData(packets[i]);
+        devs.setProperty(i, data->getDeviceId(res) ? QScriptValue(&m_engine, res) : QScriptValue(&m_engine, -1));
+        cmds.setProperty(i, data->getCmd(res) ? QScriptValue(&m_engine, res) : QScriptValue(&m_engine, -1));
+    }
+    offsets.setProperty(count, QScriptValue(&m_engine, off));
+
+    QScriptValueList args;
+    args << QScriptValue(&m_engine, QString::fromLatin1(bytes.constData(), bytes.size()))
+         << offsets << devs << cmds;
+
+    QScriptValue val = m_batchFunc.call(QScriptValue(), args);
+    if(m_engine.hasUncaughtException())
+    {
+        mask.assign(count, 0);
+        return;
+    }
+
+    for(quint32 i = 0; i < count; ++i)
+        mask[i] = mask[i] && val.property(i).toBool();
+}
+
 QString ScriptFilterCondition::getDesc() const
 {
     return QObject::tr("Script");
@@ -10,6 +10,7 @@
 
 #include <QString>
 #include <vector>
+#include <deque>
 #include <QScriptEngine>
 
 #include "../misc/datafileparser.h"
@@ -43,6 +44,11 @@ public:
     virtual bool isOkay(analyzer_data *data) = 0;
     virtual QString getDesc() const = 0;
 
+    // Clears mask of packets which do not pass, packets which are already
+    // cleared can be skipped. data is used for reading the packets.
+    virtual void filterBatch(analyzer_data *data, const packet_view *packets,
+                             quint32 count, std::vector<quint8>& mask);
+
     virtual void save(DataFileParser *file);
     virtual void load(DataFileParser *file);
 
@@ -123,6 +129,8 @@ public:
     ScriptFilterCondition(int engine);
 
     bool isOkay(analyzer_data *data);
+    void filterBatch(analyzer_data *data, const packet_view *packets,
+                     quint32 count, std::vector<quint8>& mask);
     void save(DataFileParser *file);
     void load(DataFileParser *file);
 
@@ -139,6 +147,8 @@ private:
     int m_lang;
     QScriptEngine m_engine;
     QScriptValue m_func;
+    QScriptValue m_batchFunc; // optional dataPassBatch()
+    QScriptValue m_array; // reused for every packet
     QString m_error;
 };
 
@@ -156,6 +166,7 @@ class DataFilter : public QObject
 
 Q_SIGNALS:
     void newData(analyzer_data *data, quint32 idx);
+    void newBatch(analyzer_data *data, const std::vector<quint32>& indexes);
     void activateTab();
 
 public:
@@ -165,6 +176,12 @@ public:
     static DataFilter *createFilter(quint8 type, quint32 id, const QString& name, QObject *parent);
 
     virtual bool isOkay(analyzer_data *data) = 0;
+    // Sets mask[i] to 1 if packets[i] passes, 0 otherwise
+    virtual void isOkayBatch(analyzer_data *data, const packet_view *packets,
+                             quint32 count, std::vector<quint8>& mask);
+    // isOkayBatch() can be called from FilterIndexer thread while
+    // GUI thread uses the filter too
+    virtual bool canIndexInBackground() const { return true; }
 
     virtual void save(DataFileParser *file);
     virtual void load(DataFileParser *file);
@@ -173,6 +190,14 @@ public:
     void setAreaAndLayout(QScrollArea *a, ScrollDataLayout *l);
     void handleData(analyzer_data *data, quint32 idx);
 
+    // Batch delivery, see FilterTabWidget::handleBatch(). sendBatch()
+    // gets data of the last matched packet. first_seq is sequence number
+    // of the first packet, see StorageData::firstSeq()
+    void matchBatch(analyzer_data *data, const std::vector<packet_view>& packets,
+                    quint32 first_idx, quint64 first_seq);
+    const std::vector<quint32>& getBatch() const { return m_batch; }
+    void sendBatch(analyzer_data *data);
+
     quint8 getType() const { return m_type; }
     QString getName() const { return m_name; }
     quint32 getId() const { return m_id; }
@@ -183,9 +208,30 @@ public:
     void clearLastData();
     void connectWidget(DataWidget *w, bool exclusive = true);
 
+    // Match index: sorted sequence numbers of matching packets from range
+    // [getIndexStart(), getIndexEnd()). New packets are appended by
+    // matchBatch(), FilterTabWidget fills the rest in the background.
+    bool isIndexed(quint64 start, quint64 end) const
+    {
+        return start >= m_index_start && end <= m_index_end;
+    }
+    // Appends matching packets from [start, end) to out
+    void getMatches(quint64 start, quint64 end, std::vector<quint64>& out) const;
+    quint64 getIndexStart() const { return m_index_start; }
+    quint64 getIndexEnd() const { return m_index_end; }
+    void resetIndex(quint64 seq);
+    void trimIndex(quint64 first_seq);
+    void indexPacket(quint64 seq, bool match);
+    void indexPacketFront(quint64 seq, bool match);
+
     void setDividers(const std::vector<int>& dividers);
     const std::vector<int>& getDividers() const { return m_dividers; }
 
+    // Changes when conditions or packet structure may have changed,
+    // values widgets cached from matching packets are stale then
+    quint32 getRevision() const { return m_revision; }
+    void conditionsChanged() { ++m_revision; }
+
 protected slots:
     void updateForWidget();
     void widgetMouseStatus(bool in, const data_widget_info &info, qint32 parent);
@@ -198,6 +244,13 @@ protected:
 
     analyzer_data m_lastData;
     quint32 m_lastIdx;
+    std::vector<quint32> m_batch;
+
+    std::vector<quint8> m_mask;
+    std::deque<quint64> m_matches;
+    quint64 m_index_start;
+    quint64 m_index_end;
+    quint32 m_revision;
 
     ScrollDataLayout *m_layout;
     QScrollArea *m_area;
@@ -211,6 +264,9 @@ public:
     ~ConditionFilter();
 
     bool isOkay(analyzer_data *data);
+    void isOkayBatch(analyzer_data *data, const packet_view *packets,
+                     quint32 count, std::vector<quint8>& mask);
+    bool canIndexInBackground() const;
     void save(DataFileParser *file);
     void load(DataFileParser *file);
 
@@ -233,6 +289,10 @@ public:
     EmptyFilter(quint32 id, QString name, QObject *parent);
 
     bool isOkay(analyzer_data *) { return true; }
+    void isOkayBatch(analyzer_data *, const packet_view *, quint32 count, std::vector<quint8>& mask)
+    {
+        mask.assign(count, 1);
+    }
 };
 
 
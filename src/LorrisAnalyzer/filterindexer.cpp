@@ -0,0 +1,118 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "filterindexer.h"
+#include "datafilter.h"
+#include "storage.h"
+#include "packet.h"
+
+FilterIndexer::FilterIndexer(QObject *parent) :
+    QThread(parent)
+{
+    m_filter = NULL;
+    m_packet = NULL;
+    m_revision = 0;
+    m_start = 0;
+}
+
+FilterIndexer::~FilterIndexer()
+{
+    reset();
+}
+
+void FilterIndexer::reset()
+{
+    stop();
+
+    if(m_packet)
+    {
+        delete m_packet->header;
+        delete m_packet;
+        m_packet = NULL;
+    }
+
+    m_filter = NULL;
+    m_data.clear();
+    m_packets.clear();
+    m_mask.clear();
+    m_cancel.fetchAndStoreOrdered(0);
+}
+
+void FilterIndexer::start(DataFilter *filter, analyzer_packet *packet, const Storage *storage, quint64 end)
+{
+    reset();
+
+    const quint64 first_seq = storage->getFirstSeq();
+
+    // Packets are taken from the end, until one of the limits is reached
+    quint64 start = end;
+    quint32 bytes = 0;
+    while(start > first_seq && end - start < JOB_PACKETS && bytes < JOB_BYTES)
+        bytes += storage->get(--start - first_seq).size;
+
+    m_data.resize(bytes);
+    m_packets.resize(end - start);
+
+    char *itr = m_data.data();
+    for(quint32 i = 0; i < m_packets.size(); ++i)
+    {
+        const packet_view p = storage->get(start + i - first_seq);
+        memcpy(itr, p.data, p.size);
+        m_packets[i] = packet_view(itr, p.size, p.time);
+        itr += p.size;
+    }
+
+    m_filter = filter;
+    m_packet = new analyzer_packet(packet);
+    m_revision = filter->getRevision();
+    m_start = start;
+
+    QThread::start(QThread::LowPriority);
+}
+
+void FilterIndexer::stop()
+{
+    m_cancel.fetchAndStoreOrdered(1);
+    wait();
+}
+
+bool FilterIndexer::takeResult(std::vector<quint8>& mask)
+{
+    wait();
+
+    if(!m_filter)
+        return false;
+    m_filter = NULL;
+
+    if(m_cancel.fetchAndAddOrdered(0) != 0 || m_mask.size() != m_packets.size())
+        return false;
+
+    mask.swap(m_mask);
+    return true;
+}
+
+void FilterIndexer::run()
+{
+    analyzer_data data(m_packet);
+    std::vector<quint8> mask;
+
+    m_mask.clear();
+    m_mask.reserve(m_packets.size());
+
+    for(quint32 i = 0; i < m_packets.size(); i += CHUNK)
+    {
+        if(m_cancel.fetchAndAddOrdered(0) != 0)
+            return;
+
+        const quint32 count = (std::min)((quint32)CHUNK, (quint32)m_packets.size() - i);
+        m_filter->isOkayBatch(&data, m_packets.data() + i, count, mask);
+        m_mask.insert(m_mask.end(), mask.begin(), mask.end());
+    }
+}
@@ -0,0 +1,67 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef FILTERINDEXER_H
+#define FILTERINDEXER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <vector>
+
+#include "storagedata.h"
+
+struct analyzer_packet;
+class DataFilter;
+class Storage;
+
+// Rebuilds match index of one filter in background thread, see
+// DataFilter::canIndexInBackground(). Each job checks packets older than
+// the filter's index, they are copied from Storage when the job starts,
+// so the storage can be changed while the thread runs. Result is merged
+// to the index by GUI thread after finished().
+class FilterIndexer : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum { JOB_PACKETS = 64*1024, JOB_BYTES = 4*1024*1024, CHUNK = 256 };
+
+    explicit FilterIndexer(QObject *parent = 0);
+    ~FilterIndexer();
+
+    // Checks up to JOB_PACKETS packets before sequence number end. filter
+    // must not be changed nor deleted until the thread finishes, see stop().
+    void start(DataFilter *filter, analyzer_packet *packet, const Storage *storage, quint64 end);
+    void stop();
+
+    DataFilter *getFilter() const { return m_filter; }
+    quint32 getRevision() const { return m_revision; }
+    // sequence number of the first checked packet
+    quint64 getStart() const { return m_start; }
+
+    // Returns false if the job was cancelled. Clears getFilter(),
+    // which is not NULL while a job is running or its result was not taken.
+    bool takeResult(std::vector<quint8>& mask);
+
+protected:
+    void run();
+
+private:
+    void reset();
+
+    DataFilter *m_filter;
+    analyzer_packet *m_packet; // own copy
+    quint32 m_revision;
+    quint64 m_start;
+    QByteArray m_data;
+    std::vector<packet_view> m_packets;
+    std::vector<quint8> m_mask;
+    QAtomicInt m_cancel;
+};
+
+#endif // FILTERINDEXER_H
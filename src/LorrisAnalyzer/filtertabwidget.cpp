@@ -18,8 +18,10 @@
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonValue>
+#include <QTimer>
 
 #include <map>
+#include <algorithm>
 
 #include "filtertabwidget.h"
 #include "packet.h"
@@ -28,12 +30,22 @@
 #include "labellayout.h"
 #include "../misc/utils.h"
 #include "../ui/editorwidget.h"
+#include "storage.h"
+#include "filterindexer.h"
 
 FilterTabWidget::FilterTabWidget(QWidget *parent) :
     QTabWidget(parent)
 {
     m_filterIdCounter = 0;
     m_header = NULL;
+    m_editing = false;
+
+    m_indexTimer = new QTimer(this);
+    m_indexTimer->setInterval(0);
+    connect(m_indexTimer, SIGNAL(timeout()), SLOT(updateIndex()));
+
+    m_indexer = new FilterIndexer(this);
+    connect(m_indexer, SIGNAL(finished()), SLOT(indexJobFinished()));
 
     setTabPosition(QTabWidget::South);
 
@@ -48,6 +60,7 @@ FilterTabWidget::FilterTabWidget(QWidget *parent) :
 
 FilterTabWidget::~FilterTabWidget()
 {
+    stopIndexJob();
     delete_vect(m_filters);
 }
 
@@ -210,11 +223,13 @@ void FilterTabWidget::setHeader(analyzer_header *h)
     m_header = h;
     for(quint32 i = 0; i < m_filters.size(); ++i)
         m_filters[i]->setHeader(h);
+    invalidateIndex();
 }
 
 void FilterTabWidget::removeAll()
 {
     m_filterIdCounter = 0;
+    stopIndexJob();
     delete_vect(m_filters);
 
     addEmptyFilter();
@@ -230,12 +245,212 @@ void FilterTabWidget::handleData(analyzer_data *data, quint32 index)
 {
     for(quint32 i = 0; i < m_filters.size(); ++i)
         m_filters[i]->handleData(data, index);
+
+    // Packets might have been added without handleBatch()
+    scheduleIndexUpdate();
+}
+
+void FilterTabWidget::handleBatch(quint32 first_idx, quint32 last_idx)
+{
+    if(m_filters.empty())
+        return;
+
+    analyzer_data data(analyzer()->getPacket());
+    const quint64 first_seq = analyzer()->getStorage()->getFirstSeq();
+
+    // Packets which were added without a batch
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+    {
+        m_filters[i]->trimIndex(first_seq);
+        indexForward(m_filters[i], first_seq + first_idx, data, NULL);
+    }
+
+    // Filters check the whole batch at once
+    m_packets.clear();
+    for(quint32 idx = first_idx; idx <= last_idx; ++idx)
+        m_packets.push_back(analyzer()->getDataAt(idx));
+
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+        m_filters[i]->matchBatch(&data, m_packets, first_idx, first_seq + first_idx);
+
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+    {
+        DataFilter *f = m_filters[i];
+        if(f->getBatch().empty())
+            continue;
+
+        data.setData(analyzer()->getDataAt(f->getBatch().back()));
+        f->sendBatch(&data);
+    }
+}
+
+void FilterTabWidget::indexBatch(quint32 /*first_idx*/, quint32 last_idx)
+{
+    if(m_filters.empty())
+        return;
+
+    analyzer_data data(analyzer()->getPacket());
+    const quint64 first_seq = analyzer()->getStorage()->getFirstSeq();
+
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+    {
+        m_filters[i]->trimIndex(first_seq);
+        indexForward(m_filters[i], first_seq + last_idx + 1, data, NULL);
+    }
+}
+
+void FilterTabWidget::invalidateIndex()
+{
+    // Start at the end, so that new packets are indexed right away
+    // and the older ones are filled in from the newest
+    const Storage *storage = analyzer()->getStorage();
+    const quint64 end = storage->getFirstSeq() + storage->getSize();
+
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+    {
+        m_filters[i]->resetIndex(end);
+        m_filters[i]->conditionsChanged();
+    }
+    scheduleIndexUpdate();
+}
+
+void FilterTabWidget::scheduleIndexUpdate()
+{
+    if(!m_indexTimer->isActive())
+        m_indexTimer->start();
+}
+
+// Indexes packets up to end, returns false if timer ran out
+bool FilterTabWidget::indexForward(DataFilter *f, quint64 end, analyzer_data& data, const QElapsedTimer *timer)
+{
+    const Storage *storage = analyzer()->getStorage();
+    const quint64 first_seq = storage->getFirstSeq();
+
+    while(f->getIndexEnd() < end)
+    {
+        if(timer && timer->elapsed() >= INDEX_SLICE_MS)
+            return false;
+
+        const quint64 start = f->getIndexEnd();
+        const quint64 chunk_end = (std::min)(end, start + INDEX_CHUNK);
+
+        m_packets.clear();
+        for(quint64 seq = start; seq < chunk_end; ++seq)
+            m_packets.push_back(storage->get(seq - first_seq));
+
+        f->isOkayBatch(&data, m_packets.data(), m_packets.size(), m_mask);
+        for(size_t i = 0; i < m_packets.size(); ++i)
+            f->indexPacket(start + i, m_mask[i]);
+    }
+    return true;
+}
+
+// Indexes older packets, newest first
+bool FilterTabWidget::indexBackward(DataFilter *f, analyzer_data& data, const QElapsedTimer *timer)
+{
+    const Storage *storage = analyzer()->getStorage();
+    const quint64 first_seq = storage->getFirstSeq();
+
+    while(f->getIndexStart() > first_seq)
+    {
+        if(timer->elapsed() >= INDEX_SLICE_MS)
+            return false;
+
+        const quint64 end = f->getIndexStart();
+        const quint64 start = end - (std::min)(end - first_seq, (quint64)INDEX_CHUNK);
+
+        m_packets.clear();
+        for(quint64 seq = start; seq < end; ++seq)
+            m_packets.push_back(storage->get(seq - first_seq));
+
+        f->isOkayBatch(&data, m_packets.data(), m_packets.size(), m_mask);
+        for(size_t i = m_packets.size(); i > 0; --i)
+            f->indexPacketFront(start + i - 1, m_mask[i-1]);
+    }
+    return true;
+}
+
+void FilterTabWidget::updateIndex()
+{
+    const Storage *storage = analyzer()->getStorage();
+    if(!analyzer()->getPacket() || storage->isEmpty())
+    {
+        m_indexTimer->stop();
+        return;
+    }
+
+    const quint64 first_seq = storage->getFirstSeq();
+    const quint64 end = first_seq + storage->getSize();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    analyzer_data data(analyzer()->getPacket());
+    for(quint32 i = 0; i < m_filters.size(); ++i)
+    {
+        DataFilter *f = m_filters[i];
+        f->trimIndex(first_seq);
+
+        if(!indexForward(f, end, data, &timer))
+            return;
+
+        if(f->getIndexStart() <= first_seq)
+            continue;
+
+        // indexJobFinished() schedules next update
+        if(f->canIndexInBackground())
+        {
+            if(!m_indexer->getFilter() && !m_editing)
+                m_indexer->start(f, analyzer()->getPacket(), storage, f->getIndexStart());
+            continue;
+        }
+
+        if(!indexBackward(f, data, &timer))
+            return;
+    }
+
+    m_indexTimer->stop();
+}
+
+void FilterTabWidget::indexJobFinished()
+{
+    // Signal of cancelled job can come after the next one was started
+    if(m_indexer->isRunning())
+        return;
+
+    DataFilter *f = m_indexer->getFilter();
+    if(m_indexer->takeResult(m_mask) && f->getRevision() == m_indexer->getRevision() &&
+       f->getIndexStart() == m_indexer->getStart() + m_mask.size())
+    {
+        // Packets might have been dropped meanwhile
+        const quint64 start = m_indexer->getStart();
+        const quint64 first_seq = analyzer()->getStorage()->getFirstSeq();
+        for(size_t i = m_mask.size(); i > 0 && start + i > first_seq; --i)
+            f->indexPacketFront(start + i - 1, m_mask[i-1]);
+    }
+
+    scheduleIndexUpdate();
+}
+
+void FilterTabWidget::stopIndexJob()
+{
+    // Filters must not be changed while the job uses them,
+    // the rest of index is built after the next update
+    m_indexer->stop();
 }
 
 void FilterTabWidget::showSettings()
 {
+    stopIndexJob();
+    m_editing = true;
+
     FilterDialog d(this);
     d.exec();
+
+    m_editing = false;
+
+    // Conditions were probably changed
+    invalidateIndex();
 }
 
 void FilterTabWidget::addFilter(DataFilter *f)
@@ -268,6 +483,8 @@ void FilterTabWidget::addFilter(DataFilter *f)
     }
 
     connect(f, SIGNAL(activateTab()), SLOT(activateTab()));
+
+    scheduleIndexUpdate();
 }
 
 void FilterTabWidget::removeFilter(DataFilter *f)
@@ -277,6 +494,7 @@ void FilterTabWidget::removeFilter(DataFilter *f)
         if(m_filters[i] != f)
             continue;
 
+        stopIndexJob();
         m_filters.erase(m_filters.begin()+i);
         delete f;
     }
@@ -10,6 +10,7 @@
 
 #include <QTabWidget>
 #include <QFrame>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 
 #include <map>
@@ -27,6 +28,8 @@ class QComboBox;
 class analyzer_data;
 class EditorWidget;
 class DataFileParser;
+class QTimer;
+class FilterIndexer;
 struct analyzer_header;
 struct data_widget_info;
 
@@ -62,20 +65,43 @@ public:
     void sendLastData();
     void clearLastData();
 
+    // Match indexes of filters are rebuilt by FilterIndexer, filters
+    // with scripts in idle time, see DataFilter. Also tells widgets
+    // to drop values cached from matching packets.
+    void invalidateIndex();
+    void scheduleIndexUpdate();
+    // Indexes packets which are not delivered to filters by handleBatch()
+    void indexBatch(quint32 first_idx, quint32 last_idx);
+
 public slots:
     void handleData(analyzer_data *data, quint32 index);
+    void handleBatch(quint32 first_idx, quint32 last_idx);
 
 private slots:
     void showSettings();
     void activateTab();
+    void updateIndex();
+    void indexJobFinished();
 
 private:
+    enum { INDEX_SLICE_MS = 10, INDEX_CHUNK = 256 };
+
     void addEmptyFilter();
+    void stopIndexJob();
+    bool indexForward(DataFilter *f, quint64 end, analyzer_data& data, const QElapsedTimer *timer);
+    bool indexBackward(DataFilter *f, analyzer_data& data, const QElapsedTimer *timer);
     inline LorrisAnalyzer *analyzer() const { return (LorrisAnalyzer*)parent(); }
 
     analyzer_header *m_header;
     std::vector<DataFilter*> m_filters;
     quint32 m_filterIdCounter;
+    QTimer *m_indexTimer;
+    FilterIndexer *m_indexer;
+    bool m_editing; // FilterDialog is open, no jobs are started
+
+    // reused buffers for batch filtering
+    std::vector<packet_view> m_packets;
+    std::vector<quint8> m_mask;
 };
 
 class FilterDialog : public QDialog, private Ui::FilterDialog
@@ -342,11 +342,11 @@ void ScrollDataLayout::fmtChanged(int fmt)
 void ScrollDataLayout::SetData(analyzer_data *data)
 {
     QString value;
-    const QByteArray& bytes = data->getData();
+    const char *bytes = data->data();
 
     lenChanged(data->getLenght());
 
-    for(quint32 i = 0; i < (quint32)bytes.size() && i < m_labels.size(); ++i)
+    for(quint32 i = 0; i < data->size() && i < m_labels.size(); ++i)
     {
         switch(m_format)
         {
@@ -24,6 +24,8 @@
 #include <QFileDialog>
 #include <QStringBuilder>
 #include <QToolBar>
+#include <QProgressDialog>
+#include <QFileInfo>
 
 #include "lorrisanalyzer.h"
 #include "sourcedialog.h"
@@ -36,6 +38,7 @@
 #include "DataWidgets/datawidget.h"
 #include "widgetfactory.h"
 #include "searchwidget.h"
+#include "parseworker.h"
 #include "../ui/floatinginputdialog.h"
 
 #include "ui_lorrisanalyzer.h"
@@ -47,10 +50,21 @@ static bool sortDataWidget(DataWidgetAddBtn *a, DataWidgetAddBtn *b)
 
 LorrisAnalyzer::LorrisAnalyzer()
     : ui(new Ui::LorrisAnalyzer),
-     m_storage(this), m_parser(&m_storage, this), m_connectButton(0)
+     m_storage(this), m_connectButton(0)
 {
     ui->setupUi(this);
 
+    m_worker = new ParseWorker(&m_parseThread);
+    connect(m_worker->batchChannel(), SIGNAL(dataReceived()), SLOT(batchesReceived()));
+    m_parseThread.start();
+
+    m_pauseCount = 0;
+    m_storageBusy = false;
+    m_reframeDlg = NULL;
+    m_reframeEnd = 0;
+    m_framing = FRAME_NONE;
+    connect(&m_reframer, SIGNAL(finished()), SLOT(framingFinished()));
+
     connect(ui->collapseTop,     SIGNAL(clicked()),         SLOT(collapseTopButton()));
     connect(ui->collapseRight,   SIGNAL(clicked()),         SLOT(collapseRightButton()));
     connect(ui->collapseLeft,    SIGNAL(clicked()),         SLOT(collapseLeftButton()));
@@ -63,7 +77,6 @@ LorrisAnalyzer::LorrisAnalyzer()
     connect(ui->playFrame,       SIGNAL(enablePosSet(bool)),    ui->timeSlider, SLOT(setEnabled(bool)));
     connect(ui->dataArea,        SIGNAL(updateData()),      SLOT(updateData()));
     connect(ui->limitBtn,        SIGNAL(clicked()),         SLOT(setPacketLimit()));
-    connect(&m_parser,           SIGNAL(packetReceived(analyzer_data*,quint32)), SIGNAL(newData(analyzer_data*,quint32)));
     connect(ui->dataArea,        SIGNAL(mouseStatus(bool,data_widget_info,qint32)),
                                  SLOT(widgetMouseStatus(bool,data_widget_info, qint32)));
     connect(this,                SIGNAL(newData(analyzer_data*,quint32)), ui->filterTabs,
@@ -92,6 +105,8 @@ LorrisAnalyzer::LorrisAnalyzer()
     menuData->addSeparator();
     QAction* importAct = menuData->addAction(tr("Import binary data"));
     QAction* exportAct = menuData->addAction(tr("Export binary data"));
+    m_recordAct = menuData->addAction(tr("Record to disk..."));
+    QAction* importRecAct = menuData->addAction(tr("Import recording..."));
     menuData->addSeparator();
     QAction* clearAct = menuData->addAction(QIcon(":/actions/clear"), tr("Clear received data"));
     QAction* clearAllAct = menuData->addAction(tr("Clear everything"));
@@ -108,6 +123,9 @@ LorrisAnalyzer::LorrisAnalyzer()
     QAction *structAct = new QAction(QIcon(":/actions/system"), tr("Change structure"), this);
 
     exportAct->setStatusTip(tr("Export received bytes as binary file"));
+    m_recordAct->setStatusTip(tr("Write all received packets to files in a folder, keep only recent ones in memory"));
+    m_recordAct->setCheckable(true);
+    importRecAct->setStatusTip(tr("Load packets from segment files written by \"Record to disk\""));
     structAct->setStatusTip(tr("Change structure of incoming data"));
 
     QToolBar *bar = new QToolBar(this);
@@ -133,6 +151,9 @@ LorrisAnalyzer::LorrisAnalyzer()
     connect(structAct,      SIGNAL(triggered()),     SLOT(editStructure()));
     connect(exportAct,      SIGNAL(triggered()),     SLOT(exportBin()));
     connect(importAct,      SIGNAL(triggered()),     SLOT(importBinAct()));
+    connect(m_recordAct,    SIGNAL(triggered(bool)), SLOT(recordButton(bool)));
+    connect(importRecAct,   SIGNAL(triggered()),     SLOT(importRecording()));
+    connect(&m_storage,     SIGNAL(recordingError(QString)), SLOT(recordingError(QString)));
 
     ui->dataArea->setAnalyzerAndStorage(this, &m_storage);
 
@@ -174,6 +195,12 @@ LorrisAnalyzer::~LorrisAnalyzer()
 {
     qApp->removeEventFilter(this);
 
+    cancelFraming();
+
+    m_parseThread.quit();
+    m_parseThread.wait();
+    delete m_worker;
+
     delete m_searchWidget;
 
     if(m_packet)
@@ -193,9 +220,44 @@ void LorrisAnalyzer::connectedStatus(bool)
 
 void LorrisAnalyzer::readData(const QByteArray& data)
 {
+    const qint64 time = Utils::monotonicTimestamp();
+    m_storage.getRawLog()->append(data, time);
+
+    // Parsed when framing job finishes, see framingFinished()
+    if(m_framing == FRAME_NONE)
+        m_worker->addData(data, time);
+}
+
+void LorrisAnalyzer::batchesReceived()
+{
+    // Picked up when saving or loading finishes
+    if(m_storageBusy)
+        return;
+
+    std::vector<StorageData*> batches;
+    m_worker->takeBatches(batches);
+
     bool atMax = (m_curIndex == (quint32)ui->timeSlider->maximum());
-    bool update = atMax || (m_storage.getSize() >= (quint32)m_storage.getPacketLimit());
-    if(!m_parser.newData(data, update))
+    quint32 received = 0;
+
+    for(size_t i = 0; i < batches.size(); ++i)
+    {
+        bool update = atMax || m_storage.isFull();
+        quint32 count = m_storage.appendBatch(*batches[i]);
+        delete batches[i];
+
+        received += count;
+        if(!count)
+            continue;
+
+        const quint32 size = m_storage.getSize();
+        if(update)
+            ui->filterTabs->handleBatch(size - (std::min)(count, size), size - 1);
+        else
+            ui->filterTabs->indexBatch(size - (std::min)(count, size), size - 1);
+    }
+
+    if(!received)
         return;
 
     m_data_changed = true;
@@ -215,6 +277,161 @@ void LorrisAnalyzer::readData(const QByteArray& data)
     }
 }
 
+void LorrisAnalyzer::setParserPacket(analyzer_packet *packet)
+{
+    m_worker->setPacket(packet);
+}
+
+void LorrisAnalyzer::dropBatches()
+{
+    std::vector<StorageData*> batches;
+    m_worker->takeBatches(batches);
+    for(size_t i = 0; i < batches.size(); ++i)
+        delete batches[i];
+}
+
+void LorrisAnalyzer::setParserPaused(bool pause)
+{
+    // Pauses are nested, re-framing keeps the parser paused
+    // after the dialog which started it is closed
+    if(pause)
+        ++m_pauseCount;
+    else if(m_pauseCount)
+        --m_pauseCount;
+
+    m_worker->setPaused(m_pauseCount != 0);
+}
+
+void LorrisAnalyzer::startReframe()
+{
+    RawLog *log = m_storage.getRawLog();
+    if(!m_packet || log->empty() || !log->isComplete())
+        return;
+
+    setParserPaused(true);
+
+    // Bytes waiting in the worker are in the log too
+    m_worker->dropInput();
+
+    std::vector<raw_chunk> chunks;
+    log->getChunks(0, chunks);
+
+    startFraming(FRAME_REFRAME, tr("Framing received data with new structure..."));
+    m_reframer.start(chunks, m_packet);
+}
+
+void LorrisAnalyzer::startImport(const QString& filename, bool add)
+{
+    setParserPaused(true);
+
+    // Imported bytes are logged only if the whole file fits
+    const RawLog *log = m_storage.getRawLog();
+    const quint64 size = QFileInfo(filename).size();
+    const bool keep = log->isComplete() && log->byteSize() + size <= log->getLimit();
+
+    startFraming(add ? FRAME_IMPORT_ADD : FRAME_IMPORT, tr("Importing your data..."));
+    m_reframer.start(filename, m_packet, keep);
+}
+
+void LorrisAnalyzer::startFraming(framing_job job, const QString& text)
+{
+    m_framing = job;
+    m_reframeEnd = m_storage.getRawLog()->endSeq();
+
+    m_reframeDlg = new QProgressDialog(text, tr("Cancel"), 0, 100, this);
+    m_reframeDlg->setMinimumDuration(500);
+    connect(&m_reframer, SIGNAL(progress(int)), m_reframeDlg, SLOT(setValue(int)));
+    connect(m_reframeDlg, SIGNAL(canceled()), &m_reframer, SLOT(cancel()));
+}
+
+void LorrisAnalyzer::framingFinished()
+{
+    // finished() of cancelled run can arrive after new one was started
+    if(m_framing == FRAME_NONE || m_reframer.isRunning() || m_storageBusy)
+        return;
+
+    const framing_job job = m_framing;
+    m_framing = FRAME_NONE;
+    delete m_reframeDlg;
+    m_reframeDlg = NULL;
+
+    RawLog *log = m_storage.getRawLog();
+    StorageData *data = m_reframer.takeResult();
+    const bool done = (data != NULL);
+    if(done)
+    {
+        if(job == FRAME_REFRAME)
+        {
+            // Packets of old structure
+            dropBatches();
+
+            m_storage.replaceData(*data);
+            ui->filterTabs->clearLastData();
+        }
+        else
+        {
+            // Imported bytes must directly follow the ones already in the log
+            std::vector<raw_chunk> chunks;
+            m_reframer.takeChunks(chunks);
+            if(!data->empty() && (chunks.empty() || log->endSeq() != m_reframeEnd))
+                log->setIncomplete();
+            else
+            {
+                for(size_t i = 0; i < chunks.size(); ++i)
+                    log->append(chunks[i].data, chunks[i].time);
+            }
+
+            m_storage.appendBatch(*data);
+        }
+        delete data;
+
+        ui->filterTabs->invalidateIndex();
+
+        quint32 max = m_storage.getMaxIdx();
+        m_curIndex = max;
+        ui->timeSlider->setMaximum(max);
+        ui->timeSlider->setValue(max);
+        ui->timeBox->setMaximum(max);
+        ui->timeBox->setSuffix(tr(" of ") % QString::number(m_storage.getSize()));
+        ui->timeBox->setValue(max);
+        m_data_changed = true;
+        updateData();
+    }
+
+    // Bytes received meanwhile
+    std::vector<raw_chunk> chunks;
+    log->getChunks(m_reframeEnd, chunks);
+
+    setParserPaused(false);
+    for(size_t i = 0; i < chunks.size(); ++i)
+        m_worker->addData(chunks[i].data, chunks[i].time);
+
+    if(!m_reframer.getError().isEmpty())
+        Utils::showErrorBox(m_reframer.getError());
+    else if(done && job == FRAME_IMPORT_ADD)
+    {
+        // Structure could have been changed for the import
+        startReframe();
+    }
+}
+
+LorrisAnalyzer::framing_job LorrisAnalyzer::cancelFraming()
+{
+    const framing_job job = m_framing;
+    if(job == FRAME_NONE)
+        return job;
+
+    m_framing = FRAME_NONE;
+    m_reframer.cancel();
+    delete m_reframer.takeResult();
+
+    delete m_reframeDlg;
+    m_reframeDlg = NULL;
+
+    setParserPaused(false);
+    return job;
+}
+
 void LorrisAnalyzer::onTabShow(const QString& filename)
 {
     if(!filename.isEmpty())
@@ -238,7 +455,7 @@ void LorrisAnalyzer::doNewSource()
     if(!askToSave())
         return;
 
-    m_parser.setPaused(true);
+    setParserPaused(true);
     SourceSelectDialog s(this);
 
     if(!m_con)
@@ -247,16 +464,18 @@ void LorrisAnalyzer::doNewSource()
     switch(s.get())
     {
         case -1:
-            m_parser.setPaused(false);
+            setParserPaused(false);
             break;
         case 0:
         {
             analyzer_packet *packet = SourceDialog::getStructure(NULL, m_con.data());
-
-            m_parser.setPaused(false);
             if(!packet)
+            {
+                setParserPaused(false);
                 break;
+            }
 
+            cancelFraming();
             if(m_packet)
             {
                 delete m_packet->header;
@@ -265,6 +484,7 @@ void LorrisAnalyzer::doNewSource()
 
             resetDevAndStorage(packet);
             setPacket(packet);
+            setParserPaused(false);
             m_data_changed = true;
             break;
         }
@@ -272,12 +492,14 @@ void LorrisAnalyzer::doNewSource()
         {
             QString file = s.getFileName();
             quint8 mask = s.getDataMask();
+            setParserPaused(false);
             load(file, mask);
             m_data_changed = false;
             break;
         }
         case 2:
         {
+            setParserPaused(false);
             importBinary(s.getFileName());
             break;
         }
@@ -286,13 +508,17 @@ void LorrisAnalyzer::doNewSource()
 
 void LorrisAnalyzer::importBinary(const QString& filename, bool reset)
 {
+    // Parse thread must not use the packet which is about to be deleted
+    setParserPaused(true);
+
     analyzer_packet *packet = SourceDialog::getStructure(reset ? NULL : m_packet, NULL, filename);
     if(!packet)
     {
-        m_parser.setPaused(false);
+        setParserPaused(false);
         return;
     }
 
+    cancelFraming();
     if(m_packet)
     {
         delete m_packet->header;
@@ -306,33 +532,13 @@ void LorrisAnalyzer::importBinary(const QString& filename, bool reset)
     else
     {
         ui->filterTabs->setHeader(packet->header);
-        m_parser.setPacket(packet);
+        setParserPacket(packet);
         m_storage.setPacket(packet);
     }
 
-    m_parser.setPaused(false);
-
-    QFile f(filename);
-    if(!f.open(QIODevice::ReadOnly))
-        return Utils::showErrorBox(tr("Could not open file %1 for reading!").arg(filename));
-
-    QMessageBox box(QMessageBox::Information, tr("Importing..."), tr("Importing your data..."));
-    box.setStandardButtons(QMessageBox::NoButton);
-    box.setWindowModality(Qt::ApplicationModal);
-    box.open();
-
-    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
-
-    m_parser.newData(f.readAll(), false);
-    f.close();
+    setParserPaused(false);
 
-    quint32 max = m_storage.getMaxIdx();
-    ui->timeSlider->setMaximum(max);
-    ui->timeSlider->setValue(max);
-    ui->timeBox->setMaximum(max);
-    ui->timeBox->setSuffix(tr(" of ") % QString::number(m_storage.getSize()));
-    ui->timeBox->setValue(max);
-    updateData();
+    startImport(filename, !reset);
 }
 
 bool LorrisAnalyzer::onTabClose()
@@ -427,24 +633,44 @@ analyzer_data *LorrisAnalyzer::getLastData(quint32 &idx)
     return &m_curData;
 }
 
-QByteArray *LorrisAnalyzer::getDataAt(quint32 idx)
+packet_view LorrisAnalyzer::getDataAt(quint32 idx)
 {
     if(idx >= m_storage.getSize())
-        return NULL;
+        return packet_view();
 
     return m_storage.get(idx);
 }
 
 bool LorrisAnalyzer::load(QString &name, quint8 mask)
 {
+    setParserPaused(true);
+
+    // old packet is deleted in Storage::loadFromFile()
+    const framing_job job = cancelFraming();
+
+    // Loading processes events, batches of the old data must not
+    // get into the loaded storage
+    m_storageBusy = true;
     quint32 idx = 0;
     analyzer_packet *packet = m_storage.loadFromFile(&name, mask, ui->dataArea, ui->filterTabs, idx);
+    m_storageBusy = false;
+
     if(!packet)
+    {
+        batchesReceived();
+        if(job == FRAME_REFRAME)
+            startReframe();
+        setParserPaused(false);
         return false;
+    }
 
-    // old packet deleted in Storage::loadFromFile()
     setPacket(packet);
-    m_parser.setPacket(packet);
+    // Also drops batches, storage was replaced by the file
+    setParserPacket(packet);
+
+    // Loaded packets have no raw bytes
+    if(!m_storage.isEmpty())
+        m_storage.getRawLog()->setIncomplete();
 
     if(!ui->filterTabs->count())
         ui->filterTabs->reset(packet->header);
@@ -458,7 +684,7 @@ bool LorrisAnalyzer::load(QString &name, quint8 mask)
     ui->timeBox->setMaximum(m_storage.getMaxIdx());
     ui->timeBox->setSuffix(tr(" of ") % QString::number(m_storage.getSize()));
     ui->timeBox->setValue(idx);
-    m_parser.setPaused(false);
+    setParserPaused(false);
 
     updateData();
     ui->filterTabs->sendLastData();
@@ -466,9 +692,24 @@ bool LorrisAnalyzer::load(QString &name, quint8 mask)
     return true;
 }
 
+void LorrisAnalyzer::saveStorage(const QString *filename)
+{
+    // Writer runs event loop while it waits for the disk, storage
+    // must stay the same until all packets are written
+    m_storageBusy = true;
+    if(filename)
+        m_storage.SaveToFile(*filename, ui->dataArea, ui->filterTabs);
+    else
+        m_storage.SaveToFile(ui->dataArea, ui->filterTabs);
+    m_storageBusy = false;
+
+    batchesReceived();
+    framingFinished();
+}
+
 void LorrisAnalyzer::saveButton()
 {
-    m_storage.SaveToFile(ui->dataArea, ui->filterTabs);
+    saveStorage(NULL);
 
     if(m_storage.getFilename().isEmpty())
         return;
@@ -480,7 +721,9 @@ void LorrisAnalyzer::saveButton()
 
 void LorrisAnalyzer::saveAsButton()
 {
-    m_storage.SaveToFile("", ui->dataArea, ui->filterTabs);
+    // Empty name asks for a new one
+    const QString filename;
+    saveStorage(&filename);
     if(m_storage.getFilename().isEmpty())
         return;
 
@@ -523,6 +766,102 @@ void LorrisAnalyzer::importBinAct()
     importBinary(filename, false);
 }
 
+void LorrisAnalyzer::recordButton(bool record)
+{
+    if(!record)
+    {
+        m_storage.stopRecording();
+        return;
+    }
+
+    QString folder = QFileDialog::getExistingDirectory(this, tr("Record to folder"),
+                                                       sConfig.get(CFG_STRING_ANALYZER_REC_FOLDER));
+    if(folder.isEmpty())
+        return m_recordAct->setChecked(false);
+
+    try {
+        m_storage.startRecording(folder);
+    } catch(const QString& ex) {
+        m_recordAct->setChecked(false);
+        return Utils::showErrorBox(ex);
+    }
+
+    sConfig.set(CFG_STRING_ANALYZER_REC_FOLDER, folder);
+    emit statusBarMsg(tr("Recording to folder \"%1\"").arg(folder), 5000);
+}
+
+void LorrisAnalyzer::importRecording()
+{
+    static const QString filters = QObject::tr("Lorris recordings (*.lrec)");
+    QStringList files = QFileDialog::getOpenFileNames(this, tr("Import recording"),
+                                                      sConfig.get(CFG_STRING_ANALYZER_REC_FOLDER),
+                                                      filters);
+    if(files.isEmpty())
+        return;
+
+    // Names start with the time of the segment
+    files.sort();
+
+    StorageData data;
+    analyzer_packet *packet = NULL;
+    int skipped = 0;
+    try {
+        packet = Recorder::readSegments(files, data, skipped);
+    } catch(const QString& ex) {
+        return Utils::showErrorBox(ex);
+    }
+
+    setParserPaused(true);
+    cancelFraming();
+
+    // Widgets are kept when the recording has the current structure
+    if(m_packet && Recorder::sameStructure(m_packet, packet))
+    {
+        delete packet->header;
+        delete packet;
+        m_worker->setPacket(m_packet);
+    }
+    else
+    {
+        if(m_packet)
+        {
+            delete m_packet->header;
+            delete m_packet;
+        }
+        resetDevAndStorage(packet);
+        setPacket(packet);
+    }
+
+    m_storage.replaceData(data);
+
+    // Recorded packets have no raw bytes
+    if(!m_storage.isEmpty())
+        m_storage.getRawLog()->setIncomplete();
+
+    ui->filterTabs->clearLastData();
+    ui->filterTabs->invalidateIndex();
+
+    m_curIndex = m_storage.getMaxIdx();
+    ui->timeSlider->setMaximum(m_curIndex);
+    ui->timeSlider->setValue(m_curIndex);
+    ui->timeBox->setMaximum(m_curIndex);
+    ui->timeBox->setSuffix(tr(" of ") % QString::number(m_storage.getSize()));
+    ui->timeBox->setValue(m_curIndex);
+    setParserPaused(false);
+
+    updateData();
+
+    if(skipped)
+        Utils::showErrorBox(tr("%1 segment(s) with different packet structure were skipped.").arg(skipped));
+}
+
+void LorrisAnalyzer::recordingError(const QString &error)
+{
+    m_storage.stopRecording();
+    m_recordAct->setChecked(false);
+    Utils::showErrorBox(error);
+}
+
 void LorrisAnalyzer::widgetMouseStatus(bool in, const data_widget_info &, qint32 parent)
 {
     if(parent != -1)
@@ -601,6 +940,8 @@ void LorrisAnalyzer::clearAllButton()
     if(box.exec())
         return;
 
+    cancelFraming();
+
     analyzer_packet *packet = m_packet;
     setPacket(NULL);
 
@@ -626,7 +967,10 @@ void LorrisAnalyzer::clearAllButton()
 
 void LorrisAnalyzer::clearData()
 {
-    m_parser.resetCurPacket();
+    cancelFraming();
+
+    // Drops partially received packet
+    m_worker->setPacket(m_packet);
     m_storage.Clear();
 
     m_curIndex = 0;
@@ -645,7 +989,7 @@ void LorrisAnalyzer::resetDevAndStorage(analyzer_packet *packet)
 
     ui->dataArea->clear();
 
-    m_parser.setPacket(packet);
+    setParserPacket(packet);
     m_storage.Clear();
     m_storage.setPacket(packet);
     m_storage.clearFilename();
@@ -676,12 +1020,16 @@ void LorrisAnalyzer::openFile()
 
 void LorrisAnalyzer::editStructure()
 {
-    m_parser.setPaused(true);
+    setParserPaused(true);
     analyzer_packet *packet = SourceDialog::getStructure(m_packet, m_con.data());
 
     if(packet)
     {
-        m_parser.setPacket(packet);
+        // It uses the old packet
+        cancelFraming();
+
+        // Drops packets parsed with the old structure
+        setParserPacket(packet);
 
         if(m_packet)
         {
@@ -696,9 +1044,12 @@ void LorrisAnalyzer::editStructure()
         m_storage.setPacket(packet);
         setPacket(packet);
 
+        // Packets of old structure are replaced when it finishes
+        startReframe();
+
         updateData();
     }
-    m_parser.setPaused(false);
+    setParserPaused(false);
 }
 
 quint32 LorrisAnalyzer::getCurrentIndex()
@@ -755,7 +1106,8 @@ void LorrisAnalyzer::saveData(DataFileParser *file)
         if(!info.path().isEmpty())
         {
             QString cfg_name = sConfig.get(CFG_STRING_ANALYZER_FOLDER);
-            m_storage.SaveToFile(info.absoluteFilePath(), ui->dataArea, ui->filterTabs);
+            const QString path = info.absoluteFilePath();
+            saveStorage(&path);
             m_storage.clearFilename();
             sConfig.set(CFG_STRING_ANALYZER_FOLDER, cfg_name);
 
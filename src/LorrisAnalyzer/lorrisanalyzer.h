@@ -10,6 +10,7 @@
 
 #include <QMutex>
 #include <QTime>
+#include <QThread>
 
 #include "../WorkTab/WorkTab.h"
 #include "packet.h"
@@ -17,6 +18,7 @@
 #include "../ui/connectbutton.h"
 #include "storage.h"
 #include "packetparser.h"
+#include "reframer.h"
 
 class QVBoxLayout;
 class QHBoxLayout;
@@ -29,6 +31,9 @@ class QSpinBox;
 class QScrollArea;
 class DataFilter;
 class SearchWidget;
+class QAction;
+class ParseWorker;
+class QProgressDialog;
 
 enum hideable_areas
 {
@@ -60,8 +65,9 @@ public:
     bool isAreaVisible(quint8 area);
     void setAreaVisibility(quint8 area, bool visible);
     analyzer_data *getLastData(quint32& idx);
-    QByteArray *getDataAt(quint32 idx);
+    packet_view getDataAt(quint32 idx);
     analyzer_packet *getPacket() const { return m_packet; }
+    Storage *getStorage() { return &m_storage; }
     void setEnableSearchWidget(bool enable);
 
     quint32 getCurrentIndex();
@@ -99,6 +105,9 @@ private slots:
     void saveAsButton();
     void exportBin();
     void importBinAct();
+    void recordButton(bool record);
+    void importRecording();
+    void recordingError(const QString& error);
     void clearAllButton();
     void openFile();
     void setPacketLimit();
@@ -112,24 +121,61 @@ private slots:
     void onPacketLimitChanged(int limit);
 
     void updateForWidget();
+    void batchesReceived();
+    void framingFinished();
 
 private:
     void readData(const QByteArray& data);
     bool load(QString& name, quint8 mask);
     void importBinary(const QString& filename, bool reset = true);
     void resetDevAndStorage(analyzer_packet *packet = NULL);
+    void setParserPacket(analyzer_packet *packet);
+    // Deletes batches which the worker parsed but batchesReceived() did
+    // not take yet. Call after the worker's packet was reset.
+    void dropBatches();
+    void setParserPaused(bool pause);
     void setPacket(analyzer_packet *packet);
     bool askToSave();
+    // filename is passed to Storage::SaveToFile, NULL saves to the current file
+    void saveStorage(const QString *filename);
+
+    enum framing_job
+    {
+        FRAME_NONE,
+        FRAME_REFRAME,
+        FRAME_IMPORT,
+        FRAME_IMPORT_ADD // re-framed afterwards, structure could have changed
+    };
+
+    // Framing jobs run in m_reframer. Parser is paused until the job
+    // finishes, bytes received meanwhile are parsed then.
+
+    // Frames whole raw log again with m_packet, does nothing
+    // if the log is empty or incomplete.
+    void startReframe();
+    void startImport(const QString& filename, bool add);
+    void startFraming(framing_job job, const QString& text);
+    // Must be called before m_packet is deleted, returns the cancelled job
+    framing_job cancelFraming();
 
     Ui::LorrisAnalyzer *ui;
     Storage m_storage;
     analyzer_packet *m_packet;
-    PacketParser m_parser;
+    QThread m_parseThread;
+    ParseWorker *m_worker;
+    quint32 m_pauseCount;
+    bool m_storageBusy; // storage is being saved or loaded, batches wait in the worker
+
+    Reframer m_reframer;
+    QProgressDialog *m_reframeDlg;
+    quint64 m_reframeEnd; // raw log chunks from this one were received during the job
+    framing_job m_framing;
 
     bool m_data_changed;
     quint32 m_curIndex;
 
     ConnectButton * m_connectButton;
+    QAction *m_recordAct;
     analyzer_data m_curData;
     bool m_rightVisible;
 
@@ -5,187 +5,384 @@
 **    See README and COPYING
 ***********************************************/
 
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define PACKET_USE_SSE2
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
 #include "packet.h"
 #include "../common.h"
 
-analyzer_data::analyzer_data(QByteArray *data, analyzer_packet *packet)
+packet_layout::packet_layout()
 {
-    m_packet = packet;
-    m_data = data;
+    m_valid = false;
+    m_big_endian = false;
+    m_static_offset = 0;
+    m_dev_pos = -1;
+    m_cmd_pos = -1;
+    m_cmd_shift = 0;
+    m_base_len = 0;
+    m_has_len = false;
+    m_len_pos = -1;
+    m_len_bytes = 1;
+    m_len_shift = 24;
+    m_len_mask = 0xFF;
+    m_len_offset = 0;
 }
 
-void analyzer_data::clear()
+void packet_layout::compile(analyzer_packet *packet)
 {
-    if(m_data)
-        m_data->clear();
-}
+    m_fields.clear();
+    m_field_idx.clear();
 
-void analyzer_data::copy(analyzer_data *other)
-{
-    m_data = other->m_data;
-    m_packet = other->m_packet;
-}
+    m_valid = (packet && packet->header);
+    if(!m_valid)
+        return;
 
-quint32 analyzer_data::addData(char *d_itr, char *d_end, quint32 &itr)
-{
-    if(!m_packet)
-        return 0;
+    analyzer_header *h = packet->header;
 
-    QByteArray static_data = m_packet->getStaticData();
-    const quint32 staticOffset = m_packet->getStaticDataOffset();
-    const quint32 staticOffsetEnd = staticOffset + static_data.length();
-    quint32 staticItr = 0;
-    bool readFromHeader = false;
-    quint32 len = getLenght(&readFromHeader);
-    quint32 var_len = 0;
+    m_big_endian = packet->big_endian;
+    m_static = QByteArray((const char*)packet->static_data.data(), h->static_len);
+    m_static_offset = packet->getStaticDataOffset();
 
-    quint8 lenRead = m_packet->header->hasLen();
+    m_dev_pos = (h->data_mask & DATA_DEVICE_ID) ? h->findDataPos(DATA_DEVICE_ID) : -1;
+    m_cmd_pos = -1;
+    m_cmd_shift = 0;
+    if(h->data_mask & DATA_OPCODE)
+        m_cmd_pos = h->findDataPos(DATA_OPCODE);
+    else if(h->data_mask & DATA_AVAKAR)
+    {
+        m_cmd_pos = h->findDataPos(DATA_AVAKAR);
+        m_cmd_shift = 4;
+    }
 
-    quint32 read = 0;
-    for(quint32 i = itr; i < len && d_itr+read != d_end; ++i)
+    m_has_len = h->hasLen();
+    m_base_len = m_has_len ? h->length : h->packet_length;
+    m_len_offset = h->len_offset;
+    m_len_pos = -1;
+    m_len_bytes = 1;
+
+    bool avakar = false;
+    if(h->data_mask & DATA_LEN)
     {
-        if(i >= staticOffset && i < staticOffsetEnd)
-        {
-            if(static_data[staticItr] != *(d_itr+read))
-                return read;
-            ++staticItr;
-        }
-        else if(!readFromHeader && lenRead == DATA_LEN && getLenFromHeader(var_len))
+        if(h->len_fmt <= 2)
         {
-            len += var_len;
-            lenRead = 0;
+            m_len_pos = h->findDataPos(DATA_LEN);
+            m_len_bytes = 1 << h->len_fmt;
         }
-
-        (*m_data)[itr++] = *(d_itr+read++);
     }
-    return read;
+    else if(h->data_mask & DATA_AVAKAR)
+    {
+        m_len_pos = h->findDataPos(DATA_AVAKAR);
+        avakar = true;
+    }
+
+    m_len_shift = 32 - 8*m_len_bytes;
+    m_len_mask = avakar ? 0xF : (0xFFFFFFFF >> m_len_shift);
+
+    m_fields = packet->fields;
+    for(size_t i = 0; i < m_fields.size(); ++i)
+        m_field_idx.insert(m_fields[i].name, i);
 }
 
-quint32 analyzer_data::getLenght(bool *readFromHeader)
+inline quint32 packet_layout::decodeLen(const char *data) const
 {
-    if(m_packet->header->hasLen())
-    {
-        quint32 res = 0;
-        if(getLenFromHeader(res))
-        {
-            if(readFromHeader)
-                *readFromHeader = true;
-            return res + m_packet->header->length;
-        }
-        else
-        {
-            if(readFromHeader)
-                *readFromHeader = false;
-            return m_packet->header->length;
-        }
-    }
-    else
-        return m_packet->header->packet_length;
+    quint32 val = 0;
+    memcpy(&val, data, m_len_bytes);
+
+    quint32 swapped = val;
+    Utils::swapEndian(swapped);
+    swapped >>= m_len_shift;
+
+    return (m_big_endian ? swapped : val) & m_len_mask;
 }
 
-bool analyzer_data::isValid(quint32 itr)
+quint32 packet_layout::length(const char *data, quint32 size, bool *readFromHeader) const
 {
-    if(!m_packet)
-        return false;
+    if(!m_has_len)
+        return m_base_len;
 
-    QByteArray static_data = m_packet->getStaticData();
+    if(readFromHeader)
+        *readFromHeader = false;
 
-    if(m_data->isEmpty() || itr < (quint32)static_data.length())
-        return false;
+    if(m_len_pos < 0 || !data || quint64(m_len_pos) + m_len_bytes > size)
+        return m_base_len;
 
-    quint32 static_pos = m_packet->header->findDataPos(DATA_STATIC);
-    for(quint8 i = 0; i < static_data.length(); ++i)
-    {
-        if((*m_data)[static_pos++] != static_data[i])
-            return false;
-    }
+    if(readFromHeader)
+        *readFromHeader = true;
+    return m_base_len + decodeLen(data + m_len_pos) + m_len_offset;
+}
 
-    if(itr != getLenght())
+bool packet_layout::deviceId(const char *data, quint32 size, quint8& id) const
+{
+    if(m_dev_pos < 0 || !data || (quint32)m_dev_pos >= size)
         return false;
+
+    id = (quint8)data[m_dev_pos];
     return true;
 }
 
-bool analyzer_data::getDeviceId(quint8& id)
+bool packet_layout::cmd(const char *data, quint32 size, quint8& cmd) const
 {
-    if(!(m_packet->header->data_mask & DATA_DEVICE_ID))
+    if(m_cmd_pos < 0 || !data || (quint32)m_cmd_pos >= size)
         return false;
 
-    id = (quint8)m_data->at(m_packet->header->findDataPos(DATA_DEVICE_ID));
+    cmd = quint8(data[m_cmd_pos]) >> m_cmd_shift;
     return true;
 }
 
-bool analyzer_data::getCmd(quint8 &cmd)
+bool packet_layout::lenFromHeader(const char *data, quint32 size, quint32& len) const
 {
-    if(!m_packet->header->hasOpcode())
+    if(m_len_pos < 0 || !data || quint64(m_len_pos) + m_len_bytes > size)
         return false;
 
-    if(m_packet->header->data_mask & DATA_OPCODE)
-    {
-        int pos = m_packet->header->findDataPos(DATA_OPCODE);
-        if(pos < 0 || pos >= m_data->size())
-            return false;
-        cmd = (quint8)m_data->at(pos);
-    }
-    else
-    {
-        int pos = m_packet->header->findDataPos(DATA_AVAKAR);
-        if(pos < 0 || pos >= m_data->size())
-            return false;
-        cmd = quint8(m_data->at(pos)) >> 4;
-    }
+    len = decodeLen(data + m_len_pos) + m_len_offset;
     return true;
 }
 
-bool analyzer_data::getLenFromHeader(quint32& len)
+const packet_field *packet_layout::field(const QString& name) const
+{
+    QHash<QString, int>::const_iterator itr = m_field_idx.find(name);
+    if(itr == m_field_idx.end())
+        return NULL;
+    return &m_fields[*itr];
+}
+
+#ifdef PACKET_USE_SSE2
+static inline int lowestBit(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+const char *packet_layout::findStatic(const char *itr, const char *end) const
 {
-    if(m_packet->header->data_mask & DATA_LEN)
+    const int n = m_static.size();
+    if(n == 0)
+        return itr;
+
+    if(end - itr < n)
+        return NULL;
+
+    const char *pattern = m_static.constData();
+    const char *last = end - n; // last possible start
+
+#ifdef PACKET_USE_SSE2
+    // Compare first and last byte of the pattern on 16 positions at once,
+    // only the candidates are checked with memcmp
+    if(n > 1)
     {
-        try
+        const __m128i first = _mm_set1_epi8(pattern[0]);
+        const __m128i lastb = _mm_set1_epi8(pattern[n-1]);
+        for(; last - itr >= 15; itr += 16)
         {
-            quint32 pos = m_packet->header->findDataPos(DATA_LEN);
-            if(!m_data || pos >= (quint32)m_data->size())
-                return false;
-
-            switch(m_packet->header->len_fmt)
+            const __m128i a = _mm_loadu_si128((const __m128i*)itr);
+            const __m128i b = _mm_loadu_si128((const __m128i*)(itr + n - 1));
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, lastb)));
+            while(mask != 0)
             {
-                case 0: len = getUInt8(pos);  break;
-                case 1: len = getUInt16(pos); break;
-                case 2: len = getUInt32(pos); break;
-                default: return false;
+                const int bit = lowestBit(mask);
+                if(memcmp(itr + bit + 1, pattern + 1, n - 2) == 0)
+                    return itr + bit;
+                mask &= mask - 1;
             }
-            len += m_packet->header->len_offset;
         }
-        catch(const char*)
+    }
+#endif
+
+    while(itr <= last)
+    {
+        itr = (const char*)memchr(itr, pattern[0], last - itr + 1);
+        if(!itr)
+            return NULL;
+        if(memcmp(itr + 1, pattern + 1, n - 1) == 0)
+            return itr;
+        ++itr;
+    }
+    return NULL;
+}
+
+analyzer_data::analyzer_data(analyzer_packet *packet)
+{
+    m_packet = packet;
+    m_storage = NULL;
+    m_data = NULL;
+    m_size = 0;
+    m_time = 0;
+}
+
+analyzer_data::analyzer_data(const packet_view& data, analyzer_packet *packet)
+{
+    m_packet = packet;
+    m_storage = NULL;
+    m_data = data.data;
+    m_size = data.size;
+    m_time = data.time;
+}
+
+void analyzer_data::clear()
+{
+    m_buffer.clear();
+    m_data = m_buffer.constData();
+    m_size = 0;
+    m_time = 0;
+}
+
+void analyzer_data::copy(analyzer_data *other)
+{
+    m_data = other->m_data;
+    m_size = other->m_size;
+    m_time = other->m_time;
+    m_packet = other->m_packet;
+}
+
+void analyzer_data::copyData(analyzer_data *other)
+{
+    // resize() keeps the allocation, so this does not allocate
+    // once the buffer is big enough
+    m_buffer.resize(other->m_size);
+    memcpy(m_buffer.data(), other->m_data, other->m_size);
+
+    m_data = m_buffer.constData();
+    m_size = other->m_size;
+    m_time = other->m_time;
+    m_packet = other->m_packet;
+}
+
+quint32 analyzer_data::addData(const char *d_itr, const char *d_end, quint32 &itr, const packet_layout& layout)
+{
+    if(!m_packet || !layout.isValid())
+        return 0;
+
+    const QByteArray& static_data = layout.staticData();
+    const quint32 staticOffset = layout.staticOffset();
+    const quint32 staticOffsetEnd = staticOffset + static_data.size();
+
+    // Storage may have been cleared since last call
+    if(m_storage && itr != 0)
+    {
+        m_data = m_storage->reserve(itr, itr);
+        if(!m_data)
         {
-            return false;
+            clear();
+            itr = 0;
+            return 0;
         }
     }
-    else if(m_packet->header->data_mask & DATA_AVAKAR)
+
+    const quint32 avail = d_end - d_itr;
+    quint32 len = layout.length(m_data, m_size);
+    quint32 read = 0;
+    bool mismatch = false;
+
+    // Copy whole runs, length can grow once its field is read
+    while(!mismatch && itr < len && read < avail)
     {
-        try
+        quint32 run = (std::min)(len - itr, avail - read);
+
+        if(itr < staticOffsetEnd && itr + run > staticOffset)
         {
-            quint32 pos = m_packet->header->findDataPos(DATA_AVAKAR);
-            if((quint32)m_data->size() <= pos)
-                return false;
-            len = (getUInt8(pos) & 0xF) + m_packet->header->len_offset;
+            const quint32 from = (std::max)(itr, staticOffset);
+            const quint32 to = (std::min)(itr + run, staticOffsetEnd);
+            const char *src = d_itr + read + (from - itr);
+            const char *ref = static_data.constData() + (from - staticOffset);
+            for(quint32 i = 0; i < to - from; ++i)
+            {
+                if(src[i] != ref[i])
+                {
+                    run = from - itr + i;
+                    mismatch = true;
+                    break;
+                }
+            }
         }
-        catch(const char*)
+
+        char *dest;
+        if(m_storage)
         {
-            return false;
+            dest = m_storage->reserve(itr, itr + run);
+            if(!dest)
+            {
+                clear();
+                itr = 0;
+                return 0;
+            }
+        }
+        else
+        {
+            if(itr + run > (quint32)m_buffer.size())
+                m_buffer.resize(itr + run);
+            dest = m_buffer.data();
         }
+        memcpy(dest + itr, d_itr + read, run);
+
+        itr += run;
+        read += run;
+        m_data = dest;
+        m_size = itr;
+
+        len = layout.length(m_data, m_size);
     }
-    else
+    return read;
+}
+
+quint32 analyzer_data::getLenght(bool *readFromHeader)
+{
+    return m_packet->layout.length(m_data, m_size, readFromHeader);
+}
+
+bool analyzer_data::isValid(quint32 itr, const packet_layout& layout) const
+{
+    if(!m_packet || !layout.isValid())
         return false;
 
-    return true;
+    const QByteArray& static_data = layout.staticData();
+    if(m_size == 0 || itr < (quint32)static_data.size())
+        return false;
+
+    if(!static_data.isEmpty())
+    {
+        const quint32 pos = layout.staticOffset();
+        if(quint64(pos) + static_data.size() > m_size ||
+           memcmp(m_data + pos, static_data.constData(), static_data.size()) != 0)
+            return false;
+    }
+
+    return itr == layout.length(m_data, m_size);
+}
+
+bool analyzer_data::getDeviceId(quint8& id)
+{
+    return m_packet->layout.deviceId(m_data, m_size, id);
+}
+
+bool analyzer_data::getCmd(quint8 &cmd)
+{
+    return m_packet->layout.cmd(m_data, m_size, cmd);
+}
+
+bool analyzer_data::getLenFromHeader(quint32& len)
+{
+    return m_packet->layout.lenFromHeader(m_data, m_size, len);
 }
 
 QString analyzer_data::getString(quint32 pos)
 {
     QString str;
-    if(pos >= (quint32)m_data->length())
+    if(pos >= m_size)
         return str;
-    for(; pos < (quint32)m_data->length() && m_data->at(pos) != '\0'; ++pos)
-        str.append(QChar(m_data->at(pos)));
+    for(; pos < m_size && m_data[pos] != '\0'; ++pos)
+        str.append(QChar(m_data[pos]));
     return str;
 }
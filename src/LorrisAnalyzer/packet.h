@@ -10,10 +10,13 @@
 
 #include <QTypeInfo>
 #include <QByteArray>
+#include <QString>
+#include <QHash>
 #include <algorithm>
 #include <vector>
 
 #include "../common.h"
+#include "storagedata.h"
 
 enum DataType
 {
@@ -158,6 +161,78 @@ struct analyzer_header_v1
     quint8 order[4];
 };
 
+// Named value in the packet, declared once in the structure and
+// shared by widgets and scripts. type is one of NumberTypes.
+struct packet_field
+{
+    packet_field() : pos(0), type(0) { }
+    packet_field(const QString& n, quint32 p, quint8 t) : name(n), pos(p), type(t) { }
+
+    QString name;
+    quint32 pos;
+    quint8 type;
+};
+
+struct analyzer_packet;
+
+// Compiled structure of analyzer_packet. Positions of header fields and
+// the length decoding are computed once, so that neither the parser nor
+// the readers walk the header for every packet. Must be recompiled when
+// the structure changes.
+struct packet_layout
+{
+    packet_layout();
+
+    void compile(analyzer_packet *packet);
+    bool isValid() const { return m_valid; }
+
+    // Finds next occurrence of static data in [itr, end), returns NULL
+    // if there is none. Returns itr if the packet has no static data.
+    const char *findStatic(const char *itr, const char *end) const;
+
+    // Length of whole packet. Until the length field is received, only
+    // the header length is known and readFromHeader is set to false.
+    quint32 length(const char *data, quint32 size, bool *readFromHeader = NULL) const;
+
+    // Header fields, false if the packet does not have them or is too short.
+    // Length is the value of the field with len_offset added.
+    bool deviceId(const char *data, quint32 size, quint8& id) const;
+    bool cmd(const char *data, quint32 size, quint8& cmd) const;
+    bool lenFromHeader(const char *data, quint32 size, quint32& len) const;
+
+    const QByteArray& staticData() const { return m_static; }
+    quint32 staticOffset() const { return m_static_offset; }
+
+    const std::vector<packet_field>& fields() const { return m_fields; }
+    // NULL if there is no field of that name
+    const packet_field *field(const QString& name) const;
+
+private:
+    // Length field is read as up to 4 bytes, shifted and masked,
+    // so that all formats are decoded the same way
+    inline quint32 decodeLen(const char *data) const;
+
+    bool m_valid;
+    bool m_big_endian;
+    QByteArray m_static;
+    quint32 m_static_offset;
+
+    int m_dev_pos; // -1 if the packet does not have the field
+    int m_cmd_pos;
+    quint8 m_cmd_shift; // avakar's header has cmd in upper nibble
+
+    quint32 m_base_len; // header length or fixed packet length
+    bool m_has_len;
+    int m_len_pos;
+    quint8 m_len_bytes;
+    quint8 m_len_shift; // applied after swap of big endian value
+    quint32 m_len_mask;
+    qint8 m_len_offset;
+
+    std::vector<packet_field> m_fields;
+    QHash<QString, int> m_field_idx;
+};
+
 struct analyzer_packet
 {
     analyzer_packet()
@@ -181,15 +256,22 @@ struct analyzer_packet
         header = new analyzer_header(p->header);
         big_endian = p->big_endian;
         static_data.assign(p->static_data.begin(), p->static_data.end());
+        fields = p->fields;
+        compile();
     }
 
     void Reset()
     {
         static_data.clear();
+        fields.clear();
         header = NULL;
         big_endian = true;
+        layout = packet_layout();
     }
 
+    // Must be called after the structure is changed
+    void compile() { layout.compile(this); }
+
     QByteArray getStaticData()
     {
         if(header)
@@ -207,29 +289,49 @@ struct analyzer_packet
     analyzer_header *header;
     bool big_endian;
     std::vector<quint8> static_data;
+    std::vector<packet_field> fields;
+    packet_layout layout;
 };
 
 // Real data
 class analyzer_data
 {
 public:
-    analyzer_data(QByteArray *data = NULL, analyzer_packet *packet = NULL);
+    analyzer_data(analyzer_packet *packet = NULL);
+    analyzer_data(const packet_view& data, analyzer_packet *packet = NULL);
     void clear();
     void copy(analyzer_data *other);
+    void copyData(analyzer_data *other);
 
     void setPacket(analyzer_packet *packet) { m_packet = packet; }
     analyzer_packet *getPacket() const { return m_packet; }
 
-    quint32 addData(char *d_itr, char *d_end, quint32& itr);
-    const QByteArray& getData() { return *m_data; }
-    QByteArray *getDataPtr() { return m_data; }
+    // addData() builds the packet directly in storage instead of own buffer
+    void setStorage(StorageData *storage) { m_storage = storage; }
+
+    // Appends bytes to packet being built by parser, stops at the end
+    // of packet or on static data mismatch. Returns number of bytes read.
+    quint32 addData(const char *d_itr, const char *d_end, quint32& itr, const packet_layout& layout);
+
+    const char *data() const { return m_data; }
+    quint32 size() const { return m_size; }
+    packet_view getView() const { return packet_view(m_data, m_size, m_time); }
+    qint64 getTime() const { return m_time; }
+    void setTime(qint64 time) { m_time = time; }
+
+    // Does not copy the bytes, see packet_view
+    QByteArray getData() const { return QByteArray::fromRawData(m_data, m_size); }
+
     bool hasData() const { return m_data != NULL; }
-    void setData(QByteArray *data)
+    void setData(const packet_view& data)
     {
-        m_data = data;
+        m_data = data.data;
+        m_size = data.size;
+        m_time = data.time;
     }
+    void clearData() { setData(packet_view()); }
 
-    bool isValid(quint32 itr);
+    bool isValid(quint32 itr, const packet_layout& layout) const;
 
     bool getDeviceId(quint8& id);
     bool getCmd(quint8& cmd);
@@ -253,17 +355,24 @@ public:
 
 private:
     analyzer_packet *m_packet;
-    QByteArray *m_data;
+    StorageData *m_storage;
+    const char *m_data;
+    quint32 m_size;
+    qint64 m_time;
+
+    // Owned bytes, used when building packet in parser
+    // without storage and by copyData()
+    QByteArray m_buffer;
 };
 
 template <typename T>
 T analyzer_data::read(quint32 pos) const
 {
     T val = 0;
-    if(int(pos + sizeof(T)) > m_data->size())
+    if(quint64(pos) + sizeof(T) > m_size)
         return val;
 
-    val = *((T const*)&m_data->data()[pos]);
+    val = *((T const*)&m_data[pos]);
     if(sizeof(T) > 1 && m_packet->big_endian)
         Utils::swapEndian(val);
     return val;
@@ -5,18 +5,24 @@
 **    See README and COPYING
 ***********************************************/
 
+#include <string.h>
+#include <algorithm>
+
 #include "storage.h"
 #include "packetparser.h"
 #include "packet.h"
 
 PacketParser::PacketParser(Storage *storage, QObject *parent) :
-    QObject(parent), m_curData(&m_curByteArray), m_emitSigData(NULL)
+    QObject(parent)
 {
     m_storage = storage;
     m_paused = false;
     m_packet = NULL;
     m_packetItr = 0;
-    m_staticDataOffset = 0;
+    m_windowLen = 0;
+
+    m_target = NULL;
+    m_curData.setStorage(storage ? storage->getData() : NULL);
 }
 
 PacketParser::~PacketParser()
@@ -24,83 +30,151 @@ PacketParser::~PacketParser()
     m_import.close();
 }
 
-bool PacketParser::newData(QByteArray data, bool emitSig)
+bool PacketParser::newData(const char *data, quint32 len, bool emitSig, qint64 time)
 {
-    if(m_paused || !m_packet)
+    if(m_paused || !m_packet || !m_layout.isValid())
         return false;
 
-    quint32 expLength = m_curData.getLenght();
-    if(!expLength)
+    if(!m_layout.length(NULL, 0))
         return false;
 
-    if(m_packetItr == 0 && (quint32)m_startWindow.size()+(quint32)data.size() < expLength) {
-        m_startWindow.append(data);
-        return false;
-    } else if(m_startWindow.size() != 0) {
-        m_startWindow.append(data);
-        data = QByteArray(m_startWindow);
-        m_startWindow.clear();
-    }
+    const char *d_start = data;
+    const char *d_itr = d_start;
+    const char *d_end = d_start + len;
+    const quint32 staticOffset = m_layout.staticOffset();
 
-    char *d_start = (char*)data.data();
-    char *d_itr = d_start;
-    char *d_end = d_start + data.size();
+    // Header of next packet may be split between previous chunk and this one
+    if(m_packetItr == 0 && m_windowLen != 0)
+    {
+        char seam[2*WINDOW_SIZE];
+        const quint32 head = (std::min)(len, (quint32)WINDOW_SIZE);
+        memcpy(seam, m_window, m_windowLen);
+        memcpy(seam + m_windowLen, data, head);
+
+        const char *seam_end = seam + m_windowLen + head;
+        const char *found = m_layout.findStatic(seam, seam_end);
+        while(found && quint32(found - seam) < staticOffset)
+            found = m_layout.findStatic(found + 1, seam_end);
+
+        // Only the window part is read here, packet continues in data
+        if(found && found - staticOffset < seam + m_windowLen)
+        {
+            m_curData.clear();
+            m_packetItr = 0;
+            m_curData.addData(found - staticOffset, seam + m_windowLen, m_packetItr, m_layout);
+            m_windowLen = 0;
+        }
+    }
 
+    // Window is kept while it directly precedes unread bytes of this chunk
+    const char *windowEnd = d_start;
     quint32 curRead = 1;
 
     while(d_itr != d_end)
     {
         if(m_packetItr == 0 || curRead == 0)
         {
-            int index = data.indexOf(m_packet->getStaticData(), d_itr - d_start);
-            if(index == -1)
-                break;
-            if((quint32)index < m_staticDataOffset)
+            // Occurrences with header before this chunk were handled by the seam search
+            const char *found = m_layout.findStatic(d_itr, d_end);
+            while(found && quint32(found - d_start) < staticOffset)
+                found = m_layout.findStatic(found + 1, d_end);
+
+            if(!found)
+            {
+                keepWindow(windowEnd, d_end);
                 break;
-            d_itr = d_start + index - m_staticDataOffset;
+            }
+            d_itr = found - staticOffset;
             m_curData.clear();
             m_packetItr = 0;
+            m_windowLen = 0;
         }
-        curRead = m_curData.addData(d_itr, d_end, m_packetItr);
+        curRead = m_curData.addData(d_itr, d_end, m_packetItr, m_layout);
         d_itr += curRead;
 
-        if(m_curData.isValid(m_packetItr))
+        if(m_curData.isValid(m_packetItr, m_layout))
         {
-            if(m_storage)
+            // Packet gets time of the chunk which completed it
+            if(m_target)
+                m_emitSigData.setData(m_target->commit(m_curData.size(), time));
+            else if(m_storage)
+                m_emitSigData.setData(m_storage->commitPacket(m_curData.size(), time));
+            else
             {
-                QByteArray *b = m_storage->addData(m_curData.getData());
-                m_emitSigData.setData(b);
+                m_emitSigData.setData(m_curData.getView());
+                m_emitSigData.setTime(time);
             }
-            else
-                m_emitSigData.setData(m_curData.getDataPtr());
 
             if(emitSig)
-                emit packetReceived(&m_emitSigData, m_storage ? m_storage->getSize()-1 : 0);
+            {
+                quint32 idx = 0;
+                if(m_target)       idx = m_target->size()-1;
+                else if(m_storage) idx = m_storage->getSize()-1;
+                emit packetReceived(&m_emitSigData, idx);
+            }
 
             m_curData.clear();
             m_packetItr = 0;
+            windowEnd = d_itr;
+        }
+        else if(curRead == 0 && m_packetItr == 0)
+        {
+            // Nothing could be read from this position, don't find it again
+            ++d_itr;
         }
     }
     return true;
 }
 
+void PacketParser::keepWindow(const char *itr, const char *end)
+{
+    // Last bytes can contain start of the header, up to its static data.
+    // Short reads are added to the current window, header can be split
+    // across any number of them.
+    const quint32 staticLen = m_layout.staticData().size();
+    if(staticLen == 0)
+    {
+        m_windowLen = 0;
+        return;
+    }
+
+    const quint32 keep = (std::min)(m_layout.staticOffset() + staticLen - 1, (quint32)WINDOW_SIZE);
+    const quint32 len = (std::min)(quint32(end - itr), keep);
+    const quint32 old = (std::min)(m_windowLen, keep - len);
+
+    memmove(m_window, m_window + m_windowLen - old, old);
+    memcpy(m_window + old, end - len, len);
+    m_windowLen = old + len;
+}
+
 void PacketParser::setPacket(analyzer_packet *packet)
 {
     m_packet = packet;
     m_curData.setPacket(packet);
     m_emitSigData.setPacket(packet);
     resetCurPacket();
-    if(m_packet) {
-        m_staticDataOffset = m_packet->getStaticDataOffset();
-    }
+}
+
+void PacketParser::setTarget(StorageData *target)
+{
+    m_target = target;
+    if(m_target)
+        m_curData.setStorage(m_target);
+    else
+        m_curData.setStorage(m_storage ? m_storage->getData() : NULL);
+    resetCurPacket();
 }
 
 void PacketParser::resetCurPacket()
 {
+    // Structure may have been changed in place
+    m_layout.compile(m_packet);
+
     if(m_packet)
     {
         m_curData.clear();
         m_packetItr = 0;
+        m_windowLen = 0;
         tryImport();
     }
 }
@@ -120,13 +194,13 @@ void PacketParser::tryImport()
     m_import.seek(0);
 
     bool fromheader = false;
-    int len = m_curData.getLenght(&fromheader);
+    int len = m_layout.length(m_curData.data(), m_curData.size(), &fromheader);
 
     newData(m_import.read(len));
 
     if(m_packet->header->hasLen() && !fromheader && m_import.size() >= len)
     {
-        int total = m_curData.getLenght(&fromheader);
+        int total = m_layout.length(m_curData.data(), m_curData.size(), &fromheader);
         if(fromheader)
             newData(m_import.read(total - len));
     }
@@ -33,23 +33,41 @@ public:
 
     void setPacket(analyzer_packet *packet);
     void setImport(const QString& filename);
+
+    // Packets are built in target instead of storage. Indexes in
+    // packetReceived are then relative to target.
+    void setTarget(StorageData *target);
+
+    // Reads directly from data, packets are built in storage
+    bool newData(const char *data, quint32 len, bool emitSig = true, qint64 time = 0);
     
 public slots:
-    bool newData(QByteArray data, bool emitSig = true);
+    bool newData(const QByteArray& data, bool emitSig = true, qint64 time = 0)
+    {
+        return newData(data.constData(), data.size(), emitSig, time);
+    }
     void resetCurPacket();
     void tryImport();
 
 private:
+    // Enough for static data and header fields before it
+    enum { WINDOW_SIZE = 512 };
+
+    // Adds tail of [itr, end) to the window, whose bytes must directly
+    // precede itr in the stream (window is emptied when a packet starts)
+    void keepWindow(const char *itr, const char *end);
+
     bool m_paused;
     analyzer_data m_curData;
     analyzer_data m_emitSigData;
-    QByteArray m_curByteArray;
     analyzer_packet *m_packet;
     Storage *m_storage;
+    StorageData *m_target;
     QFile m_import;
     quint32 m_packetItr;
-    quint32 m_staticDataOffset;
-    QByteArray m_startWindow;
+    packet_layout m_layout;
+    char m_window[WINDOW_SIZE];
+    quint32 m_windowLen;
 };
 
 #endif // PACKETPARSER_H
@@ -0,0 +1,115 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <QThread>
+
+#include "parseworker.h"
+
+ParseWorker::ParseWorker(QThread *thread) :
+    QObject(), m_parser(NULL)
+{
+    // Children are moved to the thread together with this
+    m_input.setParent(this);
+    m_parser.setParent(this);
+    m_publishTimer.setParent(this);
+
+    m_parser.setTarget(&m_packets);
+
+    m_publishTimer.setSingleShot(true);
+    m_lastPublish.start();
+
+    connect(&m_input,        SIGNAL(dataReceived()), SLOT(processInput()));
+    connect(&m_publishTimer, SIGNAL(timeout()),      SLOT(publish()));
+
+    moveToThread(thread);
+}
+
+ParseWorker::~ParseWorker()
+{
+    std::vector<StorageData*> batches;
+    takeBatches(batches);
+    for(size_t i = 0; i < batches.size(); ++i)
+        delete batches[i];
+}
+
+void ParseWorker::addData(const QByteArray &data, qint64 time)
+{
+    chunk c;
+    c.data = data;
+    c.time = time;
+    m_input.send(c);
+}
+
+void ParseWorker::setPacket(analyzer_packet *packet)
+{
+    QMutexLocker l(&m_mutex);
+    m_parser.setPacket(packet);
+
+    // Packets of old structure are useless. Batches are sent only with
+    // m_mutex held, so everything published after this has the new one.
+    m_packets.clear();
+
+    std::vector<StorageData*> batches;
+    m_output.receive(batches);
+    for(size_t i = 0; i < batches.size(); ++i)
+        delete batches[i];
+}
+
+void ParseWorker::setPaused(bool pause)
+{
+    QMutexLocker l(&m_mutex);
+    m_parser.setPaused(pause);
+}
+
+void ParseWorker::dropInput()
+{
+    std::vector<chunk> chunks;
+    m_input.receive(chunks);
+}
+
+void ParseWorker::takeBatches(std::vector<StorageData*>& batches)
+{
+    m_output.receive(batches);
+}
+
+void ParseWorker::processInput()
+{
+    std::vector<chunk> chunks;
+    m_input.receive(chunks);
+
+    QMutexLocker l(&m_mutex);
+    for(size_t i = 0; i < chunks.size(); ++i)
+        m_parser.newData(chunks[i].data.constData(), chunks[i].data.size(), false, chunks[i].time);
+
+    if(m_packets.empty())
+        return;
+
+    const qint64 elapsed = m_lastPublish.elapsed();
+    if(elapsed >= PUBLISH_INTERVAL)
+        publish_locked();
+    else if(!m_publishTimer.isActive())
+        m_publishTimer.start(PUBLISH_INTERVAL - elapsed);
+}
+
+void ParseWorker::publish()
+{
+    QMutexLocker l(&m_mutex);
+    publish_locked();
+}
+
+void ParseWorker::publish_locked()
+{
+    m_publishTimer.stop();
+    m_lastPublish.restart();
+
+    if(m_packets.empty())
+        return;
+
+    StorageData *batch = new StorageData();
+    batch->takePackets(m_packets);
+    m_output.send(batch);
+}
@@ -0,0 +1,73 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef PARSEWORKER_H
+#define PARSEWORKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <vector>
+
+#include "packetparser.h"
+#include "storagedata.h"
+#include "../misc/threadchannel.h"
+
+// Frames received data in its own thread, so that slow widgets and
+// scripts in GUI thread do not hold up parsing. Packets are built in
+// worker's own StorageData and passed to GUI thread in batches, at most
+// once per PUBLISH_INTERVAL ms. Batch slabs are moved to Storage
+// without copying the packets, see StorageData::append().
+class ParseWorker : public QObject
+{
+    Q_OBJECT
+public:
+    enum { PUBLISH_INTERVAL = 20 };
+
+    // Created in GUI thread, moves itself to thread
+    explicit ParseWorker(QThread *thread);
+    ~ParseWorker();
+
+    // These can be called from GUI thread
+    void addData(const QByteArray& data, qint64 time);
+    // Also deletes batches which were not taken yet
+    void setPacket(analyzer_packet *packet);
+    void setPaused(bool pause);
+    // Discards received bytes which were not parsed yet
+    void dropInput();
+
+    // Batches are owned by the caller. Channel's dataReceived()
+    // is emitted in GUI thread when there are new ones.
+    void takeBatches(std::vector<StorageData*>& batches);
+    ThreadChannelBase *batchChannel() { return &m_output; }
+
+private slots:
+    void processInput();
+    void publish();
+
+private:
+    struct chunk
+    {
+        QByteArray data;
+        qint64 time;
+    };
+
+    void publish_locked();
+
+    ThreadChannel<chunk> m_input;
+    ThreadChannel<StorageData*> m_output;
+
+    QMutex m_mutex; // guards parser and m_packets
+    PacketParser m_parser;
+    StorageData m_packets;
+
+    QTimer m_publishTimer;
+    QElapsedTimer m_lastPublish;
+};
+
+#endif // PARSEWORKER_H
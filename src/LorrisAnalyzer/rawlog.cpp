@@ -0,0 +1,61 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <algorithm>
+
+#include "rawlog.h"
+
+RawLog::RawLog()
+{
+    m_first_seq = 0;
+    m_size = 0;
+    m_limit = 64*1024*1024;
+    m_complete = true;
+}
+
+void RawLog::append(const QByteArray &data, qint64 time)
+{
+    if(data.isEmpty())
+        return;
+
+    raw_chunk c;
+    c.data = data;
+    c.time = time;
+    m_chunks.push_back(c);
+    m_size += data.size();
+
+    setLimit(m_limit);
+}
+
+void RawLog::clear()
+{
+    m_first_seq += m_chunks.size();
+    m_chunks.clear();
+    m_size = 0;
+    m_complete = true;
+}
+
+void RawLog::setLimit(quint64 bytes)
+{
+    m_limit = bytes;
+
+    // Keep at least the last chunk
+    while(m_size > m_limit && m_chunks.size() > 1)
+    {
+        m_size -= m_chunks.front().data.size();
+        m_chunks.pop_front();
+        ++m_first_seq;
+        m_complete = false;
+    }
+}
+
+void RawLog::getChunks(quint64 seq, std::vector<raw_chunk> &out) const
+{
+    seq = (std::max)(seq, m_first_seq);
+    for(quint64 i = seq - m_first_seq; i < m_chunks.size(); ++i)
+        out.push_back(m_chunks[i]);
+}
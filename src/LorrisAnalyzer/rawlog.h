@@ -0,0 +1,59 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef RAWLOG_H
+#define RAWLOG_H
+
+#include <deque>
+#include <vector>
+#include <QByteArray>
+
+struct raw_chunk
+{
+    QByteArray data;
+    qint64 time; // see Utils::monotonicTimestamp()
+};
+
+// Append-only log of bytes as they were received, kept next to the
+// parsed packets so that they can be framed again when packet structure
+// changes. Chunks are numbered, the number of a chunk never changes.
+//
+// Log is incomplete when storage can hold packets whose bytes are not
+// in it - they were loaded from a data file or oldest chunks were dropped
+// because the log was over its size limit. Re-framing would lose them.
+class RawLog
+{
+public:
+    RawLog();
+
+    void append(const QByteArray& data, qint64 time);
+    void clear();
+
+    bool empty() const { return m_chunks.empty(); }
+    bool isComplete() const { return m_complete; }
+    void setIncomplete() { m_complete = false; }
+    quint64 byteSize() const { return m_size; }
+
+    quint64 getLimit() const { return m_limit; }
+    void setLimit(quint64 bytes);
+
+    // Number of the chunk which will be appended next
+    quint64 endSeq() const { return m_first_seq + m_chunks.size(); }
+
+    // Copies chunks from seq to the end. The bytes are shared, not copied,
+    // so the result can be passed to another thread.
+    void getChunks(quint64 seq, std::vector<raw_chunk>& out) const;
+
+private:
+    std::deque<raw_chunk> m_chunks;
+    quint64 m_first_seq;
+    quint64 m_size;
+    quint64 m_limit;
+    bool m_complete;
+};
+
+#endif // RAWLOG_H
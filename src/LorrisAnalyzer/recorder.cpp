@@ -0,0 +1,319 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <QDir>
+#include <QDateTime>
+#include <QBuffer>
+#include <QScopedPointer>
+#include <string.h>
+
+#include "recorder.h"
+#include "packet.h"
+#include "storagedata.h"
+#include "DataWidgets/datawidget.h"
+
+static const char RECORDER_MAGIC[] = { 'L', 'R', 'E', 'C' };
+static const quint32 RECORDER_VERSION = 2; // 2 added named fields
+
+Recorder::Recorder(QObject *parent) :
+    QThread(parent)
+{
+    m_stop = false;
+    m_max_size = 0;
+    m_max_age = 0;
+    m_seg_idx = 0;
+}
+
+Recorder::~Recorder()
+{
+    stopRecording();
+}
+
+void Recorder::startRecording(const QString &folder, analyzer_packet *packet, quint64 maxSize, quint32 maxAge)
+{
+    stopRecording();
+
+    if(!QDir().mkpath(folder))
+        throw tr("Cannot create folder \"%1\"!").arg(folder);
+
+    m_folder = folder;
+    m_max_size = maxSize;
+    m_max_age = qint64(maxAge)*1000;
+    m_seg_idx = 0;
+    m_stop = false;
+
+    // Structure is written at the start of every segment,
+    // so that each of them can be read alone
+    m_seg_header = segmentHeader(packet);
+
+    if(!openSegment())
+        throw tr("Cannot open file \"%1\"!").arg(m_file.fileName());
+
+    start(QThread::LowPriority);
+}
+
+void Recorder::stopRecording()
+{
+    if(!isRunning())
+        return;
+
+    m_mutex.lock();
+    m_stop = true;
+    m_cond.wakeOne();
+    m_mutex.unlock();
+
+    wait();
+}
+
+void Recorder::addPacket(const char *data, quint32 len, qint64 time)
+{
+    if(!isRunning())
+        return;
+
+    QMutexLocker l(&m_mutex);
+    m_queue.append((char*)&len, sizeof(len));
+    m_queue.append((char*)&time, sizeof(time));
+    m_queue.append(data, len);
+    m_cond.wakeOne();
+}
+
+QByteArray Recorder::segmentHeader(analyzer_packet *packet)
+{
+    QByteArray res;
+    QBuffer buff(&res);
+    buff.open(QIODevice::WriteOnly);
+
+    quint32 static_len = packet->header->static_len;
+    buff.write(RECORDER_MAGIC, sizeof(RECORDER_MAGIC));
+    buff.write((char*)&RECORDER_VERSION, sizeof(RECORDER_VERSION));
+    buff.write((char*)&packet->header->length, sizeof(analyzer_header));
+    buff.write((char*)&packet->big_endian, sizeof(bool));
+    buff.write((char*)&static_len, sizeof(static_len));
+    buff.write((char*)packet->static_data.data(), static_len);
+
+    // Named fields, the same as in BLOCK_PACKET_FIELDS of data file
+    QByteArray fields;
+    QBuffer fieldBuff(&fields);
+    fieldBuff.open(QIODevice::WriteOnly);
+
+    const quint32 count = packet->fields.size();
+    fieldBuff.write((char*)&count, sizeof(count));
+    for(quint32 i = 0; i < count; ++i)
+    {
+        const packet_field& f = packet->fields[i];
+        const QByteArray name = f.name.toUtf8();
+        const quint32 name_len = name.size();
+        fieldBuff.write((char*)&name_len, sizeof(name_len));
+        fieldBuff.write(name);
+        fieldBuff.write((char*)&f.pos, sizeof(f.pos));
+        fieldBuff.write((char*)&f.type, sizeof(f.type));
+    }
+
+    const quint32 fields_len = fields.size();
+    buff.write((char*)&fields_len, sizeof(fields_len));
+    buff.write(fields);
+    return res;
+}
+
+// Fields are read only while there is enough data for them
+static void readFields(const char *itr, const char *end, std::vector<packet_field>& fields)
+{
+    static const int val_len = sizeof(quint32) + sizeof(quint8);
+
+    quint32 count = 0;
+    if(end - itr < int(sizeof(count)))
+        return;
+    memcpy(&count, itr, sizeof(count));
+    itr += sizeof(count);
+
+    for(quint32 i = 0; i < count; ++i)
+    {
+        quint32 name_len = 0;
+        if(end - itr < int(sizeof(name_len)))
+            return;
+        memcpy(&name_len, itr, sizeof(name_len));
+        itr += sizeof(name_len);
+
+        if(quint64(end - itr) < quint64(name_len) + val_len)
+            return;
+
+        packet_field f;
+        f.name = QString::fromUtf8(itr, name_len);
+        itr += name_len;
+        memcpy(&f.pos, itr, sizeof(f.pos));
+        itr += sizeof(f.pos);
+        memcpy(&f.type, itr, sizeof(f.type));
+        itr += sizeof(f.type);
+
+        if(f.type >= NUM_COUNT)
+            return;
+        fields.push_back(f);
+    }
+}
+
+bool Recorder::sameStructure(analyzer_packet *a, analyzer_packet *b)
+{
+    return segmentHeader(a) == segmentHeader(b);
+}
+
+analyzer_packet *Recorder::readSegments(const QStringList& files, StorageData& data, int& skipped)
+{
+    static const int fixed_len = sizeof(RECORDER_MAGIC) + sizeof(quint32) + sizeof(analyzer_header) +
+                                 sizeof(bool) + sizeof(quint32);
+
+    QScopedPointer<analyzer_header> header;
+    QScopedPointer<analyzer_packet> packet;
+    QByteArray first;
+
+    skipped = 0;
+    for(int i = 0; i < files.size(); ++i)
+    {
+        QFile file(files[i]);
+        if(!file.open(QIODevice::ReadOnly))
+            throw tr("Cannot open file \"%1\"!").arg(files[i]);
+
+        const QByteArray seg = file.readAll();
+        const char *itr = seg.constData();
+        const char *end = itr + seg.size();
+
+        quint32 version = 0, static_len = 0;
+        if(seg.size() >= fixed_len)
+        {
+            memcpy(&version, itr + sizeof(RECORDER_MAGIC), sizeof(version));
+            memcpy(&static_len, itr + fixed_len - sizeof(quint32), sizeof(static_len));
+        }
+
+        if(seg.size() < fixed_len || memcmp(itr, RECORDER_MAGIC, sizeof(RECORDER_MAGIC)) != 0 ||
+           version == 0 || version > RECORDER_VERSION || static_len > quint32(seg.size() - fixed_len))
+            throw tr("File \"%1\" is not a valid recording!").arg(files[i]);
+
+        // Version 1 has no named fields
+        quint32 header_len = fixed_len + static_len;
+        quint32 fields_len = 0;
+        if(version >= 2)
+        {
+            if(quint32(seg.size()) - header_len < sizeof(fields_len))
+                throw tr("File \"%1\" is not a valid recording!").arg(files[i]);
+
+            memcpy(&fields_len, itr + header_len, sizeof(fields_len));
+            header_len += sizeof(fields_len);
+
+            if(fields_len > quint32(seg.size()) - header_len)
+                throw tr("File \"%1\" is not a valid recording!").arg(files[i]);
+            header_len += fields_len;
+        }
+
+        const QByteArray seg_header = seg.left(header_len);
+        itr += seg_header.size();
+
+        if(!packet)
+        {
+            first = seg_header;
+
+            const char *h = seg_header.constData() + sizeof(RECORDER_MAGIC) + sizeof(quint32);
+            header.reset(new analyzer_header());
+            memcpy(&header->length, h, sizeof(analyzer_header));
+            h += sizeof(analyzer_header);
+
+            const quint8 *st = (const quint8*)seg_header.constData() + fixed_len;
+            packet.reset(new analyzer_packet(header.data(), *h != 0));
+            packet->static_data.assign(st, st + static_len);
+
+            const char *fields = seg_header.constData() + header_len - fields_len;
+            readFields(fields, fields + fields_len, packet->fields);
+            packet->compile();
+        }
+        else if(seg_header != first)
+        {
+            ++skipped;
+            continue;
+        }
+
+        // Segment of crashed recording can end with incomplete record
+        static const int rec_header = sizeof(quint32) + sizeof(qint64);
+        while(end - itr >= rec_header)
+        {
+            quint32 len;
+            qint64 time;
+            memcpy(&len, itr, sizeof(len));
+            memcpy(&time, itr + sizeof(len), sizeof(time));
+            if(quint64(end - itr - rec_header) < len)
+                break;
+
+            data.push_back(itr + rec_header, len, time);
+            itr += rec_header + len;
+        }
+    }
+
+    if(!packet)
+        throw tr("No recording was selected!");
+
+    header.take();
+    return packet.take();
+}
+
+bool Recorder::openSegment()
+{
+    m_file.close();
+
+    // Never overwrite segment of previous recording started in the same second
+    const QDir dir(m_folder);
+    const QString time = QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss");
+    QString path;
+    do
+    {
+        path = dir.filePath(QString("rec_%1_%2.lrec").arg(time).arg(m_seg_idx++, 3, 10, QChar('0')));
+    } while(QFile::exists(path));
+
+    m_file.setFileName(path);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    m_age.start();
+    return m_file.write(m_seg_header) == m_seg_header.size();
+}
+
+void Recorder::run()
+{
+    QByteArray data;
+    bool stop = false;
+    while(!stop)
+    {
+        m_mutex.lock();
+        if(m_queue.isEmpty() && !m_stop)
+            m_cond.wait(&m_mutex, 1000);
+        data.swap(m_queue);
+        stop = m_stop;
+        m_mutex.unlock();
+
+        if(!data.isEmpty())
+        {
+            if(m_file.write(data) != data.size() || !m_file.flush())
+            {
+                emit recordingError(tr("Error while writing file \"%1\"!").arg(m_file.fileName()));
+                break;
+            }
+            data.clear();
+        }
+
+        // Rotate only between records, the queue always contains whole ones
+        if((m_max_size != 0 && (quint64)m_file.size() >= m_max_size) ||
+           (m_max_age != 0 && m_age.elapsed() >= m_max_age))
+        {
+            if(!stop && !openSegment())
+            {
+                emit recordingError(tr("Cannot open file \"%1\"!").arg(m_file.fileName()));
+                break;
+            }
+        }
+    }
+
+    m_file.close();
+
+    QMutexLocker l(&m_mutex);
+    m_queue.clear();
+}
@@ -0,0 +1,82 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QStringList>
+
+struct analyzer_packet;
+class StorageData;
+
+// Appends every packet to segment files on disk in background thread.
+// Segment is rotated when it reaches maximal size or age, so the files
+// stay reasonably sized during long recordings. Data are flushed after
+// every write, segment is readable even if Lorris crashes.
+//
+// Segment file format (little endian):
+//   "LREC", quint32 version,
+//   analyzer_header, bool big_endian, quint32 static_len, static data,
+//   quint32 length of field table, quint32 field count, fields:
+//   quint32 name length, UTF-8 name, quint32 pos, quint8 type (since version 2)
+//   records: quint32 len, qint64 time (see Utils::monotonicTimestamp()), data
+class Recorder : public QThread
+{
+    Q_OBJECT
+
+Q_SIGNALS:
+    void recordingError(const QString& error);
+
+public:
+    explicit Recorder(QObject *parent = 0);
+    ~Recorder();
+
+    // Throws QString on error. maxSize is in bytes, maxAge in seconds,
+    // 0 means no limit.
+    void startRecording(const QString& folder, analyzer_packet *packet,
+                        quint64 maxSize, quint32 maxAge);
+    void stopRecording();
+    bool isRecording() const { return isRunning(); }
+
+    void addPacket(const char *data, quint32 len, qint64 time);
+
+    // Reads packets of segment files, in the given order, to data and
+    // returns structure of the first one. Segments with different structure
+    // are skipped and counted in skipped. Throws QString on error.
+    static analyzer_packet *readSegments(const QStringList& files, StorageData& data, int& skipped);
+    // True if segments of both structures have the same header,
+    // named fields included
+    static bool sameStructure(analyzer_packet *a, analyzer_packet *b);
+
+protected:
+    void run();
+
+private:
+    static QByteArray segmentHeader(analyzer_packet *packet);
+    bool openSegment();
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QByteArray m_queue;
+    bool m_stop;
+
+    // used only by the writing thread after start
+    QFile m_file;
+    QElapsedTimer m_age;
+    QString m_folder;
+    QByteArray m_seg_header;
+    quint64 m_max_size;
+    qint64 m_max_age;
+    quint32 m_seg_idx;
+};
+
+#endif // RECORDER_H
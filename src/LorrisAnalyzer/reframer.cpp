@@ -0,0 +1,189 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <QFile>
+#include <algorithm>
+
+#include "reframer.h"
+#include "packetparser.h"
+#include "storagedata.h"
+
+Reframer::Reframer(QObject *parent) :
+    QThread(parent)
+{
+    m_packet = NULL;
+    m_result = NULL;
+    m_keepChunks = false;
+    m_lastPct = -1;
+}
+
+Reframer::~Reframer()
+{
+    cancel();
+    wait();
+    delete m_result;
+}
+
+void Reframer::reset()
+{
+    cancel();
+    wait();
+
+    delete m_result;
+    m_result = NULL;
+
+    m_chunks.clear();
+    m_filename.clear();
+    m_keepChunks = false;
+    m_error.clear();
+    m_lastPct = -1;
+    m_cancel.fetchAndStoreOrdered(0);
+}
+
+void Reframer::start(const std::vector<raw_chunk> &chunks, analyzer_packet *packet)
+{
+    reset();
+
+    m_chunks = chunks;
+    m_packet = packet;
+
+    QThread::start(QThread::LowPriority);
+}
+
+void Reframer::start(const QString &filename, analyzer_packet *packet, bool keepChunks)
+{
+    reset();
+
+    m_filename = filename;
+    m_keepChunks = keepChunks;
+    m_packet = packet;
+
+    QThread::start(QThread::LowPriority);
+}
+
+void Reframer::cancel()
+{
+    m_cancel.fetchAndStoreOrdered(1);
+}
+
+bool Reframer::isCancelled()
+{
+    return m_cancel.fetchAndAddOrdered(0) != 0;
+}
+
+StorageData *Reframer::takeResult()
+{
+    wait();
+
+    StorageData *res = m_result;
+    m_result = NULL;
+    return res;
+}
+
+void Reframer::takeChunks(std::vector<raw_chunk> &chunks)
+{
+    wait();
+
+    chunks.swap(m_chunks);
+    m_chunks.clear();
+}
+
+void Reframer::run()
+{
+    StorageData *res = new StorageData();
+
+    // Parser is used only by this thread
+    PacketParser parser(NULL);
+    parser.setTarget(res);
+    parser.setPacket(m_packet);
+
+    if(m_filename.isEmpty())
+        frameChunks(parser);
+    else
+        frameFile(parser, res);
+
+    if(isCancelled() || !m_error.isEmpty())
+    {
+        delete res;
+        m_chunks.clear();
+    }
+    else
+        m_result = res;
+}
+
+void Reframer::frameChunks(PacketParser &parser)
+{
+    quint64 total = 0;
+    for(size_t i = 0; i < m_chunks.size(); ++i)
+        total += m_chunks[i].data.size();
+
+    quint64 done = 0;
+    for(size_t i = 0; i < m_chunks.size() && !isCancelled(); ++i)
+    {
+        const raw_chunk& c = m_chunks[i];
+        parser.newData(c.data.constData(), c.data.size(), false, c.time);
+
+        done += c.data.size();
+        reportProgress(done, total);
+    }
+
+    m_chunks.clear();
+}
+
+void Reframer::frameFile(PacketParser &parser, StorageData *res)
+{
+    QFile file(m_filename);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        m_error = tr("Could not open file %1 for reading!").arg(m_filename);
+        return;
+    }
+
+    const quint64 total = file.size();
+    quint64 done = 0;
+    while(done < total && !isCancelled())
+    {
+        raw_chunk c;
+        c.data = file.read(FILE_CHUNK);
+        c.time = 0;
+        if(c.data.isEmpty())
+        {
+            m_error = tr("Error while reading file %1!").arg(m_filename);
+            return;
+        }
+
+        parser.newData(c.data.constData(), c.data.size(), false, 0);
+
+        // Packet count of the whole file is estimated from the first
+        // chunk, slabs are then allocated in larger blocks
+        if(done == 0 && !res->empty())
+        {
+            quint64 bytes = 0;
+            for(quint32 i = 0; i < res->size(); ++i)
+                bytes += (*res)[i].size;
+
+            const quint64 estimate = bytes * total / c.data.size();
+            res->setSlabSize((quint32)(std::min)(estimate/32, quint64(32*1024*1024)));
+        }
+
+        done += c.data.size();
+        if(m_keepChunks)
+            m_chunks.push_back(c);
+
+        reportProgress(done, total);
+    }
+}
+
+void Reframer::reportProgress(quint64 done, quint64 total)
+{
+    const int pct = total ? int(done*100/total) : 100;
+    if(pct == m_lastPct)
+        return;
+
+    m_lastPct = pct;
+    emit progress(pct);
+}
@@ -0,0 +1,75 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef REFRAMER_H
+#define REFRAMER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QString>
+#include <vector>
+
+#include "rawlog.h"
+
+struct analyzer_packet;
+class StorageData;
+class PacketParser;
+
+// Frames chunks from RawLog or a binary file with given packet structure
+// in background thread. Packets are built in own StorageData, which is
+// taken by GUI thread after finished() and moved into Storage, so the
+// packets are added or replaced at once.
+class Reframer : public QThread
+{
+    Q_OBJECT
+
+Q_SIGNALS:
+    void progress(int percent);
+
+public:
+    enum { FILE_CHUNK = 1024*1024 };
+
+    explicit Reframer(QObject *parent = 0);
+    ~Reframer();
+
+    // packet must not be deleted until the thread finishes
+    void start(const std::vector<raw_chunk>& chunks, analyzer_packet *packet);
+
+    // File is read in FILE_CHUNK blocks. If keepChunks is true, they
+    // are kept for RawLog, see takeChunks().
+    void start(const QString& filename, analyzer_packet *packet, bool keepChunks);
+
+    bool isCancelled();
+
+    // Result is owned by the caller, NULL if cancelled or on error
+    StorageData *takeResult();
+    void takeChunks(std::vector<raw_chunk>& chunks);
+    const QString& getError() const { return m_error; }
+
+public slots:
+    void cancel();
+
+protected:
+    void run();
+
+private:
+    void reset();
+    void frameChunks(PacketParser& parser);
+    void frameFile(PacketParser& parser, StorageData *res);
+    void reportProgress(quint64 done, quint64 total);
+
+    std::vector<raw_chunk> m_chunks;
+    QString m_filename;
+    bool m_keepChunks;
+    analyzer_packet *m_packet;
+    StorageData *m_result;
+    QString m_error;
+    int m_lastPct;
+    QAtomicInt m_cancel;
+};
+
+#endif // REFRAMER_H
@@ -12,6 +12,13 @@
 #include <QSpacerItem>
 #include <QDialogButtonBox>
 #include <QListWidget>
+#include <QGroupBox>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QSpinBox>
+#include <QComboBox>
+#include <QSet>
+#include <climits>
 
 #include "../common.h"
 #include "sourcedialog.h"
@@ -20,6 +27,7 @@
 #include "labellayout.h"
 #include "packet.h"
 #include "packetparser.h"
+#include "DataWidgets/datawidget.h"
 
 SourceDialog::SourceDialog(analyzer_packet *pkt, PortConnection *con, const QString &importFile) :
     QDialog(),ui(new Ui::SourceDialog)
@@ -30,7 +38,10 @@ SourceDialog::SourceDialog(analyzer_packet *pkt, PortConnection *con, const QStr
     if(pkt)
         m_packet.copy(pkt);
     else
+    {
         m_packet.header = new analyzer_header();
+        m_packet.compile();
+    }
 
     m_parser = new PacketParser(NULL, this);
     m_parser->setPacket(&m_packet);
@@ -48,7 +59,7 @@ SourceDialog::SourceDialog(analyzer_packet *pkt, PortConnection *con, const QStr
     w = new QWidget(this);
     scroll_header = new LabelLayout(m_packet.header, true, true, NULL, w);
     connect(scroll_header, SIGNAL(orderChanged()), scroll_layout, SLOT(UpdateTypes()));
-    connect(scroll_header, SIGNAL(orderChanged()), m_parser,      SLOT(resetCurPacket()));
+    connect(scroll_header, SIGNAL(orderChanged()),                SLOT(structureChanged()));
 
     ui->header_scroll->setWidget(w);
 
@@ -70,6 +81,8 @@ SourceDialog::SourceDialog(analyzer_packet *pkt, PortConnection *con, const QStr
     connect(ui->len_static,     SIGNAL(toggled(bool)),                           SLOT(packetLenSetStatic(bool)));
     connect(m_parser,           SIGNAL(packetReceived(analyzer_data*,quint32)),  SLOT(packetReceived(analyzer_data*,quint32)));
 
+    createFieldsBox();
+
     setted = false;
 
     if(!pkt)
@@ -107,6 +120,10 @@ SourceDialog::SourceDialog(analyzer_packet *pkt, PortConnection *con, const QStr
             m_packet.static_data[i] = pkt->static_data[i];
         }
     }
+
+    for(size_t i = 0; i < pkt->fields.size(); ++i)
+        addFieldRow(pkt->fields[i]);
+    structureChanged();
 }
 
 SourceDialog::~SourceDialog()
@@ -121,8 +138,17 @@ void SourceDialog::butonnBoxClicked(QAbstractButton *b)
     {
         if(m_packet.header->length + ui->len_box->value() == 0)
             return Utils::showErrorBox(tr("You have to set something!"), this);
-        else
-            setted = true;
+
+        QSet<QString> names;
+        for(size_t i = 0; i < m_packet.fields.size(); ++i)
+        {
+            const QString& name = m_packet.fields[i].name;
+            if(name.isEmpty() || names.contains(name))
+                return Utils::showErrorBox(tr("Field names must be unique and not empty!"), this);
+            names.insert(name);
+        }
+
+        setted = true;
     }
     close();
 }
@@ -147,7 +173,7 @@ void SourceDialog::AddOrRmHeaderType(bool add, quint8 type)
     }
 
     updateHeaderLabels();
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::updateHeaderLabels()
@@ -194,7 +220,7 @@ void SourceDialog::headerLenChanged(int value)
     scroll_header->UpdateTypes();
     scroll_layout->UpdateTypes();
 
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::staticCheckToggled(bool checked)
@@ -243,32 +269,32 @@ void SourceDialog::staticLenChanged(int value)
         else
             ui->staticList->takeItem(ui->staticList->count() - 1);
     }
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::lenFmtChanged(int index)
 {
     m_packet.header->len_fmt = index;
     scroll_layout->UpdateTypes();
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::offsetChanged(int val)
 {
     m_packet.header->len_offset = val;
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::endianChanged(int idx)
 {
     m_packet.big_endian = (idx == 0);
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::packetLenChanged(int val)
 {
     m_packet.header->packet_length = val;
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::staticDataChanged(QListWidgetItem *)
@@ -284,7 +310,7 @@ void SourceDialog::staticDataChanged(QListWidgetItem *)
         else
             m_packet.static_data[i] = text.toInt();
     }
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::switchStackPage(bool avakar)
@@ -320,7 +346,7 @@ void SourceDialog::switchStackPage(bool avakar)
     ui->len_static->setEnabled(!avakar);
 
     scroll_layout->UpdateTypes();
-    m_parser->resetCurPacket();
+    structureChanged();
 }
 
 void SourceDialog::packetLenSetStatic(bool setStatic)
@@ -329,6 +355,115 @@ void SourceDialog::packetLenSetStatic(bool setStatic)
         ui->len_check->setChecked(!setStatic);
 }
 
+void SourceDialog::structureChanged()
+{
+    m_packet.compile();
+    m_parser->resetCurPacket();
+}
+
+void SourceDialog::createFieldsBox()
+{
+    QGroupBox *box = new QGroupBox(tr("Fields"), this);
+    QVBoxLayout *l = new QVBoxLayout(box);
+
+    m_fieldsTable = new QTableWidget(0, 3, box);
+    m_fieldsTable->setHorizontalHeaderLabels(QStringList() << tr("Name") << tr("Position") << tr("Type"));
+    m_fieldsTable->horizontalHeader()->setStretchLastSection(true);
+    m_fieldsTable->verticalHeader()->hide();
+    m_fieldsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    l->addWidget(m_fieldsTable);
+
+    QHBoxLayout *btnLayout = new QHBoxLayout();
+    QPushButton *addBtn = new QPushButton(tr("Add"), box);
+    QPushButton *rmBtn = new QPushButton(tr("Remove"), box);
+    btnLayout->addWidget(addBtn);
+    btnLayout->addWidget(rmBtn);
+    btnLayout->addStretch(1);
+    l->addLayout(btnLayout);
+
+    // above the button box
+    ui->verticalLayout_4->insertWidget(ui->verticalLayout_4->count()-1, box);
+
+    connect(addBtn,        SIGNAL(clicked()),                      SLOT(addField()));
+    connect(rmBtn,         SIGNAL(clicked()),                      SLOT(removeField()));
+    connect(m_fieldsTable, SIGNAL(itemChanged(QTableWidgetItem*)), SLOT(fieldsChanged()));
+}
+
+void SourceDialog::addFieldRow(const packet_field &field)
+{
+    static const QString dataTypes[NUM_COUNT] =
+    {
+        tr("unsigned 8bit"),
+        tr("unsigned 16bit"),
+        tr("unsigned 32bit"),
+        tr("unsigned 64bit"),
+
+        tr("signed 8bit"),
+        tr("signed 16bit"),
+        tr("signed 32bit"),
+        tr("signed 64bit"),
+
+        tr("float (4 bytes)"),
+        tr("double (8 bytes)"),
+    };
+
+    const int row = m_fieldsTable->rowCount();
+
+    m_fieldsTable->blockSignals(true);
+    m_fieldsTable->insertRow(row);
+    m_fieldsTable->setItem(row, 0, new QTableWidgetItem(field.name));
+    m_fieldsTable->blockSignals(false);
+
+    QSpinBox *pos = new QSpinBox(m_fieldsTable);
+    pos->setMaximum(INT_MAX);
+    pos->setValue(field.pos);
+    m_fieldsTable->setCellWidget(row, 1, pos);
+
+    QComboBox *type = new QComboBox(m_fieldsTable);
+    for(quint8 i = 0; i < NUM_COUNT; ++i)
+        type->addItem(dataTypes[i]);
+    type->setCurrentIndex(field.type < NUM_COUNT ? field.type : 0);
+    m_fieldsTable->setCellWidget(row, 2, type);
+
+    connect(pos,  SIGNAL(valueChanged(int)),        SLOT(fieldsChanged()));
+    connect(type, SIGNAL(currentIndexChanged(int)), SLOT(fieldsChanged()));
+}
+
+void SourceDialog::addField()
+{
+    // New field starts at the beginning of packet body
+    const packet_field field(tr("field%1").arg(m_fieldsTable->rowCount()+1),
+                             m_packet.header->length, NUM_UINT8);
+    addFieldRow(field);
+    fieldsChanged();
+}
+
+void SourceDialog::removeField()
+{
+    const int row = m_fieldsTable->currentRow();
+    if(row < 0)
+        return;
+
+    m_fieldsTable->removeRow(row);
+    fieldsChanged();
+}
+
+void SourceDialog::fieldsChanged()
+{
+    m_packet.fields.clear();
+    for(int i = 0; i < m_fieldsTable->rowCount(); ++i)
+    {
+        QTableWidgetItem *name = m_fieldsTable->item(i, 0);
+        QSpinBox *pos = (QSpinBox*)m_fieldsTable->cellWidget(i, 1);
+        QComboBox *type = (QComboBox*)m_fieldsTable->cellWidget(i, 2);
+        if(!name || !pos || !type)
+            continue;
+
+        m_packet.fields.push_back(packet_field(name->text().trimmed(), pos->value(), type->currentIndex()));
+    }
+    m_packet.compile();
+}
+
 analyzer_packet *SourceDialog::getStructure(analyzer_packet *pkt, PortConnection *con, const QString &importFile)
 {
     SourceDialog d(pkt, con, importFile);
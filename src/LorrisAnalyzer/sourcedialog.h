@@ -25,6 +25,7 @@ class QAbstractButton;
 class PacketParser;
 class QListWidgetItem;
 class PortConnection;
+class QTableWidget;
 
 class SourceDialog : public QDialog
 {
@@ -53,15 +54,24 @@ public slots:
     void switchStackPage(bool avakar);
     void packetLenSetStatic(bool setStatic);
 
+private slots:
+    void structureChanged();
+    void addField();
+    void removeField();
+    void fieldsChanged();
+
 private:
     void AddOrRmHeaderType(bool add, quint8 type);
     void updateHeaderLabels();
+    void createFieldsBox();
+    void addFieldRow(const packet_field& field);
 
     ScrollDataLayout *scroll_layout;
     LabelLayout *scroll_header;
     Ui::SourceDialog *ui;
     analyzer_packet m_packet;
     PacketParser *m_parser;
+    QTableWidget *m_fieldsTable;
     bool setted;
 };
 
@@ -7,7 +7,6 @@
 
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QCryptographicHash>
 #include <QApplication>
 
 #include "storage.h"
@@ -19,12 +18,14 @@
 static const char *ANALYZER_DATA_FORMAT = "v7";
 static const char ANALYZER_DATA_MAGIC[] = { (char)0xFF, (char)0x80, 0x68 };
 
-#define MD5(x) QCryptographicHash::hash(x, QCryptographicHash::Md5)
-
 Storage::Storage(LorrisAnalyzer *analyzer)
 {
     m_packet = NULL;
     m_analyzer = analyzer;
+    m_rec_limit = 0;
+    m_rawLog.setLimit(quint64(sConfig.get(CFG_QUINT32_ANALYZER_RAW_LOG))*1024*1024);
+
+    connect(&m_recorder, SIGNAL(recordingError(QString)), SIGNAL(recordingError(QString)));
 }
 
 Storage::~Storage()
@@ -36,8 +37,18 @@ void Storage::setPacket(analyzer_packet *packet)
 {
     m_packet = packet;
 
-    if(m_data.empty())
-        return;
+    // Segments contain the structure, start new one
+    if(m_recorder.isRecording())
+    {
+        try {
+            if(m_packet)
+                startRecording(m_rec_folder);
+            else
+                stopRecording();
+        } catch(const QString& ex) {
+            emit recordingError(ex);
+        }
+    }
 }
 
 void Storage::setPacketLimit(int limit)
@@ -49,16 +60,85 @@ void Storage::setPacketLimit(int limit)
     emit onPacketLimitChanged(limit);
 }
 
+void Storage::startRecording(const QString &folder)
+{
+    if(!m_packet)
+        throw tr("Packet structure is not set!");
+
+    // Restarted when the structure changes, the limit is already lowered
+    const bool restart = m_recorder.isRecording();
+
+    m_rec_folder = folder;
+    m_recorder.startRecording(folder, m_packet,
+                              quint64(sConfig.get(CFG_QUINT32_ANALYZER_REC_SIZE))*1024*1024,
+                              sConfig.get(CFG_QUINT32_ANALYZER_REC_TIME)*60);
+
+    const int cache = (std::max)(1u, sConfig.get(CFG_QUINT32_ANALYZER_REC_CACHE));
+    if(!restart && getPacketLimit() > cache)
+    {
+        m_rec_limit = getPacketLimit();
+        setPacketLimit(cache);
+    }
+}
+
+void Storage::stopRecording()
+{
+    m_recorder.stopRecording();
+
+    // Raising the limit never drops packets, keep it if user raised it more
+    if(m_rec_limit > getPacketLimit())
+        setPacketLimit(m_rec_limit);
+    m_rec_limit = 0;
+}
+
 void Storage::Clear()
 {
     m_data.clear();
+    m_rawLog.clear();
 }
 
-QByteArray *Storage::addData(const QByteArray& data)
+packet_view Storage::addData(const char *data, quint32 len, qint64 time)
 {
     if(!m_packet)
-        return NULL;
-    return m_data.push_back(data);
+        return packet_view();
+
+    // Used for loaded packets, only received ones are recorded
+    return m_data.push_back(data, len, time);
+}
+
+packet_view Storage::commitPacket(quint32 len, qint64 time)
+{
+    if(!m_packet)
+        return packet_view();
+
+    const packet_view res = m_data.commit(len, time);
+    m_recorder.addPacket(res.data, res.size, time);
+    return res;
+}
+
+quint32 Storage::appendBatch(StorageData &batch)
+{
+    if(!m_packet)
+        return 0;
+
+    const quint32 count = batch.size();
+    if(m_recorder.isRecording())
+    {
+        for(quint32 i = 0; i < count; ++i)
+        {
+            const packet_view p = batch[i];
+            m_recorder.addPacket(p.data, p.size, p.time);
+        }
+    }
+
+    m_data.append(batch);
+    return count;
+}
+
+void Storage::replaceData(StorageData &data)
+{
+    m_data.clear();
+    m_data.append(data);
 }
 
 void Storage::SaveToFile(WidgetArea *area, FilterTabWidget *filters)
@@ -74,7 +154,7 @@ void Storage::SaveToFile(WidgetArea *area, FilterTabWidget *filters)
         return;
     }
 
-    QByteArray md5 = MD5(file.readAll());
+    QByteArray md5 = DataFileBuilder::fileChecksum(file);
     file.close();
 
     if(md5 != m_file_md5)
@@ -113,8 +193,18 @@ void Storage::SaveToFile(QString filename, WidgetArea *area, FilterTabWidget *fi
 
     sConfig.set(CFG_STRING_ANALYZER_FOLDER, filename);
 
-    QByteArray data;
-    {
+    // The file is about to be overwritten, mapping would be invalid
+    if(m_data.isMapped() && QFileInfo(m_data.getMappedFileName()) == QFileInfo(filename))
+        m_data.unmap();
+
+    // File is written progressively, packets are passed to the writer
+    // every SAVE_FLUSH bytes, so that the whole file is never in memory
+    static const qint64 SAVE_FLUSH = 4*1024*1024;
+
+    try {
+        DataFileWriter writer(filename, filename.contains(".cldta"), DATAFILE_ANALYZER);
+
+        QByteArray data;
         DataFileParser buffer(&data, QIODevice::WriteOnly);
 
         //Header
@@ -138,22 +228,72 @@ void Storage::SaveToFile(QString filename, WidgetArea *area, FilterTabWidget *fi
         buffer.write((char*)&packet->header->static_len, sizeof(packet->header->static_len));
         buffer.write((char*)packet->static_data.data(), packet->header->static_len);
 
+        // Named fields
+        buffer.writeBlockIdentifier(BLOCK_PACKET_FIELDS);
+        buffer << (quint32)packet->fields.size();
+        for(size_t i = 0; i < packet->fields.size(); ++i)
+        {
+            buffer.writeString(packet->fields[i].name);
+            buffer << packet->fields[i].pos;
+            buffer << packet->fields[i].type;
+        }
+
         //Filters
         filters->Save(&buffer);
 
         //Data
-        buffer.writeBlockIdentifier(BLOCK_DATA);
-
         quint32 packetCount = m_data.size();
+
+        // Length of the packet records, so that loader can skip
+        // them and map them from the file. It is computed upfront,
+        // the records are already written to file when they end.
+        quint64 dataSize = 0;
+        for(quint32 i = 0; i < packetCount; ++i)
+            dataSize += sizeof(quint32) + m_data[i].size;
+
+        buffer.writeBlockIdentifier(BLOCK_DATA_SIZE);
+        buffer << dataSize;
+
+        buffer.writeBlockIdentifier(BLOCK_DATA);
         buffer.write((char*)&packetCount, sizeof(quint32));
 
-        for(quint32 i = 0; i < m_data.size(); ++i)
+        quint64 dataPos = 0;
+        std::vector<quint64> chunks;
+        chunks.reserve(packetCount/StorageData::MAP_CHUNK + 1);
+
+        for(quint32 i = 0; i < packetCount; ++i)
         {
-            const QByteArray& d = m_data[i];
-            buffer << (quint32)d.size();
-            buffer.write(d);
+            if(i % StorageData::MAP_CHUNK == 0)
+                chunks.push_back(dataPos);
+
+            const packet_view d = m_data[i];
+            buffer << d.size;
+            buffer.write(d.data, d.size);
+            dataPos += sizeof(quint32) + d.size;
+
+            if(buffer.pos() >= SAVE_FLUSH)
+                buffer.writeTo(writer);
+        }
+
+        // Receive times are in separate block, so that older
+        // versions can still read the packets
+        buffer.writeBlockIdentifier(BLOCK_DATA_TIMESTAMPS);
+        buffer << packetCount;
+        for(quint32 i = 0; i < packetCount; ++i)
+        {
+            buffer << m_data[i].time;
+
+            if(buffer.pos() >= SAVE_FLUSH)
+                buffer.writeTo(writer);
         }
 
+        // Offset of every MAP_CHUNK-th packet
+        buffer.writeBlockIdentifier(BLOCK_DATA_CHUNKS);
+        buffer << (quint32)StorageData::MAP_CHUNK;
+        buffer << (quint32)chunks.size();
+        for(size_t i = 0; i < chunks.size(); ++i)
+            buffer << chunks[i];
+
         //Widgets
         buffer.writeBlockIdentifier(BLOCK_WIDGETS);
         area->saveWidgets(&buffer);
@@ -169,11 +309,10 @@ void Storage::SaveToFile(QString filename, WidgetArea *area, FilterTabWidget *fi
         buffer.writeBlockIdentifier(BLOCK_PACKET_LIMIT);
         buffer << m_data.getPacketLimit();
 
+        buffer.writeTo(writer);
         buffer.close();
-    }
 
-    try {
-        m_file_md5 = DataFileBuilder::writeWithHeader(filename, data, filename.contains(".cldta"), DATAFILE_ANALYZER);
+        m_file_md5 = writer.finish();
     } catch(const QString& ex) {
         Utils::showErrorBox(ex);
     }
@@ -199,6 +338,12 @@ analyzer_packet *Storage::loadFromFile(QString *name, quint8 load, WidgetArea *a
     QByteArray data;
     bool legacy = false;
 
+    // Uncompressed files are mapped, packets are read from the file
+    // only when they are accessed. Has to outlive data.
+    QScopedPointer<QFile> mapFile(new QFile(filename));
+    const char *mapped = NULL;
+    quint64 mappedSize = 0;
+
     QScopedPointer<QMessageBox> loading_box;
     {
         QFile file(filename);
@@ -222,18 +367,29 @@ analyzer_packet *Storage::loadFromFile(QString *name, quint8 load, WidgetArea *a
         QApplication::processEvents();
         QApplication::processEvents();
 
-        try {
-            data = DataFileBuilder::readAndCheck(file, DATAFILE_ANALYZER, &legacy);
+        mapped = DataFileBuilder::mapData(*mapFile, DATAFILE_ANALYZER, mappedSize);
+        if(mapped)
+        {
+            // Only the blocks before packet data are read from here,
+            // the rest is switched to when packets are skipped
+            data = QByteArray::fromRawData(mapped, (std::min)(mappedSize, (quint64)INT_MAX));
         }
-        catch(const QString& ex)
+        else
         {
-            delete loading_box.take();
-            Utils::showErrorBox(tr("Error while loading data file: %1").arg(ex));
-            return NULL;
+            mapFile.reset();
+
+            try {
+                data = DataFileBuilder::readAndCheck(file, DATAFILE_ANALYZER, &legacy);
+            }
+            catch(const QString& ex)
+            {
+                delete loading_box.take();
+                Utils::showErrorBox(tr("Error while loading data file: %1").arg(ex));
+                return NULL;
+            }
         }
 
-        file.seek(0);
-        m_file_md5 = MD5(file.readAll());
+        m_file_md5 = DataFileBuilder::fileChecksum(file);
 
         file.close();
         QFileInfo info(filename);
@@ -321,35 +477,74 @@ analyzer_packet *Storage::loadFromFile(QString *name, quint8 load, WidgetArea *a
 
         // FIXME: header data and this lenght must be same,
         // corrupted file?
-        m_packet->header->static_len = static_len;
+        header->static_len = static_len;
 
         if(static_len)
         {
-            m_packet->static_data.resize(static_len);
-            buffer.read((char*)m_packet->static_data.data(), static_len);
+            packet->static_data.resize(static_len);
+            buffer.read((char*)packet->static_data.data(), static_len);
+        }
+    }
+
+    // Named fields
+    if(buffer.seekToNextBlock(BLOCK_PACKET_FIELDS, BLOCK_FILTERS))
+    {
+        // position and type, name is before them
+        static const qint64 fieldValSize = sizeof(quint32) + sizeof(quint8);
+
+        // Count comes from the file, fields are read only while
+        // there is enough data for them
+        const quint32 count = buffer.readVal<quint32>();
+        for(quint32 i = 0; i < count; ++i)
+        {
+            if(buffer.size() - buffer.pos() < qint64(sizeof(quint32)) + fieldValSize)
+                break;
+
+            packet_field field;
+            field.name = buffer.readString();
+
+            if(buffer.size() - buffer.pos() < fieldValSize)
+                break;
+
+            buffer >> field.pos;
+            buffer >> field.type;
+
+            if(field.type >= NUM_COUNT)
+                break;
+            packet->fields.push_back(field);
         }
     }
+    packet->compile();
 
     //Devices and commands
     filters->setHeader(header.data());
     filters->Load(&buffer, !(load & STORAGE_STRUCTURE));
 
     //Data
+    quint64 dataSize = 0;
+    const bool hasDataSize = buffer.seekToNextBlock(BLOCK_DATA_SIZE, BLOCK_DATA);
+    if(hasDataSize)
+        buffer.readVal(dataSize);
+
     if(buffer.seekToNextBlock(BLOCK_DATA, 0))
     {
         quint32 packetCount = 0;
         buffer.read((char*)&packetCount, sizeof(quint32));
 
-        QByteArray data;
-        for(quint32 i = 0; i < packetCount; ++i)
+        const qint64 dataStart = buffer.pos();
+        if(mapped && hasDataSize && dataStart + dataSize <= mappedSize)
         {
-            quint32 len = 0;
-            buffer.read((char*)&len, sizeof(quint32));
-            data = buffer.read(len);
+            // Data may be bigger than QByteArray can hold, offsets
+            // are 64-bit from here on
+            const char *packets = mapped + dataStart;
+            const char *tail = packets + dataSize;
+            buffer.setRawData(tail, (std::min)(quint64(mapped + mappedSize - tail), (quint64)INT_MAX));
 
             if(load & STORAGE_DATA)
-                addData(data);
+                loadMapped(&buffer, mapFile.take(), packets, dataSize, packetCount, mapped + mappedSize);
         }
+        else
+            loadPackets(&buffer, data.constData(), packetCount, load);
     }
 
     //Widgets
@@ -381,6 +576,76 @@ analyzer_packet *Storage::loadFromFile(QString *name, quint8 load, WidgetArea *a
     return m_packet;
 }
 
+void Storage::loadPackets(DataFileParser *buffer, const char *data, quint32 packetCount, quint8 load)
+{
+    // Packets are added straight from the loaded file data,
+    // without temporary QByteArray for each one
+    for(quint32 i = 0; i < packetCount; ++i)
+    {
+        quint32 len = 0;
+        buffer->read((char*)&len, sizeof(quint32));
+
+        const qint64 pos = buffer->pos();
+        if(pos + len > buffer->size())
+            break;
+
+        if(load & STORAGE_DATA)
+            addData(data + pos, len);
+        buffer->seek(pos + len);
+    }
+
+    // Do not search for next blocks inside packet data
+    buffer->skip(0);
+
+    if((load & STORAGE_DATA) && buffer->seekToNextBlock(BLOCK_DATA_TIMESTAMPS, BLOCK_WIDGETS))
+    {
+        const quint32 count = buffer->readVal<quint32>();
+
+        // Packet limit might have dropped some packets from the start
+        const quint32 skip = count - (std::min)(count, m_data.size());
+        for(quint32 i = 0; i < count; ++i)
+        {
+            const qint64 time = buffer->readVal<qint64>();
+            if(i >= skip && i - skip < m_data.size())
+                m_data.setTime(i - skip, time);
+        }
+    }
+}
+
+void Storage::loadMapped(DataFileParser *buffer, QFile *file, const char *data, quint64 len, quint32 packetCount,
+                         const char *mapEnd)
+{
+    // Timestamps follow right after the packets, do not use BLOCK_WIDGETS
+    // as limit, that would scan whole timestamp array
+    const char *times = NULL;
+    if(buffer->seekToNextBlock(BLOCK_DATA_TIMESTAMPS, 0) &&
+       buffer->readVal<quint32>() == packetCount)
+    {
+        const char *start = buffer->data().constData() + buffer->pos();
+        const quint64 timesLen = quint64(packetCount)*sizeof(qint64);
+        if(timesLen <= quint64(mapEnd - start))
+        {
+            times = start;
+            buffer->setRawData(start + timesLen, (std::min)(quint64(mapEnd - start) - timesLen, (quint64)INT_MAX));
+        }
+    }
+
+    std::vector<quint64> chunks;
+    if(buffer->seekToNextBlock(BLOCK_DATA_CHUNKS, BLOCK_WIDGETS) &&
+       buffer->readVal<quint32>() == StorageData::MAP_CHUNK)
+    {
+        const quint32 count = buffer->readVal<quint32>();
+        if(count == (packetCount + StorageData::MAP_CHUNK - 1)/StorageData::MAP_CHUNK)
+        {
+            chunks.resize(count);
+            for(quint32 i = 0; i < count; ++i)
+                chunks[i] = buffer->readVal<quint64>();
+        }
+    }
+
+    m_data.setMapped(file, data, len, packetCount, times, chunks);
+}
+
 bool Storage::checkMagic(DataFileParser *file)
 {
     char magic[3];
@@ -400,7 +665,10 @@ void Storage::ExportToBin(const QString &filename)
         throw tr("Unable to open file %1 for writing!").arg(filename);
 
     for(quint32 i = 0; i < m_data.size(); ++i)
-        f.write(m_data[i]);
+    {
+        const packet_view d = m_data[i];
+        f.write(d.data, d.size);
+    }
 
     f.close();
 }
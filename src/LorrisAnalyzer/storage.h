@@ -16,6 +16,8 @@
 
 #include "packet.h"
 #include "storagedata.h"
+#include "recorder.h"
+#include "rawlog.h"
 
 enum StorageDataType
 {
@@ -36,6 +38,7 @@ class Storage : public QObject
 
 Q_SIGNALS:
     void onPacketLimitChanged(int currentLimit);
+    void recordingError(const QString& error);
 
 public:
     explicit Storage(LorrisAnalyzer *analyzer);
@@ -46,12 +49,29 @@ public:
 
     void Clear();
 
-    QByteArray *addData(const QByteArray& data);
+    packet_view addData(const char *data, quint32 len, qint64 time = 0);
+    packet_view addData(const QByteArray& data, qint64 time = 0) { return addData(data.constData(), data.size(), time); }
+
+    // Used by PacketParser to build packet in place, see StorageData::reserve()
+    StorageData *getData() { return &m_data; }
+    packet_view commitPacket(quint32 len, qint64 time);
+
+    // Moves packets received by ParseWorker, returns their count
+    quint32 appendBatch(StorageData& batch);
+
+    // Bytes the packets were framed from, see RawLog
+    RawLog *getRawLog() { return &m_rawLog; }
+
+    // Replaces all packets by the re-framed ones. They are not passed
+    // to the recorder, it already has the received bytes.
+    void replaceData(StorageData& data);
+
     quint32 getSize() const { return m_data.size(); }
     quint32 getMaxIdx() const { return m_data.size() ? m_data.size()-1 : 0; }
     bool isEmpty() const { return m_data.empty(); }
     bool isFull() const { return m_data.full(); }
-    QByteArray *get(quint32 index) { return &m_data[index]; }
+    packet_view get(quint32 index) const { return m_data[index]; }
+    quint64 getFirstSeq() const { return m_data.firstSeq(); }
     analyzer_packet *loadFromFile(QString *name, quint8 load, WidgetArea *area, FilterTabWidget *filters, quint32 &data_idx);
 
     const QString& getFilename() { return m_filename; }
@@ -60,6 +80,13 @@ public:
     int getPacketLimit() const { return m_data.getPacketLimit(); }
     void setPacketLimit(int limit);
 
+    // Every new packet is written to disk, memory keeps only recent
+    // ones (packet limit is lowered until the recording is stopped).
+    // Throws QString on error. See Recorder::readSegments() for import.
+    void startRecording(const QString& folder);
+    void stopRecording();
+    bool isRecording() const { return m_recorder.isRecording(); }
+
 public slots:
     void SaveToFile(QString filename, WidgetArea *area, FilterTabWidget *filters);
     void SaveToFile(WidgetArea *area, FilterTabWidget *filters);
@@ -67,13 +94,20 @@ public slots:
 
 private:
     bool checkMagic(DataFileParser *file);
+    void loadPackets(DataFileParser *buffer, const char *data, quint32 packetCount, quint8 load);
+    void loadMapped(DataFileParser *buffer, QFile *file, const char *data, quint64 len, quint32 packetCount,
+                    const char *mapEnd);
     void readLegacyStructure(DataFileParser *file, analyzer_packet *packet);
 
     StorageData m_data;
+    RawLog m_rawLog;
+    Recorder m_recorder;
     analyzer_packet *m_packet;
     LorrisAnalyzer *m_analyzer;
 
     QString m_filename;
+    QString m_rec_folder;
+    int m_rec_limit; // packet limit before recording lowered it, 0 if it did not
     QByteArray m_file_md5;
 };
 
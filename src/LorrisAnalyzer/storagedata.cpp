@@ -5,12 +5,27 @@
 **    See README and COPYING
 ***********************************************/
 
+#include <string.h>
+#include <climits>
+#include <algorithm>
+#include <QFile>
+
 #include "storagedata.h"
 
+#define SLAB_SIZE (1 << 20)
+
 StorageData::StorageData()
 {
     m_packet_limit = INT_MAX;
-    m_offset = 0;
+    m_slab_size = SLAB_SIZE;
+    m_first_slab = 0;
+    m_pending = 0;
+    m_first_seq = 0;
+
+    m_map_file = NULL;
+    m_map_data = m_map_times = NULL;
+    m_map_len = 0;
+    m_map_first = m_map_count = 0;
 }
 
 StorageData::~StorageData()
@@ -20,66 +35,385 @@ StorageData::~StorageData()
 
 void StorageData::clear()
 {
-    m_data.clear();
-    m_offset = 0;
+    m_first_seq += size();
+
+    for(std::deque<slab>::iterator itr = m_slabs.begin(); itr != m_slabs.end(); ++itr)
+        delete[] (*itr).data;
+
+    m_slabs.clear();
+    m_index.clear();
+    m_first_slab = 0;
+    m_pending = 0;
+
+    closeMapping();
+}
+
+void StorageData::closeMapping()
+{
+    delete m_map_file;
+    m_map_file = NULL;
+    m_map_data = m_map_times = NULL;
+    m_map_len = 0;
+    m_map_first = m_map_count = 0;
+    m_map_chunks.clear();
+}
+
+void StorageData::setMapped(QFile *file, const char *data, quint64 data_len, quint32 count,
+                            const char *times, const std::vector<quint64>& chunks)
+{
+    clear();
+
+    m_map_file = file;
+    m_map_data = data;
+    m_map_len = data_len;
+    m_map_times = times;
+    m_map_count = count;
+
+    m_map_chunks.resize(chunks.size());
+    for(size_t i = 0; i < chunks.size(); ++i)
+        m_map_chunks[i].offset = chunks[i];
+
+    // File without chunk index, has to read all the lengths
+    if(m_map_chunks.empty())
+    {
+        quint64 off = 0;
+        for(quint32 i = 0; i < count && off + sizeof(quint32) <= data_len; ++i)
+        {
+            if(i % MAP_CHUNK == 0)
+            {
+                m_map_chunks.push_back(map_chunk());
+                m_map_chunks.back().offset = off;
+            }
+
+            quint32 len = 0;
+            memcpy(&len, data + off, sizeof(quint32));
+            off += sizeof(quint32) + len;
+        }
+    }
+
+    while(size() > (quint32)m_packet_limit)
+        pop_front();
+}
+
+QString StorageData::getMappedFileName() const
+{
+    return m_map_file ? m_map_file->fileName() : QString();
+}
+
+void StorageData::unmap()
+{
+    if(!m_map_file)
+        return;
+
+    std::deque<entry> index;
+    index.swap(m_index);
+
+    std::deque<slab> slabs;
+    slabs.swap(m_slabs);
+    const quint32 first_slab = m_first_slab;
+    m_first_slab = 0;
+    m_pending = 0;
+
+    for(quint32 i = 0; i < mappedSize(); ++i)
+    {
+        const packet_view p = getMapped(i);
+
+        entry e;
+        e.len = p.size;
+        e.time = p.time;
+        memcpy(allocate(p.size, e.slab, e.offset), p.data, p.size);
+        m_index.push_back(e);
+    }
+
+    // Move packets which were added after the file was loaded
+    for(size_t i = 0; i < index.size(); ++i)
+    {
+        const entry& old = index[i];
+
+        entry e;
+        e.len = old.len;
+        e.time = old.time;
+        memcpy(allocate(e.len, e.slab, e.offset), slabs[old.slab - first_slab].data + old.offset, e.len);
+        m_index.push_back(e);
+    }
+
+    for(std::deque<slab>::iterator itr = slabs.begin(); itr != slabs.end(); ++itr)
+        delete[] (*itr).data;
+
+    closeMapping();
 }
 
 void StorageData::setPacketLimit(int limit)
 {
+    limit = (std::max)(1, limit);
     if(limit == m_packet_limit)
         return;
 
-    if(!m_data.empty())
+    while(size() > (quint32)limit)
+        pop_front();
+
+    m_packet_limit = limit;
+}
+
+packet_view StorageData::operator[](quint32 idx) const
+{
+    if(idx < mappedSize())
+        return getMapped(idx);
+
+    const entry& e = m_index[idx - mappedSize()];
+    return packet_view(m_slabs[e.slab - m_first_slab].data + e.offset, e.len, e.time);
+}
+
+packet_view StorageData::push_back(const char *data, quint32 len, qint64 time)
+{
+    entry e;
+    e.len = len;
+    e.time = time;
+
+    m_pending = 0;
+    char *dest = allocate(len, e.slab, e.offset);
+    memcpy(dest, data, len);
+
+    m_index.push_back(e);
+    if(size() > (quint32)m_packet_limit)
+        pop_front();
+
+    return packet_view(dest, len, time);
+}
+
+void StorageData::setSlabSize(quint32 size)
+{
+    m_slab_size = (std::max)((quint32)SLAB_SIZE, size);
+}
+
+char *StorageData::reserve(quint32 used, quint32 size)
+{
+    if(used > m_pending)
+        return NULL;
+
+    if(m_slabs.empty() || m_slabs.back().size - m_slabs.back().used < size)
     {
-        size_t itr;
-        std::vector<QByteArray> vec;
-        vec.reserve((std::min)(m_data.size(), (size_t)limit));
+        slab s;
+        s.size = (std::max)(m_slab_size, size);
+        s.used = 0;
 
-        if(m_offset < limit)
+        const bool hasLast = !m_slabs.empty();
+        if(hasLast)
         {
-            itr = m_data.size() - (std::min)(m_data.size()-m_offset, size_t(limit - m_offset));
-            vec.insert(vec.end(), m_data.begin()+itr, m_data.end());
+            // Big packet keeps outgrowing its slab, double the space so that
+            // the received part is not copied again with every chunk
+            const slab& last = m_slabs.back();
+            const quint64 grown = quint64(last.size - last.used)*2;
+            if(used != 0 && size > m_slab_size)
+                s.size = (std::max)(size, quint32((std::min)(grown, (quint64)UINT_MAX)));
         }
 
-        itr = (std::max)(0, m_offset-limit);
-        vec.insert(vec.end(), m_data.begin()+itr, m_data.begin()+m_offset);
+        s.data = new char[s.size];
+
+        // Move the part which was already received
+        if(used != 0)
+            memcpy(s.data, m_slabs.back().data + m_slabs.back().used, used);
 
-        m_data.swap(vec);
+        // Slab with no packets in it would only be freed with the next
+        // one, replace it instead
+        const quint32 last_seq = m_first_slab + m_slabs.size() - 1;
+        if(hasLast && m_slabs.back().used == 0 && (m_index.empty() || m_index.back().slab != last_seq))
+        {
+            delete[] m_slabs.back().data;
+            m_slabs.back() = s;
+        }
+        else
+            m_slabs.push_back(s);
     }
 
-    m_packet_limit = limit;
-    m_offset = 0;
+    m_pending = size;
+
+    slab& s = m_slabs.back();
+    return s.data + s.used;
 }
 
-QByteArray& StorageData::operator[](quint32 idx)
+packet_view StorageData::commit(quint32 len, qint64 time)
 {
-    idx += m_offset;
-    if(idx >= m_data.size())
-        idx -= m_data.size();
-    return m_data[idx];
+    Q_ASSERT(len <= m_pending);
+
+    slab& s = m_slabs.back();
+
+    entry e;
+    e.len = len;
+    e.time = time;
+    e.slab = m_first_slab + m_slabs.size() - 1;
+    e.offset = s.used;
+
+    s.used += len;
+    m_pending = 0;
+
+    m_index.push_back(e);
+    const packet_view res(s.data + e.offset, len, time);
+
+    if(size() > (quint32)m_packet_limit)
+        pop_front();
+    return res;
 }
 
-QByteArray *StorageData::push_back(const QByteArray& data)
+void StorageData::takePackets(StorageData& src)
 {
-    QByteArray *res = NULL;
-    if(m_data.size() < (quint32)m_packet_limit)
+    Q_ASSERT(empty() && !src.isMapped());
+
+    if(src.m_index.empty())
+        return;
+
+    // All slabs but the last one are full, just move them. Slab numbers
+    // are rebased after our slabs, which may be left by pop_front().
+    slab& last = src.m_slabs.back();
+    const quint32 last_seq = src.m_first_slab + src.m_slabs.size() - 1;
+    const quint32 base = m_first_slab + m_slabs.size();
+    for(size_t i = 0; i + 1 < src.m_slabs.size(); ++i)
+        m_slabs.push_back(src.m_slabs[i]);
+
+    // Packets from the last one are copied to a slab of exact size,
+    // so that src can reuse it and mostly empty slabs are not passed on
+    quint32 last_bytes = 0;
+    bool last_used = false;
+    for(size_t i = 0; i < src.m_index.size(); ++i)
     {
-        m_data.push_back(data);
-        res = &m_data.back();
+        if(src.m_index[i].slab == last_seq)
+        {
+            last_bytes += src.m_index[i].len;
+            last_used = true;
+        }
     }
-    else
+
+    slab copy;
+    copy.size = copy.used = last_bytes;
+    copy.data = last_bytes ? new char[last_bytes] : NULL;
+
+    for(size_t i = 0; i < src.m_index.size(); ++i)
     {
-        if((quint32)m_offset >= m_data.size())
-            m_offset = 0;
+        entry e = src.m_index[i];
+        if(e.slab == last_seq)
+        {
+            const quint32 offset = e.offset;
+            e.slab = base + src.m_slabs.size() - 1;
+            e.offset = copy.used - last_bytes;
+            memcpy(copy.data + e.offset, last.data + offset, e.len);
+            last_bytes -= e.len;
+        }
+        else
+            e.slab = e.slab - src.m_first_slab + base;
+        m_index.push_back(e);
+    }
+
+    if(last_used)
+        m_slabs.push_back(copy);
 
-        m_data[m_offset] = data;
-        res = &m_data[m_offset];
-        ++m_offset;
+    // Reserved bytes go to the start of the last slab
+    memmove(last.data, last.data + last.used, src.m_pending);
+    last.used = 0;
+
+    src.m_slabs.erase(src.m_slabs.begin(), src.m_slabs.end() - 1);
+    src.m_first_seq += src.m_index.size();
+    src.m_index.clear();
+    src.m_first_slab = 0;
+}
+
+void StorageData::append(StorageData& other)
+{
+    Q_ASSERT(!other.isMapped());
+
+    // Reserved space would no longer be at the end of the last slab
+    m_pending = 0;
+
+    const quint32 base = m_first_slab + m_slabs.size();
+    for(size_t i = 0; i < other.m_index.size(); ++i)
+    {
+        entry e = other.m_index[i];
+        e.slab = e.slab - other.m_first_slab + base;
+        m_index.push_back(e);
     }
+    m_slabs.insert(m_slabs.end(), other.m_slabs.begin(), other.m_slabs.end());
 
-    // Data in this class will never be modified,
-    // so release unused memory
-    res->squeeze();
-    return res;
+    other.m_slabs.clear();
+    other.m_first_seq += other.m_index.size();
+    other.m_index.clear();
+    other.m_first_slab = 0;
+    other.m_pending = 0;
+
+    while(size() > (quint32)m_packet_limit)
+        pop_front();
 }
 
+packet_view StorageData::getMapped(quint32 idx) const
+{
+    idx += m_map_first;
+
+    map_chunk& chunk = m_map_chunks[idx / MAP_CHUNK];
+    if(chunk.offsets.empty())
+    {
+        // Walk the packets of this chunk, only its pages are read
+        const quint32 count = (std::min)((quint32)MAP_CHUNK, m_map_count - (idx / MAP_CHUNK)*MAP_CHUNK);
+        chunk.offsets.resize(count);
+
+        quint64 off = chunk.offset;
+        for(quint32 i = 0; i < count && off + sizeof(quint32) <= m_map_len; ++i)
+        {
+            quint32 len = 0;
+            memcpy(&len, m_map_data + off, sizeof(quint32));
+
+            chunk.offsets[i] = off - chunk.offset;
+            off += sizeof(quint32) + len;
+        }
+    }
+
+    const quint64 off = chunk.offset + chunk.offsets[idx % MAP_CHUNK];
+
+    quint32 len = 0;
+    memcpy(&len, m_map_data + off, sizeof(quint32));
+    if(off + sizeof(quint32) + len > m_map_len) // corrupted file
+        len = 0;
+
+    qint64 time = 0;
+    if(m_map_times)
+        memcpy(&time, m_map_times + quint64(idx)*sizeof(qint64), sizeof(qint64));
+
+    return packet_view(m_map_data + off + sizeof(quint32), len, time);
+}
+
+char *StorageData::allocate(quint32 len, quint32& slab_seq, quint32& offset)
+{
+    if(m_slabs.empty() || m_slabs.back().size - m_slabs.back().used < len)
+    {
+        slab s;
+        s.size = (std::max)(m_slab_size, len);
+        s.data = new char[s.size];
+        s.used = 0;
+        m_slabs.push_back(s);
+    }
+
+    slab& s = m_slabs.back();
+    slab_seq = m_first_slab + m_slabs.size() - 1;
+    offset = s.used;
+    s.used += len;
+    return s.data + offset;
+}
+
+void StorageData::pop_front()
+{
+    ++m_first_seq;
+
+    if(mappedSize() != 0)
+    {
+        ++m_map_first;
+        return;
+    }
+
+    m_index.pop_front();
+
+    // Keep the last slab, new packets are appended to it
+    const quint32 keep = m_index.empty() ? m_first_slab + m_slabs.size() - 1 : m_index.front().slab;
+    while(m_first_slab < keep)
+    {
+        delete[] m_slabs.front().data;
+        m_slabs.pop_front();
+        ++m_first_slab;
+    }
+}
@@ -8,30 +8,137 @@
 #ifndef STORAGEDATA_H
 #define STORAGEDATA_H
 
+#include <deque>
 #include <vector>
 #include <QByteArray>
 
+class QFile;
+
+// Read-only view of one packet in StorageData. It does not own
+// the bytes and is valid until the packet is evicted or the storage
+// is cleared.
+struct packet_view
+{
+    packet_view() : data(NULL), size(0), time(0) { }
+    packet_view(const char *d, quint32 s, qint64 t = 0) : data(d), size(s), time(t) { }
+
+    bool isNull() const { return data == NULL; }
+
+    // Makes a deep copy, use when the data must outlive the storage
+    QByteArray toByteArray() const { return QByteArray(data, size); }
+
+    const char *data;
+    quint32 size;
+    qint64 time; // receive time, see Utils::monotonicTimestamp(). 0 if unknown
+};
+
+// Packets are appended into large slabs, so there is no allocation
+// per packet. The index stores only slab number, offset and length.
+// Packets are evicted from the front when packet limit is reached,
+// slab is freed once all its packets are gone.
+//
+// Packets can also come from memory-mapped data file, see setMapped().
+// These are always before the slab ones. The file is split to chunks
+// of MAP_CHUNK packets and offsets inside a chunk are computed only
+// when the chunk is first accessed.
 class StorageData
 {
 public:
+    enum { MAP_CHUNK = 4096 };
+
     StorageData();
     virtual ~StorageData();
 
     void clear();
-    inline bool empty() const { return m_data.empty(); }
-    inline bool full() const { return m_data.size() >= (quint32)m_packet_limit; }
-    inline quint32 size() const { return m_data.size(); }
+    inline bool empty() const { return size() == 0; }
+    inline bool full() const { return size() >= (quint32)m_packet_limit; }
+    inline quint32 size() const { return mappedSize() + m_index.size(); }
+
+    // Sequence number of packet at index 0. Packets keep their
+    // sequence number, it only grows as packets are evicted or cleared.
+    quint64 firstSeq() const { return m_first_seq; }
 
     int getPacketLimit() const { return m_packet_limit; }
     void setPacketLimit(int limit);
 
-    QByteArray& operator [](quint32 idx);
-    QByteArray *push_back(const QByteArray& data);
+    // Size of newly allocated slabs, can be raised when a lot of
+    // packets is expected. Slab is freed only with all its packets.
+    void setSlabSize(quint32 size);
+
+    packet_view operator [](quint32 idx) const;
+    packet_view push_back(const char *data, quint32 len, qint64 time = 0);
+    void setTime(quint32 idx, qint64 time) { m_index[idx - mappedSize()].time = time; }
+
+    // Packet can be built directly in its final place: reserve() returns
+    // space for size bytes, first used bytes are kept from previous call.
+    // Returns NULL if they were lost (storage was cleared or push_back()
+    // was called). commit() then adds first len bytes as a packet.
+    char *reserve(quint32 used, quint32 size);
+    packet_view commit(quint32 len, qint64 time);
+
+    // Moves all packets from src to this empty storage, src keeps only
+    // the reserved bytes. Full slabs are moved without copying.
+    void takePackets(StorageData& src);
+
+    // Appends packets from other, its slabs are moved. other is left empty.
+    void append(StorageData& other);
+
+    // Takes ownership of file, which must be kept mapped. data points to
+    // length of the first packet, times to qint64 array or is NULL.
+    // chunks are offsets (relative to data) of every MAP_CHUNK-th packet,
+    // they are computed from the data if empty.
+    void setMapped(QFile *file, const char *data, quint64 data_len, quint32 count,
+                   const char *times, const std::vector<quint64>& chunks);
+    bool isMapped() const { return m_map_file != NULL; }
+    QString getMappedFileName() const;
+
+    // Copies mapped packets to slabs and closes the file
+    void unmap();
 
 private:
-    std::vector<QByteArray> m_data;
+    struct slab
+    {
+        char *data;
+        quint32 size;
+        quint32 used;
+    };
+
+    struct entry
+    {
+        qint64 time;
+        quint32 slab; // slab sequence number, see m_first_slab
+        quint32 offset;
+        quint32 len;
+    };
+
+    struct map_chunk
+    {
+        quint64 offset;
+        std::vector<quint32> offsets; // lazily filled, relative to offset
+    };
+
+    inline quint32 mappedSize() const { return m_map_count - m_map_first; }
+    packet_view getMapped(quint32 idx) const;
+    void closeMapping();
+
+    char *allocate(quint32 len, quint32& slab_seq, quint32& offset);
+    void pop_front();
+
+    std::deque<slab> m_slabs;
+    std::deque<entry> m_index;
+    quint32 m_first_slab; // sequence number of m_slabs.front()
+    quint32 m_pending; // reserved bytes at the end of last slab
+    quint32 m_slab_size;
+    quint64 m_first_seq;
     int m_packet_limit;
-    int m_offset;
+
+    QFile *m_map_file;
+    const char *m_map_data;
+    quint64 m_map_len;
+    const char *m_map_times;
+    quint32 m_map_first; // evicted from the front
+    quint32 m_map_count;
+    mutable std::vector<map_chunk> m_map_chunks;
 };
 
 #endif // STORAGEDATA_H
@@ -16,6 +16,7 @@
 #include <QProgressDialog>
 #include <QSignalMapper>
 #include <QInputDialog>
+#include <QMessageBox>
 
 #include "lorristerminal.h"
 #include "../ui/terminal.h"
@@ -68,6 +69,30 @@ void LorrisTerminal::initUI()
 
     dataMenu->addSeparator();
 
+    m_logAct = dataMenu->addAction(tr("Log received data to file..."));
+    m_logAct->setStatusTip(tr("Write all received data to a file as it comes, terminal can keep only recent ones"));
+    m_logAct->setCheckable(true);
+
+    QMenu *logTsMenu = dataMenu->addMenu(tr("Log timestamps"));
+    QSignalMapper *logTsMap = new QSignalMapper(this);
+    for(quint8 i = 0; i < LOG_TS_MAX; ++i)
+    {
+        static const QString tsText[] = { tr("None"), tr("Each line"), tr("Each received chunk") };
+
+        m_log_ts[i] = logTsMenu->addAction(tsText[i]);
+        m_log_ts[i]->setStatusTip(tr("Used when logging is started"));
+        m_log_ts[i]->setCheckable(true);
+        logTsMap->setMapping(m_log_ts[i], i);
+        connect(m_log_ts[i], SIGNAL(triggered()), logTsMap, SLOT(map()));
+    }
+    logTsAct(sConfig.get(CFG_QUINT32_TERMINAL_LOG_TS));
+
+    QAction *logSizeAct = dataMenu->addAction(tr("Log segment size..."));
+    logSizeAct->setStatusTip(tr("Log is split to files of this size, used when logging is started"));
+    connect(logSizeAct, SIGNAL(triggered()), SLOT(logSizeAct()));
+
+    dataMenu->addSeparator();
+
     QMenu *inputMenu = new QMenu(tr("Input handling"), this);
     addTopMenu(inputMenu);
     QSignalMapper *inputMap = new QSignalMapper(this);
@@ -107,6 +132,9 @@ void LorrisTerminal::initUI()
     connect(termLoad,          SIGNAL(triggered()),                 SLOT(loadText()));
     connect(termSave,          SIGNAL(triggered()),                 SLOT(saveText()));
     connect(binSave,           SIGNAL(triggered()),                 SLOT(saveBin()));
+    connect(m_logAct,          SIGNAL(triggered(bool)),             SLOT(logToFile(bool)));
+    connect(logTsMap,          SIGNAL(mapped(int)),                 SLOT(logTsAct(int)));
+    connect(&m_logger,         SIGNAL(loggingError(QString)),       SLOT(loggingError(QString)));
     connect(chgSettings,       SIGNAL(triggered()),   ui->terminal, SLOT(showSettings()));
     connect(ui->terminal,      SIGNAL(fmtSelected(int)),            SLOT(checkFmtAct(int)));
     connect(ui->terminal,      SIGNAL(paused(bool)),                SLOT(setPauseBtnText(bool)));
@@ -163,6 +191,7 @@ void LorrisTerminal::connectedStatus(bool connected)
 void LorrisTerminal::readData(const QByteArray& data)
 {
     ui->terminal->appendText(data);
+    m_logger.addData(data);
 }
 
 void LorrisTerminal::sendKeyEvent(const QString &key)
@@ -235,6 +264,18 @@ void LorrisTerminal::saveText()
 
 void LorrisTerminal::saveBin()
 {
+    if(ui->terminal->isDataTrimmed())
+    {
+        QMessageBox box(QMessageBox::Question, tr("Save binary data"),
+                        tr("Only the last %1 MB of received data are kept, older data were dropped. "
+                           "Use \"Log received data to file\" to keep everything, or raise the limit in terminal settings.\n\n"
+                           "Do you want to save the kept data?").arg(ui->terminal->getDataLimit()),
+                        (QMessageBox::Yes | QMessageBox::No), this);
+
+        if(box.exec() == QMessageBox::No)
+            return;
+    }
+
     static const QString filters = tr("Any file (*.*)");
     QString filename = QFileDialog::getSaveFileName(this, tr("Save binary data"),
                                                     sConfig.get(CFG_STRING_TERMINAL_TEXTFILE), filters);
@@ -254,6 +295,57 @@ void LorrisTerminal::saveBin()
     sConfig.set(CFG_STRING_TERMINAL_TEXTFILE, filename);
 }
 
+void LorrisTerminal::logToFile(bool log)
+{
+    if(!log)
+        return m_logger.stopLogging();
+
+    static const QString filters = tr("Log file (*.log);;Text file (*.txt);;Any file (*.*)");
+    QString filename = QFileDialog::getSaveFileName(this, tr("Log received data"),
+                                                    sConfig.get(CFG_STRING_TERMINAL_LOGFILE), filters);
+    if(filename.isEmpty())
+        return m_logAct->setChecked(false);
+
+    try {
+        m_logger.startLogging(filename, quint64(sConfig.get(CFG_QUINT32_TERMINAL_LOG_SIZE))*1024*1024,
+                              sConfig.get(CFG_QUINT32_TERMINAL_LOG_TS));
+    } catch(const QString& ex) {
+        m_logAct->setChecked(false);
+        return Utils::showErrorBox(ex, this);
+    }
+
+    sConfig.set(CFG_STRING_TERMINAL_LOGFILE, filename);
+    emit statusBarMsg(tr("Logging to file \"%1\"").arg(filename), 5000);
+}
+
+void LorrisTerminal::logTsAct(int act)
+{
+    if(act < 0 || act >= LOG_TS_MAX)
+        act = LOG_TS_NONE;
+
+    for(quint8 i = 0; i < LOG_TS_MAX; ++i)
+        m_log_ts[i]->setChecked(i == act);
+
+    sConfig.set(CFG_QUINT32_TERMINAL_LOG_TS, act);
+}
+
+void LorrisTerminal::logSizeAct()
+{
+    bool ok = false;
+    int size = QInputDialog::getInt(this, tr("Log segment size"),
+                                    tr("Maximal size of one log file in MB, 0 means the log is not split:"),
+                                    sConfig.get(CFG_QUINT32_TERMINAL_LOG_SIZE), 0, 1024*1024, 1, &ok);
+    if(ok)
+        sConfig.set(CFG_QUINT32_TERMINAL_LOG_SIZE, size);
+}
+
+void LorrisTerminal::loggingError(const QString &error)
+{
+    m_logger.stopLogging();
+    m_logAct->setChecked(false);
+    Utils::showErrorBox(error, this);
+}
+
 void LorrisTerminal::inputAct(int act)
 {
     for(quint8 i = 0; i < INPUT_MAX; ++i)
@@ -18,6 +18,7 @@
 #include "../ui/terminal.h"
 #include "../ui/chooseconnectiondlg.h"
 #include "../ui/connectbutton.h"
+#include "terminallogger.h"
 
 class QVBoxLayout;
 class QTextEdit;
@@ -50,6 +51,10 @@ private slots:
     void loadText();
     void saveText();
     void saveBin();
+    void logToFile(bool log);
+    void logTsAct(int act);
+    void logSizeAct();
+    void loggingError(const QString& error);
     void inputAct(int act);
     void sendButton();
     void spRtsToggled(bool);
@@ -68,6 +73,10 @@ private:
     QAction *m_import_eeprom;
     QAction *m_fmt_act[FMT_MAX];
     QAction *m_input[INPUT_MAX];
+    QAction *m_logAct;
+    QAction *m_log_ts[LOG_TS_MAX];
+
+    TerminalLogger m_logger;
 
     ConnectButton * m_connectButton;
     Ui::LorrisTerminal *ui;
@@ -0,0 +1,223 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <string.h>
+#include <algorithm>
+
+#include "terminallogger.h"
+
+TerminalLogger::TerminalLogger(QObject *parent) :
+    QThread(parent)
+{
+    m_queued = 0;
+    m_stop = false;
+    m_max_size = 0;
+    m_file_idx = 0;
+    m_file_size = 0;
+    m_timestamps = LOG_TS_NONE;
+    m_line_start = true;
+    m_ts_time = -1;
+}
+
+TerminalLogger::~TerminalLogger()
+{
+    stopLogging();
+}
+
+void TerminalLogger::startLogging(const QString &filename, quint64 maxSize, int timestamps)
+{
+    stopLogging();
+
+    m_filename = filename;
+    m_max_size = maxSize;
+    m_timestamps = timestamps;
+    m_file_idx = 0;
+    m_line_start = true;
+    m_ts_time = -1;
+    m_stop = false;
+
+    if(!openFile())
+        throw tr("Cannot open file \"%1\"!").arg(m_file.fileName());
+
+    start(QThread::LowPriority);
+}
+
+void TerminalLogger::stopLogging()
+{
+    if(!isRunning())
+        return;
+
+    m_mutex.lock();
+    m_stop = true;
+    m_cond.wakeOne();
+    m_mutex.unlock();
+
+    wait();
+}
+
+void TerminalLogger::addData(const QByteArray &data)
+{
+    if(!isRunning())
+        return;
+
+    chunk c;
+    c.data = data;
+    c.time = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker l(&m_mutex);
+    m_queue.push_back(c);
+    m_queued += data.size();
+
+    // Small reads are collected until FLUSH_INTERVAL passes
+    if(m_queued >= BUFFER_SIZE)
+        m_cond.wakeOne();
+}
+
+bool TerminalLogger::openFile()
+{
+    m_file.close();
+    m_file_size = 0;
+
+    // The chosen file was confirmed in the file dialog,
+    // segments after it must not overwrite anything
+    if(m_file_idx++ == 0)
+    {
+        m_file.setFileName(m_filename);
+        return m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+
+    QString name = segmentName(m_file_idx - 1);
+    while(QFile::exists(name))
+        name = segmentName(m_file_idx++);
+
+    m_file.setFileName(name);
+    return m_file.open(QIODevice::WriteOnly);
+}
+
+QString TerminalLogger::segmentName(quint32 idx) const
+{
+    const QFileInfo info(m_filename);
+    const QString suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+    return info.dir().filePath(QString("%1_%2%3")
+            .arg(info.completeBaseName())
+            .arg(idx, 3, 10, QChar('0'))
+            .arg(suffix));
+}
+
+// Splits data to segments of maximal size
+bool TerminalLogger::write(const char *data, quint64 len)
+{
+    while(len != 0)
+    {
+        if(m_max_size != 0 && m_file_size >= m_max_size && !openFile())
+        {
+            emit loggingError(tr("Cannot open file \"%1\"!").arg(m_file.fileName()));
+            return false;
+        }
+
+        quint64 chunk = len;
+        if(m_max_size != 0)
+            chunk = (std::min)(chunk, m_max_size - m_file_size);
+
+        if(m_file.write(data, chunk) != qint64(chunk))
+        {
+            emit loggingError(tr("Error while writing file \"%1\"!").arg(m_file.fileName()));
+            return false;
+        }
+
+        m_file_size += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+const QByteArray& TerminalLogger::timestamp(qint64 time)
+{
+    if(time != m_ts_time)
+    {
+        m_ts_time = time;
+        m_ts = "[" + QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1() + "] ";
+    }
+    return m_ts;
+}
+
+void TerminalLogger::format(const chunk &c, QByteArray &out)
+{
+    switch(m_timestamps)
+    {
+        case LOG_TS_NONE:
+            out.append(c.data);
+            break;
+        case LOG_TS_CHUNK:
+            out.append(timestamp(c.time));
+            out.append(c.data);
+            break;
+        case LOG_TS_LINE:
+        {
+            // Line gets the time when its first byte was received
+            const char *itr = c.data.constData();
+            const char *end = itr + c.data.size();
+            while(itr != end)
+            {
+                if(m_line_start)
+                    out.append(timestamp(c.time));
+
+                const char *nl = (const char*)memchr(itr, '\n', end - itr);
+                const char *next = nl ? nl + 1 : end;
+                out.append(itr, next - itr);
+
+                m_line_start = (nl != NULL);
+                itr = next;
+            }
+            break;
+        }
+    }
+}
+
+void TerminalLogger::run()
+{
+    std::vector<chunk> chunks;
+    QByteArray out;
+    bool stop = false;
+    while(!stop)
+    {
+        m_mutex.lock();
+        if(m_queued < BUFFER_SIZE && !m_stop)
+            m_cond.wait(&m_mutex, FLUSH_INTERVAL);
+        chunks.swap(m_queue);
+        m_queued = 0;
+        stop = m_stop;
+        m_mutex.unlock();
+
+        if(chunks.empty())
+            continue;
+
+        out.clear();
+        for(size_t i = 0; i < chunks.size(); ++i)
+            format(chunks[i], out);
+        chunks.clear();
+
+        if(!write(out.constData(), out.size()))
+            break;
+
+        if(!m_file.flush())
+        {
+            emit loggingError(tr("Error while writing file \"%1\"!").arg(m_file.fileName()));
+            break;
+        }
+    }
+
+    m_file.close();
+
+    QMutexLocker l(&m_mutex);
+    m_queue.clear();
+    m_queued = 0;
+}
@@ -0,0 +1,87 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef TERMINALLOGGER_H
+#define TERMINALLOGGER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <vector>
+
+enum log_timestamps
+{
+    LOG_TS_NONE = 0,
+    LOG_TS_LINE,
+    LOG_TS_CHUNK,
+
+    LOG_TS_MAX
+};
+
+// Writes received bytes to a file in background thread, so that nothing
+// is lost when Terminal's scrollback is limited. Data are written in
+// blocks of BUFFER_SIZE bytes or every FLUSH_INTERVAL ms. When rotation
+// is enabled, output is split at maximal size: the first segment is the
+// chosen file, next ones are name_001.ext, name_002.ext... Numbers of
+// existing files are skipped, so older logs are never overwritten.
+class TerminalLogger : public QThread
+{
+    Q_OBJECT
+
+Q_SIGNALS:
+    void loggingError(const QString& error);
+
+public:
+    enum { BUFFER_SIZE = 64*1024, FLUSH_INTERVAL = 250 };
+
+    explicit TerminalLogger(QObject *parent = 0);
+    ~TerminalLogger();
+
+    // Throws QString on error. maxSize is in bytes, 0 means no rotation.
+    // timestamps is one of log_timestamps.
+    void startLogging(const QString& filename, quint64 maxSize, int timestamps);
+    void stopLogging();
+    bool isLogging() const { return isRunning(); }
+
+    void addData(const QByteArray& data);
+
+protected:
+    void run();
+
+private:
+    struct chunk
+    {
+        QByteArray data;
+        qint64 time; // ms since epoch
+    };
+
+    bool openFile();
+    QString segmentName(quint32 idx) const;
+    bool write(const char *data, quint64 len);
+    void format(const chunk& c, QByteArray& out);
+    const QByteArray& timestamp(qint64 time);
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    std::vector<chunk> m_queue;
+    quint32 m_queued; // bytes in m_queue
+    bool m_stop;
+
+    // used only by the writing thread after start
+    QFile m_file;
+    QString m_filename;
+    quint64 m_max_size;
+    quint32 m_file_idx;
+    quint64 m_file_size; // bytes written to m_file
+    int m_timestamps;
+    bool m_line_start;
+    qint64 m_ts_time;
+    QByteArray m_ts;
+};
+
+#endif // TERMINALLOGGER_H
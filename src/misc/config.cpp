@@ -37,6 +37,12 @@ static const QString keys_quint32[] =
     "shupito/spi_tunnel_speed",  // CFG_QUINT32_SPI_TUNNEL_SPEED
     "shupito/spi_tunnel_modes",  // CFG_QUINT32_SPI_TUNNEL_MODES
     "main/freeze_timeout",    // CFG_QUINT32_SCRIPT_FREEZE_TIMEOUT
+    "analyzer/rec_segment_size", // CFG_QUINT32_ANALYZER_REC_SIZE
+    "analyzer/rec_segment_time", // CFG_QUINT32_ANALYZER_REC_TIME
+    "analyzer/rec_cache",        // CFG_QUINT32_ANALYZER_REC_CACHE
+    "analyzer/raw_log_size",     // CFG_QUINT32_ANALYZER_RAW_LOG
+    "terminal/log_segment_size", // CFG_QUINT32_TERMINAL_LOG_SIZE
+    "terminal/log_timestamps",   // CFG_QUINT32_TERMINAL_LOG_TS
 };
 
 static const quint32 def_quint32[] =
@@ -63,6 +69,12 @@ static const quint32 def_quint32[] =
     500000,                      // CFG_QUINT32_SPI_TUNNEL_SPEED
     0x200,                       // CFG_QUINT32_SPI_TUNNEL_MODES
     15000,                       // CFG_QUINT32_SCRIPT_FREEZE_TIMEOUT
+    64,                          // CFG_QUINT32_ANALYZER_REC_SIZE, MB
+    60,                          // CFG_QUINT32_ANALYZER_REC_TIME, minutes
+    100000,                      // CFG_QUINT32_ANALYZER_REC_CACHE
+    64,                          // CFG_QUINT32_ANALYZER_RAW_LOG, MB
+    64,                          // CFG_QUINT32_TERMINAL_LOG_SIZE, MB, 0 means no rotation
+    0,                           // CFG_QUINT32_TERMINAL_LOG_TS, LOG_TS_NONE
 };
 
 static const QString keys_string[] =
@@ -86,6 +98,8 @@ static const QString keys_string[] =
     "proxy/tunnel_name",          // CFG_STRING_PROXY_TUNNEL_NAME
     "shupito/avr109_bootseq",     // CFG_STRING_AVR109_BOOTSEQ
     "shupito/zmodem_bootseq",     // CFG_STRING_ZMODEM_BOOTSEQ
+    "analyzer/rec_folder",        // CFG_STRING_ANALYZER_REC_FOLDER
+    "terminal/log_file",          // CFG_STRING_TERMINAL_LOGFILE
 };
 
 static const QString def_string[] =
@@ -109,6 +123,8 @@ static const QString def_string[] =
     "Proxy tunnel",               // CFG_STRING_PROXY_TUNNEL_NAME
     "0x74 0x7E 0x7A 0x33",        // CFG_STRING_AVR109_BOOTSEQ
     "" /*"0x74 0x7E 0x7A 0x33"*/, // CFG_STRING_ZMODEM_BOOTSEQ
+    "",                           // CFG_STRING_ANALYZER_REC_FOLDER
+    "",                           // CFG_STRING_TERMINAL_LOGFILE
 };
 
 static const QString keys_bool[] =
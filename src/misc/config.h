@@ -38,6 +38,12 @@ enum cfg_quint32
     CFG_QUINT32_SPI_TUNNEL_SPEED,
     CFG_QUINT32_SPI_TUNNEL_MODES,
     CFG_QUINT32_SCRIPT_FREEZE_TIMEOUT,
+    CFG_QUINT32_ANALYZER_REC_SIZE,
+    CFG_QUINT32_ANALYZER_REC_TIME,
+    CFG_QUINT32_ANALYZER_REC_CACHE,
+    CFG_QUINT32_ANALYZER_RAW_LOG,
+    CFG_QUINT32_TERMINAL_LOG_SIZE,
+    CFG_QUINT32_TERMINAL_LOG_TS,
 
     CFG_QUINT32_NUM
 };
@@ -63,6 +69,8 @@ enum cfg_string
     CFG_STRING_PROXY_TUNNEL_NAME,
     CFG_STRING_AVR109_BOOTSEQ,
     CFG_STRING_ZMODEM_BOOTSEQ,
+    CFG_STRING_ANALYZER_REC_FOLDER,
+    CFG_STRING_TERMINAL_LOGFILE,
 
     CFG_STRING_NUM
 };
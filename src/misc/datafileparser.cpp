@@ -9,7 +9,9 @@
 #include <QCryptographicHash>
 #include <QMessageBox>
 #include <QEventLoop>
+#include <QThread>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
 #include <QTimer>
 #include <QApplication>
 #include <QDesktopWidget>
@@ -23,6 +25,16 @@
 
 #define MD5(x) QCryptographicHash::hash(x, QCryptographicHash::Md5)
 
+static QByteArray compressBlock(const QByteArray& block)
+{
+    return qCompress(block);
+}
+
+static QByteArray uncompressBlock(const QByteArray& block)
+{
+    return qUncompress(block);
+}
+
 static const char *blockNames[] = {
     "staticDataBlock",     // BLOCK_STATIC_DATA
     "collapseWStatus",     // BLOCK_COLLAPSE_STATUS
@@ -37,6 +49,10 @@ static const char *blockNames[] = {
     "dataIndexBlock",      // BLOCK_DATA_INDEX
     "packetLimits",        // BLOCK_PACKET_LIMIT
     "filterBlock",         // BLOCK_FILTERS
+    "dataTimestamps",      // BLOCK_DATA_TIMESTAMPS
+    "dataSize",            // BLOCK_DATA_SIZE
+    "dataChunks",          // BLOCK_DATA_CHUNKS
+    "packetFields",        // BLOCK_PACKET_FIELDS
 
     "tabWidget",           // BLOCK_TABWIDGET
     "tabWidgetTab",        // BLOCK_WORKTAB
@@ -150,6 +166,31 @@ void DataFileParser::writeBlockIdentifier(const char *block)
     write(name.data(), lenght);
 }
 
+void DataFileParser::skip(qint64 len)
+{
+    m_last_block = pos() + len;
+    seek(m_last_block);
+}
+
+void DataFileParser::setRawData(const char *data, qint64 len)
+{
+    Q_ASSERT(len <= INT_MAX);
+
+    const OpenMode mode = openMode();
+    close();
+    buffer() = QByteArray::fromRawData(data, len);
+    open(mode);
+
+    m_last_block = 0;
+}
+
+void DataFileParser::writeTo(DataFileWriter& writer)
+{
+    writer.write(buffer());
+    buffer().clear();
+    seek(0);
+}
+
 char *DataFileParser::getBlockWithFormat(const char *block, quint8& lenght)
 {
     lenght = strlen(block) + 3;
@@ -172,8 +213,9 @@ QString DataFileParser::readString()
     quint32 size = 0;
     read((char*)&size, sizeof(size));
 
+    // Data can be shorter than size in corrupted file
     QByteArray raw = read(size);
-    return QString::fromUtf8(raw.data(), size);
+    return QString::fromUtf8(raw.data(), raw.size());
 }
 
 void DataFileParser::writeColor(const QColor &color)
@@ -379,25 +421,32 @@ QByteArray DataFileBuilder::readAndCheck(QFile &file, DataFileTypes expectedType
 
     if(compressed && header && (header->flags & DATAFLAG_COMPRESSED))
     {
-        char *end = data.data() + data.size();
+        const char *begin = data.constData();
+        const char *end = begin + data.size();
         quint32 blocks = *( (quint32*) (end-sizeof(quint32)) );
-        data.chop(sizeof(blocks));
-        end = data.data() + data.size();
+        end -= sizeof(blocks);
 
-        std::vector<QByteArray> uncompressed(blocks);
-        quint32 resSize = 0;
-        for(quint32 i = 0; i < blocks; ++i)
+        // Blocks are independent, find them all and uncompress them
+        // on all cores. Blocks are stored from the end.
+        QList<QByteArray> compressed;
+        for(quint32 i = 0; i < blocks && end - begin >= (int)sizeof(quint32); ++i)
         {
             end -= sizeof(quint32);
             quint32 size = *((quint32*)end);
+            if(size > quint32(end - begin))
+                throw QObject::tr("Corrupted data file");
 
-            uncompressed[i] = qUncompress((const uchar*)(end-size), size);
-            resSize += uncompressed[i].size();
-
-            data.chop(size + sizeof(quint32));
-            end = data.data() + data.size();
+            end -= size;
+            compressed.push_back(QByteArray::fromRawData(end, size));
         }
 
+        QList<QByteArray> uncompressed = QtConcurrent::blockingMapped(compressed, uncompressBlock);
+        compressed.clear();
+
+        quint32 resSize = 0;
+        for(int i = 0; i < uncompressed.size(); ++i)
+            resSize += uncompressed[i].size();
+
         data.clear();
         data.reserve(resSize);
         while(!uncompressed.empty())
@@ -412,6 +461,51 @@ QByteArray DataFileBuilder::readAndCheck(QFile &file, DataFileTypes expectedType
     return data;
 }
 
+const char *DataFileBuilder::mapData(QFile& file, DataFileTypes expectedType, quint64& size)
+{
+    if(!file.isOpen() && !file.open(QIODevice::ReadOnly))
+        return NULL;
+
+    if(file.size() < (qint64)sizeof(DataFileHeader))
+        return NULL;
+
+    DataFileHeader header;
+    readHeader(file, &header);
+
+    if(strncmp(header.str, "LDTA", 4) != 0 || header.version < 2 ||
+       (header.flags & (DATAFLAG_COMPRESSED | DATAFLAG_COMPRESSED_OBSOLETE)))
+        return NULL;
+
+    if(expectedType != DATAFILE_NONE && header.data_type != expectedType)
+        return NULL;
+
+    const qint64 len = file.size() - header.header_size;
+    uchar *data = file.map(header.header_size, len);
+    if(!data)
+        return NULL;
+
+    size = len;
+    return (const char*)data;
+}
+
+QByteArray DataFileBuilder::fileChecksum(QFile& file)
+{
+    if(!file.isOpen() && !file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    file.seek(0);
+    if(file.size() >= (qint64)sizeof(DataFileHeader))
+    {
+        DataFileHeader header;
+        readHeader(file, &header);
+        if(strncmp(header.str, "LDTA", 4) == 0)
+            return QByteArray(header.md5, sizeof(header.md5));
+    }
+
+    file.seek(0);
+    return MD5(file.readAll());
+}
+
 QByteArray DataFileBuilder::writeWithHeader(const QString& filename, QByteArray &data, bool compress, DataFileTypes type)
 {
     QFile testFile(filename);
@@ -466,23 +560,31 @@ QByteArray DataFileBuilder::writeWithHeader_private(const QString& filename, QBy
         header.flags |= DATAFLAG_COMPRESSED;
         header.compressed_block = sConfig.get(CFG_QUINT32_COMPRESS_BLOCK);
 
-        std::vector<QByteArray> compressed(data.size()/header.compressed_block + 1);
-
-        quint32 chunk = (std::min)(header.compressed_block, (quint32)data.size());
-        char *end = data.data() + data.size();
-        quint32 size = 0;
-        for(quint32 i = 0; !data.isEmpty(); ++i)
+        // Chunks are cut from the end of data and there is one
+        // empty block if the size is multiple of compressed_block.
+        // Keep it that way, so that the files stay the same.
+        QList<QByteArray> chunks;
+        const char *begin = data.constData();
+        const char *end = begin + data.size();
+        while(end != begin)
         {
-            compressed[i] = qCompress((const uchar*)(end-chunk), chunk);
-            data.chop(chunk);
-            data.squeeze();
+            quint32 chunk = (std::min)(header.compressed_block, quint32(end - begin));
+            end -= chunk;
+            chunks.push_back(QByteArray::fromRawData(end, chunk));
+        }
 
-            size += compressed[i].size() + 4;
+        // Blocks are independent, compress them on all cores
+        QList<QByteArray> compressed = QtConcurrent::blockingMapped(chunks, compressBlock);
+        chunks.clear();
 
-            chunk = (std::min)(header.compressed_block, (quint32)data.size());
-            end = data.data() + data.size();
-        }
+        if(compressed.size() < int(data.size()/header.compressed_block + 1))
+            compressed.push_back(QByteArray());
+
+        quint32 size = 0;
+        for(int i = 0; i < compressed.size(); ++i)
+            size += compressed[i].size() + 4;
 
+        data.clear();
         data.reserve(size + 4);
         quint32 blocks = compressed.size();
         while(!compressed.empty())
@@ -513,6 +615,139 @@ QByteArray DataFileBuilder::writeWithHeader_private(const QString& filename, QBy
     return data;
 }
 
+DataFileWriter::DataFileWriter(const QString &filename, bool compress, DataFileTypes type) :
+    m_file(filename), m_md5(QCryptographicHash::Md5)
+{
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        throw QObject::tr("Cannot open file \"%1\"!").arg(filename);
+
+    DataFileBuilder::initHeader(m_header, type);
+
+    m_compress = compress;
+    m_error = false;
+    m_blocks = 0;
+
+    if(m_compress)
+    {
+        m_header.flags |= DATAFLAG_COMPRESSED;
+        m_header.compressed_block = sConfig.get(CFG_QUINT32_COMPRESS_BLOCK);
+
+        // one block for each core
+        m_batch_size = qint64(m_header.compressed_block)*(std::max)(1, QThread::idealThreadCount());
+    }
+    else
+        m_batch_size = 4*1024*1024;
+
+    // Placeholder, rewritten in finish()
+    DataFileBuilder::writeHeader(m_file, &m_header);
+
+    m_reporter = new ProgressReporter();
+}
+
+DataFileWriter::~DataFileWriter()
+{
+    m_future.waitForFinished();
+    delete m_reporter;
+}
+
+void DataFileWriter::write(const QByteArray &data)
+{
+    m_pending.append(data);
+
+    if(m_pending.size() >= m_batch_size)
+    {
+        // Keep data blocks full, leave the rest for next batch
+        qint64 len = m_pending.size();
+        if(m_compress)
+            len -= len % m_header.compressed_block;
+        startBatch(len);
+    }
+}
+
+void DataFileWriter::startBatch(qint64 len)
+{
+    waitForBatch();
+
+    QByteArray batch;
+    if(len == m_pending.size())
+        batch.swap(m_pending);
+    else
+    {
+        batch = m_pending.left(len);
+        m_pending.remove(0, len);
+    }
+
+    m_future = QtConcurrent::run(this, &DataFileWriter::processBatch, batch);
+}
+
+void DataFileWriter::waitForBatch()
+{
+    if(m_future.isFinished())
+        return;
+
+    // Keep UI painted, same as DataFileBuilder::writeWithHeader. User input
+    // is not processed, the data being saved must not be changed.
+    QFutureWatcher<void> watcher;
+    QEventLoop ev;
+    QObject::connect(&watcher, SIGNAL(finished()), &ev, SLOT(quit()));
+    watcher.setFuture(m_future);
+    if(!m_future.isFinished())
+        ev.exec(QEventLoop::ExcludeUserInputEvents);
+}
+
+void DataFileWriter::processBatch(QByteArray batch)
+{
+    if(m_compress)
+    {
+        QList<QByteArray> chunks;
+        for(int i = 0; i < batch.size(); i += m_header.compressed_block)
+        {
+            int len = (std::min)(int(m_header.compressed_block), batch.size() - i);
+            chunks.push_back(QByteArray::fromRawData(batch.constData() + i, len));
+        }
+
+        QList<QByteArray> compressed = QtConcurrent::blockingMapped(chunks, compressBlock);
+        chunks.clear();
+        batch.clear();
+
+        for(int i = 0; i < compressed.size(); ++i)
+        {
+            quint32 size = compressed[i].size();
+            batch.append(compressed[i]);
+            batch.append((char*)&size, sizeof(size));
+        }
+        m_blocks += compressed.size();
+    }
+
+    m_md5.addData(batch);
+    if(m_file.write(batch) != batch.size())
+        m_error = true;
+}
+
+QByteArray DataFileWriter::finish()
+{
+    if(!m_pending.isEmpty())
+        startBatch(m_pending.size());
+    waitForBatch();
+
+    if(m_compress)
+    {
+        m_md5.addData((char*)&m_blocks, sizeof(m_blocks));
+        if(m_file.write((char*)&m_blocks, sizeof(m_blocks)) != sizeof(m_blocks))
+            m_error = true;
+    }
+
+    QByteArray md5 = m_md5.result();
+    std::copy(md5.data(), md5.data()+sizeof(m_header.md5), m_header.md5);
+
+    DataFileBuilder::writeHeader(m_file, &m_header);
+    m_file.close();
+
+    if(m_error)
+        throw QObject::tr("Error while writing file \"%1\"!").arg(m_file.fileName());
+    return md5;
+}
+
 void DataFileBuilder::readHeader(QFile &file, DataFileHeader *header)
 {
     file.seek(0);
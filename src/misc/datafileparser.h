@@ -15,11 +15,14 @@
 #include <QFutureWatcher>
 #include <QTimer>
 #include <QFileInfo>
+#include <QCryptographicHash>
 
 #include "utils.h"
 
 class QEventLoop;
 class Connection;
+class DataFileWriter;
+class ProgressReporter;
 
 enum DataBlocks
 {
@@ -36,6 +39,10 @@ enum DataBlocks
     BLOCK_DATA_INDEX,
     BLOCK_PACKET_LIMIT,
     BLOCK_FILTERS,
+    BLOCK_DATA_TIMESTAMPS,
+    BLOCK_DATA_SIZE,
+    BLOCK_DATA_CHUNKS,
+    BLOCK_PACKET_FIELDS,
 
     BLOCK_TABWIDGET,
     BLOCK_WORKTAB,
@@ -93,6 +100,18 @@ public:
     void writeBlockIdentifier(DataBlocks block);
     void writeBlockIdentifier(const char* block);
 
+    // Seeks len bytes forward and starts next block search from there
+    void skip(qint64 len);
+
+    // Continues reading from len bytes at data, which are not owned nor
+    // copied. Used to read parts of mapped file that is too big
+    // for QByteArray.
+    void setRawData(const char *data, qint64 len);
+
+    // Passes everything written so far to writer and empties the buffer.
+    // Do not seek before this point afterwards.
+    void writeTo(DataFileWriter& writer);
+
     void writeString(const QString& str);
     QString readString();
 
@@ -132,9 +151,20 @@ private:
 
 class DataFileBuilder
 {
+    friend class DataFileWriter;
+
 public:
     static QByteArray readAndCheck(QFile& file, DataFileTypes expectedType, bool *legacy = NULL, DataFileHeader *fillHeader = NULL);
 
+    // Memory-maps data of uncompressed file with header and sets size to
+    // its length, which may be over 2 GB. The data is valid until the file
+    // is closed or destroyed. MD5 is not checked, that would read whole file.
+    // Returns NULL when the file can't be mapped, use readAndCheck() then.
+    static const char *mapData(QFile& file, DataFileTypes expectedType, quint64& size);
+
+    // MD5 from header if the file has one, otherwise MD5 of whole file
+    static QByteArray fileChecksum(QFile& file);
+
     // Returns MD5 of written data. data is cleared!
     static QByteArray writeWithHeader(const QString& filename, QByteArray& data, bool compress, DataFileTypes type);
 
@@ -153,11 +183,46 @@ private:
     static QFutureWatcher<QByteArray> *m_watcher;
 };
 
+// Writes data file with header progressively, so that the whole file
+// does not have to be in memory. Data are compressed, hashed and written
+// in background while the caller produces next part. Header with MD5
+// is written in finish().
+class DataFileWriter
+{
+public:
+    // Throws QString on error
+    DataFileWriter(const QString& filename, bool compress, DataFileTypes type);
+    ~DataFileWriter();
+
+    void write(const QByteArray& data);
+
+    // Returns MD5 from the header, throws QString on error
+    QByteArray finish();
+
+private:
+    void startBatch(qint64 len);
+    void waitForBatch();
+    void processBatch(QByteArray batch);
+
+    QFile m_file;
+    DataFileHeader m_header;
+    QCryptographicHash m_md5;
+    bool m_compress;
+    bool m_error;
+    quint32 m_blocks;
+    qint64 m_batch_size;
+
+    QByteArray m_pending;
+    QFuture<void> m_future;
+    ProgressReporter *m_reporter;
+};
+
 class ProgressReporter : public QObject
 {
     Q_OBJECT
 
     friend class DataFileBuilder;
+    friend class DataFileWriter;
 
 protected:
     ProgressReporter();
@@ -6,9 +6,324 @@
 ***********************************************/
 
 #include <QScriptEngine>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+
 #include "formulaevaluation.h"
 #include "../ui/formuladialog.h"
 
+// Wrappers, so that overloaded std functions can be taken by pointer
+namespace
+{
+double f_abs(double x)   { return std::fabs(x); }
+double f_acos(double x)  { return std::acos(x); }
+double f_asin(double x)  { return std::asin(x); }
+double f_atan(double x)  { return std::atan(x); }
+double f_ceil(double x)  { return std::ceil(x); }
+double f_cos(double x)   { return std::cos(x); }
+double f_exp(double x)   { return std::exp(x); }
+double f_floor(double x) { return std::floor(x); }
+double f_log(double x)   { return std::log(x); }
+double f_round(double x) { return std::floor(x + 0.5); } // as in JavaScript
+double f_sin(double x)   { return std::sin(x); }
+double f_sqrt(double x)  { return std::sqrt(x); }
+double f_tan(double x)   { return std::tan(x); }
+
+double f_atan2(double y, double x) { return std::atan2(y, x); }
+double f_pow(double x, double y)   { return std::pow(x, y); }
+double f_min(double x, double y)   { return (x != x || x < y) ? x : y; }
+double f_max(double x, double y)   { return (x != x || x > y) ? x : y; }
+
+struct math_func1 { const char *name; double (*func)(double); };
+struct math_func2 { const char *name; double (*func)(double, double); };
+struct math_const { const char *name; double value; };
+
+const math_func1 funcs1[] = {
+    { "abs", f_abs }, { "acos", f_acos }, { "asin", f_asin }, { "atan", f_atan },
+    { "ceil", f_ceil }, { "cos", f_cos }, { "exp", f_exp }, { "floor", f_floor },
+    { "log", f_log }, { "round", f_round }, { "sin", f_sin }, { "sqrt", f_sqrt },
+    { "tan", f_tan },
+    { NULL, NULL }
+};
+
+const math_func2 funcs2[] = {
+    { "atan2", f_atan2 }, { "pow", f_pow }, { "min", f_min }, { "max", f_max },
+    { NULL, NULL }
+};
+
+const math_const consts[] = {
+    { "PI", 3.14159265358979323846 }, { "E", 2.71828182845904523536 },
+    { "LN2", 0.69314718055994530942 }, { "LN10", 2.30258509299404568402 },
+    { "SQRT2", 1.41421356237309504880 },
+    { NULL, 0 }
+};
+
+inline bool isIdentChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '$';
+}
+}
+
+CompiledFormula::CompiledFormula()
+{
+    m_pos = m_depth = m_maxDepth = 0;
+}
+
+bool CompiledFormula::compile(const QString &formula)
+{
+    m_code.clear();
+    m_src = formula.toLatin1();
+    m_pos = m_depth = m_maxDepth = 0;
+
+    bool res = parseExpr();
+
+    skipSpaces();
+    if(!res || m_pos != m_src.size() || m_maxDepth > MAX_STACK)
+        m_code.clear();
+
+    m_src.clear();
+    return isValid();
+}
+
+double CompiledFormula::evaluate(double n) const
+{
+    double stack[MAX_STACK];
+    int top = -1;
+
+    const op *itr = m_code.data();
+    const op *end = itr + m_code.size();
+    for(; itr != end; ++itr)
+    {
+        switch(itr->code)
+        {
+            case OP_CONST: stack[++top] = itr->value; break;
+            case OP_N:     stack[++top] = n; break;
+            case OP_ADD:   --top; stack[top] += stack[top+1]; break;
+            case OP_SUB:   --top; stack[top] -= stack[top+1]; break;
+            case OP_MUL:   --top; stack[top] *= stack[top+1]; break;
+            case OP_DIV:   --top; stack[top] /= stack[top+1]; break;
+            case OP_MOD:   --top; stack[top] = std::fmod(stack[top], stack[top+1]); break;
+            case OP_NEG:   stack[top] = -stack[top]; break;
+            case OP_FUNC1: stack[top] = itr->func1(stack[top]); break;
+            case OP_FUNC2:
+                --top;
+                stack[top] = itr->func2(stack[top], stack[top+1]);
+                break;
+        }
+    }
+    return stack[0];
+}
+
+void CompiledFormula::emitOp(opcode code, double value)
+{
+    op o;
+    o.code = code;
+    o.value = value;
+    o.func1 = NULL;
+    o.func2 = NULL;
+    m_code.push_back(o);
+
+    switch(code)
+    {
+        case OP_CONST:
+        case OP_N:
+            m_maxDepth = (std::max)(m_maxDepth, ++m_depth);
+            break;
+        case OP_NEG:
+        case OP_FUNC1:
+            break;
+        default:
+            --m_depth;
+            break;
+    }
+}
+
+void CompiledFormula::skipSpaces()
+{
+    while(m_pos < m_src.size() && isspace((uchar)m_src.at(m_pos)))
+        ++m_pos;
+}
+
+bool CompiledFormula::accept(char c)
+{
+    skipSpaces();
+    if(m_pos >= m_src.size() || m_src.at(m_pos) != c)
+        return false;
+    ++m_pos;
+    return true;
+}
+
+bool CompiledFormula::parseExpr()
+{
+    if(!parseTerm())
+        return false;
+
+    while(true)
+    {
+        if(accept('+'))
+        {
+            if(!parseTerm())
+                return false;
+            emitOp(OP_ADD);
+        }
+        else if(accept('-'))
+        {
+            if(!parseTerm())
+                return false;
+            emitOp(OP_SUB);
+        }
+        else
+            return true;
+    }
+}
+
+bool CompiledFormula::parseTerm()
+{
+    if(!parseUnary())
+        return false;
+
+    while(true)
+    {
+        skipSpaces();
+
+        opcode code;
+        if(accept('*'))
+            code = OP_MUL;
+        else if(accept('/'))
+            code = OP_DIV;
+        // %n is operand, not modulo
+        else if(m_pos+1 < m_src.size() && m_src.at(m_pos+1) != 'n' && accept('%'))
+            code = OP_MOD;
+        else
+            return true;
+
+        if(!parseUnary())
+            return false;
+        emitOp(code);
+    }
+}
+
+bool CompiledFormula::parseUnary()
+{
+    if(accept('-'))
+    {
+        if(!parseUnary())
+            return false;
+        emitOp(OP_NEG);
+        return true;
+    }
+    else if(accept('+'))
+        return parseUnary();
+    return parsePrimary();
+}
+
+bool CompiledFormula::parsePrimary()
+{
+    skipSpaces();
+    if(m_pos >= m_src.size())
+        return false;
+
+    const char c = m_src.at(m_pos);
+    if(c == '(')
+    {
+        ++m_pos;
+        return parseExpr() && accept(')');
+    }
+    else if(c == '%')
+    {
+        if(m_pos+1 >= m_src.size() || m_src.at(m_pos+1) != 'n')
+            return false;
+        m_pos += 2;
+        emitOp(OP_N);
+        return true;
+    }
+    else if((c >= '0' && c <= '9') || c == '.')
+    {
+        // Not strtod, it depends on locale
+        int end = m_pos;
+        while(end < m_src.size() && (isdigit((uchar)m_src.at(end)) || m_src.at(end) == '.'))
+            ++end;
+        if(end < m_src.size() && (m_src.at(end) == 'e' || m_src.at(end) == 'E'))
+        {
+            ++end;
+            if(end < m_src.size() && (m_src.at(end) == '+' || m_src.at(end) == '-'))
+                ++end;
+            while(end < m_src.size() && isdigit((uchar)m_src.at(end)))
+                ++end;
+        }
+
+        // hex and octal literals are left to script engine
+        if(end < m_src.size() && isIdentChar(m_src.at(end)))
+            return false;
+        if(c == '0' && end - m_pos > 1 && isdigit((uchar)m_src.at(m_pos+1)))
+            return false;
+
+        bool ok = false;
+        double val = m_src.mid(m_pos, end - m_pos).toDouble(&ok);
+        if(!ok)
+            return false;
+
+        m_pos = end;
+        emitOp(OP_CONST, val);
+        return true;
+    }
+    else if(m_src.mid(m_pos, 5) == "Math.")
+    {
+        m_pos += 5;
+        return parseMath();
+    }
+    return false;
+}
+
+bool CompiledFormula::parseMath()
+{
+    int len = 0;
+    while(m_pos + len < m_src.size() && isIdentChar(m_src.at(m_pos + len)))
+        ++len;
+
+    const QByteArray name = m_src.mid(m_pos, len);
+    m_pos += len;
+
+    for(const math_const *c = consts; c->name; ++c)
+    {
+        if(name == c->name)
+        {
+            emitOp(OP_CONST, c->value);
+            return true;
+        }
+    }
+
+    if(!accept('('))
+        return false;
+
+    for(const math_func1 *f = funcs1; f->name; ++f)
+    {
+        if(name != f->name)
+            continue;
+
+        if(!parseExpr() || !accept(')'))
+            return false;
+        emitOp(OP_FUNC1);
+        m_code.back().func1 = f->func;
+        return true;
+    }
+
+    for(const math_func2 *f = funcs2; f->name; ++f)
+    {
+        if(name != f->name)
+            continue;
+
+        if(!parseExpr() || !accept(',') || !parseExpr() || !accept(')'))
+            return false;
+        emitOp(OP_FUNC2);
+        m_code.back().func2 = f->func;
+        return true;
+    }
+    return false;
+}
+
 FormulaEvaluation::FormulaEvaluation(QObject *parent) : QObject(parent)
 {
     m_script_eng = NULL;
@@ -23,6 +338,8 @@ void FormulaEvaluation::setFormula(const QString &formula)
     emit setError(false);
     m_error = false;
 
+    m_compiled.clear();
+
     if(m_formula == "%n")
     {
         delete m_script_eng;
@@ -35,10 +352,18 @@ void FormulaEvaluation::setFormula(const QString &formula)
     }
     else
     {
+        // Simple arithmetic does not need the script engine
+        const bool compiled = m_compiled.compile(m_formula);
+
         m_formula.replace("%1", "%%1");
         m_formula.replace("%n", "%1");
 
-        if(!m_script_eng)
+        if(compiled)
+        {
+            delete m_script_eng;
+            m_script_eng = NULL;
+        }
+        else if(!m_script_eng)
             m_script_eng = new QScriptEngine(this);
     }
 }
@@ -62,6 +387,15 @@ void FormulaEvaluation::showFormulaDialog()
 
 QVariant FormulaEvaluation::evaluate(const QString& val)
 {
+    if(m_compiled.isValid())
+    {
+        bool ok = false;
+        double n = val.toDouble(&ok);
+        if(!ok)
+            return QVariant();
+        return QVariant(m_compiled.evaluate(n));
+    }
+
     if(!m_script_eng)
         return QVariant();
 
@@ -86,3 +420,10 @@ QVariant FormulaEvaluation::evaluate(const QString& val)
     }
     return QVariant();
 }
+
+double FormulaEvaluation::evaluate(double val)
+{
+    if(m_compiled.isValid())
+        return m_compiled.evaluate(val);
+    return evaluate(QString::number(val, 'f')).toDouble();
+}
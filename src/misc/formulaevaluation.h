@@ -9,9 +9,71 @@
 #define FORMULAEVALUATION_H
 
 #include <QObject>
+#include <QByteArray>
+#include <vector>
 
 class QScriptEngine;
 
+// Formula compiled to stack machine code, evaluated on doubles directly.
+// Handles only the arithmetic subset of formula language: %n, numbers,
+// + - * / %, parentheses and Math.* functions and constants. compile()
+// returns false for anything else, those must go to script engine.
+class CompiledFormula
+{
+public:
+    CompiledFormula();
+
+    bool compile(const QString& formula);
+    bool isValid() const { return !m_code.empty(); }
+    void clear() { m_code.clear(); }
+
+    double evaluate(double n) const;
+
+private:
+    enum opcode
+    {
+        OP_CONST,
+        OP_N,
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        OP_MOD,
+        OP_NEG,
+        OP_FUNC1,
+        OP_FUNC2
+    };
+
+    enum { MAX_STACK = 32 };
+
+    struct op
+    {
+        opcode code;
+        double value;
+        double (*func1)(double);
+        double (*func2)(double, double);
+    };
+
+    // recursive descent parser, all return false on error
+    bool parseExpr();
+    bool parseTerm();
+    bool parseUnary();
+    bool parsePrimary();
+    bool parseMath();
+
+    void skipSpaces();
+    bool accept(char c);
+    void emitOp(opcode code, double value = 0);
+
+    std::vector<op> m_code;
+
+    // used only while compiling
+    QByteArray m_src;
+    int m_pos;
+    int m_depth;
+    int m_maxDepth;
+};
+
 class FormulaEvaluation : public QObject
 {
     Q_OBJECT
@@ -23,7 +85,9 @@ public:
     FormulaEvaluation(QObject *parent = NULL);
 
     QVariant evaluate(const QString& val);
-    bool isActive() const { return m_script_eng != NULL; }
+    // Faster for numeric values, errors result in 0
+    double evaluate(double val);
+    bool isActive() const { return m_compiled.isValid() || m_script_eng != NULL; }
 
 public slots:
     void setFormula(const QString& formula);
@@ -31,6 +95,7 @@ public slots:
     void showFormulaDialog();
 
 private:
+    CompiledFormula m_compiled;
     QScriptEngine *m_script_eng;
     QString m_formula;
     bool m_error;
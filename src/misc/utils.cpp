@@ -13,6 +13,8 @@
 #include <QDir>
 #include <QDesktopServices>
 #include <QDesktopWidget>
+#include <QElapsedTimer>
+#include <QDateTime>
 
 #if QT_VERSION < 0x050000
 #include <QDesktopServices>
@@ -291,6 +293,20 @@ size_t Utils::align(size_t & offset, size_t & size, size_t alignment)
     return front_padding;
 }
 
+static QElapsedTimer startedTimer()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+qint64 Utils::monotonicTimestamp()
+{
+    static const qint64 epoch = QDateTime::currentMSecsSinceEpoch()*1000000LL;
+    static const QElapsedTimer timer = startedTimer();
+    return epoch + timer.nsecsElapsed();
+}
+
 QString Utils::storageLocation(StandardLocation loc)
 {
 #if QT_VERSION < 0x050000
@@ -96,6 +96,10 @@ public:
 
     static size_t align(size_t & offset, size_t & size, size_t alignment);
 
+    // Nanoseconds since Unix epoch. Wall clock is read only once,
+    // the rest is measured by monotonic clock, so it never goes back.
+    static qint64 monotonicTimestamp();
+
     static QString storageLocation(StandardLocation loc);
 
     static void moveDataFolder();
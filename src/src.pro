@@ -43,6 +43,7 @@ SOURCES += ui/mainwindow.cpp \
     WorkTab/WorkTabInfo.cpp \
     LorrisTerminal/lorristerminal.cpp \
     LorrisTerminal/lorristerminalinfo.cpp \
+    LorrisTerminal/terminallogger.cpp \
     connection/connection.cpp \
     connection/serialport.cpp \
     LorrisAnalyzer/lorrisanalyzerinfo.cpp \
@@ -51,6 +52,7 @@ SOURCES += ui/mainwindow.cpp \
     LorrisAnalyzer/labellayout.cpp \
     LorrisAnalyzer/packet.cpp \
     LorrisAnalyzer/DataWidgets/datawidget.cpp \
+    LorrisAnalyzer/DataWidgets/numbercolumn.cpp \
     LorrisAnalyzer/DataWidgets/numberwidget.cpp \
     LorrisAnalyzer/DataWidgets/barwidget.cpp \
     LorrisAnalyzer/sourceselectdialog.cpp \
@@ -108,6 +110,8 @@ SOURCES += ui/mainwindow.cpp \
     ui/rotatebutton.cpp \
     ui/terminalsettings.cpp \
     ui/terminal.cpp \
+    ui/terminaldata.cpp \
+    ui/terminalscreen.cpp \
     misc/sessionmgr.cpp \
     misc/datafileparser.cpp \
     LorrisAnalyzer/DataWidgets/sliderwidget.cpp \
@@ -162,6 +166,11 @@ SOURCES += ui/mainwindow.cpp \
     LorrisAnalyzer/confirmwidget.cpp \
     LorrisAnalyzer/DataWidgets/RotationWidget/rotationwidget.cpp \
     LorrisAnalyzer/storagedata.cpp \
+    LorrisAnalyzer/recorder.cpp \
+    LorrisAnalyzer/parseworker.cpp \
+    LorrisAnalyzer/rawlog.cpp \
+    LorrisAnalyzer/reframer.cpp \
+    LorrisAnalyzer/filterindexer.cpp \
     ui/floatingwidget.cpp \
     ui/floatinginputdialog.cpp \
     LorrisProgrammer/modes/shupitospitunnel.cpp \
@@ -182,6 +191,7 @@ HEADERS += ui/mainwindow.h \
     WorkTab/WorkTabInfo.h \
     LorrisTerminal/lorristerminal.h \
     LorrisTerminal/lorristerminalinfo.h \
+    LorrisTerminal/terminallogger.h \
     connection/connection.h \
     connection/serialport.h \
     LorrisAnalyzer/lorrisanalyzer.h \
@@ -191,6 +201,7 @@ HEADERS += ui/mainwindow.h \
     LorrisAnalyzer/labellayout.h \
     LorrisAnalyzer/packet.h \
     LorrisAnalyzer/DataWidgets/datawidget.h \
+    LorrisAnalyzer/DataWidgets/numbercolumn.h \
     LorrisAnalyzer/DataWidgets/numberwidget.h \
     LorrisAnalyzer/DataWidgets/barwidget.h \
     LorrisAnalyzer/sourceselectdialog.h \
@@ -251,6 +262,8 @@ HEADERS += ui/mainwindow.h \
     ui/rotatebutton.h \
     ui/terminalsettings.h \
     ui/terminal.h \
+    ui/terminaldata.h \
+    ui/terminalscreen.h \
     misc/sessionmgr.h \
     misc/datafileparser.h \
     LorrisAnalyzer/DataWidgets/sliderwidget.h \
@@ -308,6 +321,11 @@ HEADERS += ui/mainwindow.h \
     ui/floatinginputdialog.h \
     LorrisAnalyzer/DataWidgets/RotationWidget/rotationwidget.h \
     LorrisAnalyzer/storagedata.h \
+    LorrisAnalyzer/recorder.h \
+    LorrisAnalyzer/parseworker.h \
+    LorrisAnalyzer/rawlog.h \
+    LorrisAnalyzer/reframer.h \
+    LorrisAnalyzer/filterindexer.h \
     LorrisProgrammer/modes/shupitospitunnel.h \
     connection/shupitospitunnelconn.h \
     LorrisProgrammer/programmers/arduinoprogrammer.h \
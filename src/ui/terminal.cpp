@@ -18,6 +18,7 @@
 
 #define QT_USE_FAST_CONCATENATION
 
+#include <climits>
 #include <QApplication>
 #include <QScrollBar>
 #include <QKeyEvent>
@@ -35,12 +36,9 @@
 #include "../common.h"
 #include "terminal.h"
 #include "terminalsettings.h"
-#include "termina-colors.h"
 
-Terminal::Terminal(QWidget *parent) : QAbstractScrollArea(parent)
+Terminal::Terminal(QWidget *parent) : QAbstractScrollArea(parent), m_screen(&m_settings)
 {
-    m_data.reserve(512);
-
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 
     QPalette p = palette();
@@ -51,8 +49,12 @@ Terminal::Terminal(QWidget *parent) : QAbstractScrollArea(parent)
     m_paused = false;
     m_fmt = FMT_MAX+1;
     m_input = INPUT_SEND_KEYPRESS;
-    m_hex_pos = 0;
-    m_last_esc = NULL;
+    m_pause_hex_end = 0;
+    m_parsed = 0;
+    m_view_first = 0;
+    m_view_hex = 0;
+    m_changed = m_full_update = true;
+    applyLimits();
 
     viewport()->setCursor(Qt::IBeamCursor);
     setFont(Utils::getMonospaceFont());
@@ -111,287 +113,100 @@ Terminal::~Terminal()
 
 void Terminal::appendText(const QByteArray& text)
 {
-    if(m_data.size()+text.size() > m_data.capacity())
-        while(m_data.capacity() < m_data.size()+text.size())
-            m_data.reserve(m_data.capacity()+512);
-
-    m_data.insert(m_data.end(), text.data(), text.data()+text.size());
-
-    switch(m_fmt)
-    {
-        case FMT_TEXT: addLines(QString::fromUtf8(text)); break;
-        case FMT_HEX:  addHex();       break;
-    }
+    // Bytes are only stored here, they are parsed once per update,
+    // see parsePending()
+    m_data.append(text.data(), text.size());
 
     if(!m_paused)
         m_changed = true;
 }
 
-void Terminal::addLines(const QString &text)
+void Terminal::parsePending()
 {
-    quint32 pos = m_cursor_pos.y();
-    QChar *line_start = (QChar*)text.data();
-    QChar *line_end = line_start;
-
-    for(int i = 0; i < text.size(); ++i)
+    // Hex view is drawn from m_data, the screen is kept up to date
+    // in both formats so that switching between them is instant.
+    // Bytes over data limit which were not parsed yet are lost.
+    quint64 pos = std::max(m_parsed, m_data.begin());
+    quint32 avail = 0;
+    while(const char *data = m_data.at(pos, avail))
     {
-        const auto c = (*line_end).unicode();
-
-        if(!m_esc_seq.isEmpty()) {
-            if(m_esc_seq.length() == 1 && c != '[') {
-                m_esc_seq.clear();
-                line_start = line_end;
-                ++line_end;
-            } else if((*line_end).isLetter()) {
-                m_esc_seq.append(c);
-                handleEscSeq();
-                m_esc_seq.clear();
-                ++line_end;
-                line_start = line_end;
-            } else {
-                m_esc_seq.append(c);
-                ++line_end;
-            }
-            continue;
-        }
-
-        switch(c)
-        {
-            case '\f':
-            {
-                addLine(pos, line_start, line_end);
-
-                if(!m_settings.chars[SET_FORMFEED])
-                    break;
-
-                m_cursor_pos.setX(0);
-                m_cursor_pos.setY(0);
-                pos = 0;
-                break;
-            }
-            case '\r':
-            {
-                addLine(pos, line_start, line_end);
-                newlineChar(m_settings.chars[SET_RETURN], pos);
-                break;
-            }
-            case '\n':
-            {
-                addLine(pos, line_start, line_end);
-                newlineChar(m_settings.chars[SET_NEWLINE], pos);
-                break;
-            }
-            case '\b':
-            {
-                if(!m_settings.chars[SET_BACKSPACE])
-                {
-                    addLine(pos, line_start, line_end);
-                    break;
-                }
-
-                if(line_end != line_start)
-                {
-                    --line_end;
-
-                    addLine(pos, line_start, line_end);
-
-                    if(*line_start == '\b')
-                        ++line_end;
-                    line_start = line_end;
-                }
-                else
-                {
-                    std::vector<QString>::iterator linePos = m_lines.begin() + pos;
-                    if(linePos == m_lines.end())
-                        break;
+        m_screen.write(data, avail);
+        pos += avail;
+    }
+    m_parsed = pos;
+}
 
-                    if(m_cursor_pos.x() != 0)
-                        --m_cursor_pos.rx();
+QString Terminal::hexLine(quint64 offset) const
+{
+    static const char* hex = "0123456789ABCDEF";
 
-                    ++line_end;
-                    ++line_start;
+    char chunk[16];
+    char line[78];
 
-                    if((*linePos).size() == 1)
-                        m_lines.erase(linePos);
-                    else
-                        (*linePos).chop(1);
-                }
+    const quint64 end = hexEnd();
+    const int chunk_size = offset < end ? m_data.read(offset, chunk, std::min(end - offset, quint64(16))) : 0;
 
-                break;
-            }
-            case '\a':
-                if(m_settings.chars[SET_ALARM])
-                    Utils::playErrorSound();
-                break;
-            case '\t':
-            {
-                if(m_settings.chars[SET_REPLACE_TAB])
-                {
-                    addLine(pos, line_start, line_end);
-                    std::vector<QString>::iterator linePos = m_lines.begin() + pos;
-                    if(linePos != m_lines.end())
-                    {
-                        (*linePos).append(QByteArray(m_settings.tabReplace, ' '));
-                         m_cursor_pos.rx() += m_settings.tabReplace;
-                    }
-                }
-                else
-                    ++line_end;
-                break;
-            }
-            case 0:
-            {
-                if(!m_settings.chars[SET_IGNORE_NULL])
-                {
-                    i = text.size()+1;
-                    break;
-                }
-                else
-                {
-                    addLine(pos, line_start, line_end);
-
-                    std::vector<QString>::iterator linePos = m_lines.begin() + pos;
-                    if(linePos != m_lines.end())
-                        (*linePos).append('.');
-                    else
-                        m_lines.push_back(QString("."));
-                    break;
-                }
-            }
-            case '\e':
-            {
-                if(m_settings.chars[SET_HANDLE_ESCAPE]) {
-                    addLine(pos, line_start, line_end);
-                    m_esc_seq.append(c);
-                } else {
-                    ++line_end;
-                }
-                break;
-            }
-            default:
-            {
-                ++line_end;
-                break;
-            }
-        }
-    }
+    line[8] = line[57] = line[58] = line[59] = ' ';
+    line[60] = line[77] = '|';
 
-    if(line_start != line_end)
-        addLine(pos, line_start, line_end);
-}
+    char *itr = line;
+    for(int x = 7; x >= 0; --x, ++itr)
+        *itr = hex[(offset >> x*4) & 0x0F];
+    ++itr;
 
-void Terminal::addLine(quint32 pos, QChar *&line_start, QChar *&line_end)
-{
-    std::vector<QString>::iterator linePos = m_lines.begin() + pos;
-    if(linePos != m_lines.end())
+    for(int x = 0; x < chunk_size; ++x)
     {
-        if((line_end - line_start + m_cursor_pos.x()) > (*linePos).length())
-            (*linePos).resize(line_end - line_start + m_cursor_pos.x());
+        *(itr++) = hex[quint8(chunk[x]) >> 4];
+        *(itr++) = hex[quint8(chunk[x]) & 0x0F];
+        *(itr++) = ' ';
 
-        QChar *lineData = (*linePos).data()+m_cursor_pos.x();
-        std::copy(line_start, line_end, lineData);
-
-        m_cursor_pos.rx() += (line_end - line_start);
+        line[61+x] = (chunk[x] < 32 || chunk[x] > 126) ? '.' : chunk[x];
     }
-    else
-    {
-        QChar tmp = *line_end;
-        *line_end = 0;
-        m_lines.insert(linePos, QString(line_start));
-        *line_end = tmp;
 
-        m_cursor_pos.setX(m_lines[pos].length());
+    memset(itr, ' ', (16 - chunk_size)*3);
 
-        if(m_last_esc && !m_last_esc->isEmpty())
-            m_escapes[pos][0] = *m_last_esc;
-    }
-
-    m_cursor_pos.setY(pos);
+    if(chunk_size != 16)
+        *(line + chunk_size + 61) = '|';
 
-    ++line_end;
-    line_start = line_end;
+    return QString::fromLatin1(line, 62+chunk_size);
 }
 
-void Terminal::newlineChar(quint8 option, quint32& pos)
+quint64 Terminal::hexEnd() const
 {
-    switch(option)
-    {
-        case NL_NEWLINE_RETURN:
-            ++pos;
-            m_cursor_pos.setY(pos);
-            m_cursor_pos.setX(0);
-            break;
-        case NL_NEWLINE:
-        {
-            ++pos;
-            m_cursor_pos.setY(pos);
-
-            if(m_cursor_pos.x() == 0)
-                break;
-
-            std::vector<QString>::iterator linePos = m_lines.begin() + pos;
-            if(linePos != m_lines.end() && m_cursor_pos.x() > (*linePos).size())
-                (*linePos).append(QByteArray(m_cursor_pos.x() - (*linePos).size(), ' '));
-            else
-                m_lines.push_back(QString(m_cursor_pos.x(), ' '));
-            break;
-        }
-        case NL_RETURN:
-            m_cursor_pos.setX(0);
-            break;
-        case NL_NOTHING:
-            break;
-    }
+    return m_paused ? std::min(m_pause_hex_end, m_data.end()) : m_data.end();
 }
 
-void Terminal::addHex()
+int Terminal::lineCount()
 {
-    if(m_hex_pos%16 != 0)
-    {
-        m_hex_pos -= m_hex_pos%16;
-        m_lines.pop_back();
-    }
-
-    std::vector<char>::iterator chunk;
-
-    int chunk_size;
-    char *itr;
-    char line[78];
-
-    line[8] = line[57] = line[58] = line[59] = ' ';
-    line[60] = line[77] = '|';
-
-    for(quint32 i = m_hex_pos; i < m_data.size(); i += 16)
-    {
-        itr = line;
-        chunk = m_data.begin()+m_hex_pos;
-        chunk_size = std::min(int(m_data.end() - chunk), 16);
+    if(m_fmt != FMT_HEX)
+        return m_screen.endLine() - m_view_first;
 
-        static const char* hex = "0123456789ABCDEF";
-        for(int x = 7; x >= 0; --x, ++itr)
-            *itr = hex[(m_hex_pos >> x*4) & 0x0F];
-        ++itr;
-
-        m_hex_pos += chunk_size;
-
-        for(int x = 0; x < chunk_size; ++x)
-        {
-            *(itr++) = hex[quint8(chunk[x]) >> 4];
-            *(itr++) = hex[quint8(chunk[x]) & 0x0F];
-            *(itr++) = ' ';
+    // m_data.begin() is always a multiple of 16
+    return (std::max(hexEnd(), m_view_hex) - m_view_hex + 15)/16;
+}
 
-            line[61+x] = (chunk[x] < 32 || chunk[x] > 126) ? '.' : chunk[x];
-        }
+QString Terminal::lineText(int idx)
+{
+    if(m_fmt != FMT_HEX)
+        return m_screen.lineText(m_view_first + idx);
+    return hexLine(m_view_hex + quint64(idx)*16);
+}
 
-        memset(itr, ' ', (16 - chunk_size)*3);
+QPoint Terminal::cursorPos()
+{
+    if(m_fmt == FMT_HEX)
+        return QPoint(0, lineCount());
 
-        if(chunk_size != 16)
-            *(line + chunk_size + 61) = '|';
+    quint64 line;
+    int col;
+    m_screen.cursor(line, col);
+    return QPoint(col, line - m_view_first);
+}
 
-        m_lines.push_back(QString::fromLatin1(line, 62+chunk_size));
-    }
-    m_cursor_pos.setY(m_lines.size());
-    m_cursor_pos.setX(0);
+void Terminal::applyLimits()
+{
+    m_data.setLimit(quint64(m_settings.dataLimit)*1024*1024);
+    m_screen.setScrollback(m_settings.scrollback);
 }
 
 void Terminal::inputMethodEvent(QInputMethodEvent *e) {
@@ -505,16 +320,16 @@ void Terminal::copyToClipboard()
     int stop;
     for(quint32 i = m_sel_start.y(); i <= (quint32)m_sel_stop.y(); ++i)
     {
-        if(i >= lines().size())
+        if(i >= (quint32)lineCount())
             break;
 
+        line = lineText(i);
         if(i == (quint32)m_sel_stop.y())
             stop = m_sel_stop.x() - m_sel_start.x();
         else
-            stop = lines()[i].length();
+            stop = line.length();
 
-        text += lines()[i].mid(start, stop);
-        line = lines()[i].mid(start, stop);
+        text += line.mid(start, stop);
 
         if(i != (quint32)m_sel_stop.y())
             text += "\r\n";
@@ -529,8 +344,8 @@ void Terminal::copyToClipboard()
 void Terminal::selectAll()
 {
     m_sel_begin = m_sel_start = QPoint(0, 0);
-    m_sel_stop.setY(lines().size()-1);
-    m_sel_stop.setX(lines()[m_sel_stop.y()].length());
+    m_sel_stop.setY(lineCount()-1);
+    m_sel_stop.setX(m_sel_stop.y() >= 0 ? lineText(m_sel_stop.y()).length() : 0);
 
     viewport()->update();
 }
@@ -540,8 +355,18 @@ void Terminal::pasteFromClipboard()
     handleInput(QApplication::clipboard()->text());
 }
 
+void Terminal::refresh()
+{
+    m_changed = m_full_update = true;
+    updateScrollBars();
+}
+
 void Terminal::updateScrollBars()
 {
+    parsePending();
+    if(m_screen.takeBell())
+        Utils::playErrorSound();
+
     if(!m_changed)
         return;
 
@@ -550,28 +375,66 @@ void Terminal::updateScrollBars()
     verticalScrollBar()->setPageStep(areaSize.height());
     horizontalScrollBar()->setPageStep(areaSize.width());
 
-    bool scroll = (verticalScrollBar()->value() == verticalScrollBar()->maximum());
+    const int oldValue = verticalScrollBar()->value();
+    bool scroll = (oldValue == verticalScrollBar()->maximum());
 
-    int height = lines().size();
-    int width = 0;
+    // Keep the same lines in view when old ones were dropped
+    const quint64 first = m_screen.firstLine();
+    const quint64 dropped = (m_fmt != FMT_HEX) ? first - m_view_first : (m_data.begin() - m_view_hex)/16;
+    const int evicted = int(std::min(dropped, quint64(INT_MAX)));
+    m_view_first = first;
+    m_view_hex = m_data.begin();
 
-    for(std::size_t i = 0; i < lines().size(); ++i)
+    if(evicted != 0)
     {
-        if(width < lines()[i].length())
-            width = lines()[i].length();
+        if(m_sel_stop.y() < evicted)
+            m_sel_start = m_sel_stop = m_sel_begin = QPoint();
+        else
+        {
+            m_sel_stop.ry() -= evicted;
+            m_sel_start.ry() = std::max(0, m_sel_start.y() - evicted);
+            m_sel_begin.ry() = std::max(0, m_sel_begin.y() - evicted);
+        }
     }
 
+    int height = lineCount();
+    int width = (m_fmt == FMT_HEX) ? 78 : m_screen.maxWidth();
+
     verticalScrollBar()->setRange(0, height - areaSize.height()/m_char_height + 1);
     horizontalScrollBar()->setRange(0, width - areaSize.width()/m_char_width + 1);
 
     if(scroll)
         verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+    else
+        verticalScrollBar()->setValue(oldValue - evicted);
 
-    update();
-    viewport()->update();
+    quint64 from, to;
+    const bool dirty = m_screen.takeDirty(from, to);
+
+    if(m_full_update || m_fmt == FMT_HEX || verticalScrollBar()->value() != oldValue)
+    {
+        m_full_update = false;
+        update();
+        viewport()->update();
+        return;
+    }
+
+    // Nothing has moved, repaint only the rows written to and both cursors
+    const int startY = verticalScrollBar()->value();
+    viewport()->update(m_cursor);
+    viewport()->update(0, (cursorPos().y() - startY)*m_char_height, areaSize.width(), m_char_height);
+
+    if(dirty)
+    {
+        const qint64 rows = areaSize.height()/m_char_height + 1;
+        const qint64 top = std::max(qint64(0), qint64(from - m_view_first) - startY);
+        const qint64 bottom = std::min(rows, qint64(to - m_view_first) - startY);
+        if(top < bottom)
+            viewport()->update(0, top*m_char_height, areaSize.width(), (bottom - top)*m_char_height);
+    }
 }
 
-void Terminal::paintEvent(QPaintEvent *)
+void Terminal::paintEvent(QPaintEvent *e)
 {
     QPainter painter(viewport());
 
@@ -584,7 +447,7 @@ void Terminal::paintEvent(QPaintEvent *)
     int y = 0;
     int x = 0;
 
-    QPoint& cursor = m_paused ? m_cursor_pause_pos : m_cursor_pos;
+    const QPoint cursor = cursorPos();
 
     // Draw cursor
     if(cursor.x() >= startX && (cursor.x() - startX) < width &&
@@ -606,113 +469,110 @@ void Terminal::paintEvent(QPaintEvent *)
     const bool drawSelection = m_sel_start != m_sel_stop && !m_sel_stop.isNull();
     if(drawSelection)
     {
-        quint32 textLine = m_sel_start.y();
-        quint32 max = m_sel_stop.y() - m_sel_start.y();
-
-        x = (m_sel_start.x() - startX)*m_char_width;
-        y = (m_sel_start.y() - startY)*m_char_height;
-
-        int w = m_char_width;
-
-        if(m_sel_stop.y() == m_sel_start.y())
-            w *= m_sel_stop.x() - m_sel_start.x();
-        else
-            w *= width - (m_sel_start.x() - startX);
+        const quint32 max = m_sel_stop.y() - m_sel_start.y();
 
         painter.setPen(Qt::NoPen);
         painter.setBrush(this->palette().color(QPalette::Highlight));
 
-        for(quint32 i = 0; i <= max; ++i,++textLine)
+        // Only the visible rows of selection are formatted
+        const int firstSel = std::max(m_sel_start.y(), startY);
+        const int lastSel = std::min(std::min(m_sel_stop.y(), startY + height), lineCount() - 1);
+        for(int textLine = firstSel; textLine <= lastSel; ++textLine)
         {
-            if(textLine >= lines().size())
-                continue;
+            const quint32 i = textLine - m_sel_start.y();
+
+            int w = 0;
+            x = 0;
+            if(i == 0)
+            {
+                x = (m_sel_start.x() - startX)*m_char_width;
+                if(max == 0)
+                    w = m_char_width*(m_sel_stop.x() - m_sel_start.x());
+                else
+                    w = m_char_width*(width - (m_sel_start.x() - startX));
+            }
 
-            int len = (lines()[textLine].length() - startX)*m_char_width;
+            int len = (lineText(textLine).length() - startX)*m_char_width;
             adjustSelectionWidth(w, i, max, len);
 
-            QRect rec(x, y, w, m_char_height);
+            QRect rec(x, (textLine - startY)*m_char_height, w, m_char_height);
             painter.drawRect(rec);
-
-            x = 0;
-            y += m_char_height;
         }
         painter.setBrush(Qt::NoBrush);
     }
 
-    // draw text
-    std::size_t i = startY;
-    int maxLines = i + height + 1;
-    int maxLen = viewport()->width()/m_char_width + 1;
+    // draw text, only rows which need repainting are formatted
+    const int firstRow = e->rect().top()/m_char_height;
+    const int lastRow = std::min(height, e->rect().bottom()/m_char_height);
+    const int maxLen = viewport()->width()/m_char_width + 1;
+    const int count = lineCount();
+    const bool hex = (m_fmt == FMT_HEX);
 
     painter.setPen(QPen(m_settings.colors[COLOR_TEXT]));
 
-    bool colorChanged = false;
-    bool fontChanged = false;
-
-    for(y = 0; (int)i < maxLines && i < lines().size(); ++i, y += m_char_height)
+    for(int row = firstRow; row <= lastRow && startY + row < count; ++row)
     {
-        QString& l = lines()[i];
+        const int i = startY + row;
+        y = row*m_char_height;
 
-        int len = std::min(l.length() - startX, maxLen);
+        const QString l = lineText(i);
+        const int len = std::min(l.length() - startX, maxLen);
         if(len <= 0)
             continue;
 
-        const auto ei = m_escapes.find(i);
-        if(ei != m_escapes.end()) {
-            const auto blks = ei->second;
-            int curX = startX;
-            for(auto itr = blks.begin(); itr != blks.end();) {
-                const auto cur = itr++;
-                if(itr != blks.end() && itr->first < curX)
-                    continue;
-
-                int end = std::min(l.length(), maxLen);
-                if(itr != blks.end() && itr->first < end)
-                    end = itr->first;
-
-                if(cur->second.color.isValid()) {
-                    painter.setPen(cur->second.color);
-                    colorChanged = true;
-                } else if(colorChanged) {
-                    painter.setPen(m_settings.colors[COLOR_TEXT]);
-                    colorChanged = false;
-                }
-
-                if(!drawSelection && cur->second.background.isValid()) {
-                    painter.save();
-
-                    painter.setBrush(QBrush(cur->second.background));
-                    painter.setPen(Qt::NoPen);
-
-                    QRectF bgrect((curX - startX)*m_char_width, y, (end - curX)*m_char_width, m_char_height);
-                    painter.drawRect(bgrect);
-
-                    painter.restore();
-                }
-
-                if(cur->second.flags & ESC_BOLD) {
-                    fontChanged = true;
-                    QFont f = painter.font();
-                    f.setBold(true);
-                    painter.setFont(f);
-                } else if(fontChanged) {
-                    QFont f = painter.font();
-                    f.setBold(false);
-                    painter.setFont(f);
-                }
-
-                painter.drawText((curX - startX)*m_char_width, y, viewport()->width(), m_char_height, 0,
-                             QString::fromRawData(l.data()+curX, end - curX));
-
-                curX = end;
+        if(!hex)
+            m_screen.lineRuns(m_view_first + i, m_runs);
+
+        if(hex || m_runs.empty())
+        {
+            drawRun(painter, 0, y, QString::fromRawData(l.data()+startX, len), term_attr(), false);
+            continue;
+        }
+
+        // Parts of the line between attribute runs
+        const int endX = startX + len;
+        int col = 0;
+        quint16 attr = 0;
+        for(size_t r = 0; r <= m_runs.size() && col < endX; ++r)
+        {
+            const int next = (r < m_runs.size()) ? std::min(m_runs[r].col, endX) : endX;
+            const int from = std::max(col, startX);
+            if(from < next)
+            {
+                drawRun(painter, (from - startX)*m_char_width, y,
+                        QString::fromRawData(l.data()+from, next - from),
+                        m_screen.attr(attr), !drawSelection);
+            }
+
+            if(r < m_runs.size())
+            {
+                col = m_runs[r].col;
+                attr = m_runs[r].attr;
             }
-        } else {
-            painter.drawText(0, y, viewport()->width(), m_char_height, 0,
-                         QString::fromRawData(l.data()+startX, len));
         }
     }
 }
 
+void Terminal::drawRun(QPainter& painter, int x, int y, const QString& text, const term_attr& attr, bool background)
+{
+    if(background && attr.background.isValid())
+        painter.fillRect(x, y, text.length()*m_char_width, m_char_height, attr.background);
+
+    const QColor& color = attr.color.isValid() ? attr.color : m_settings.colors[COLOR_TEXT];
+    if(painter.pen().color() != color)
+        painter.setPen(color);
+
+    const bool bold = (attr.flags & ATTR_BOLD);
+    if(painter.font().bold() != bold)
+    {
+        QFont f = painter.font();
+        f.setBold(bold);
+        painter.setFont(f);
+    }
+
+    painter.drawText(x, y, viewport()->width(), m_char_height, 0, text);
+}
+
 void Terminal::adjustSelectionWidth(int &w, quint32 i, quint32 max, int len)
 {
     int startX = horizontalScrollBar()->value();
@@ -732,15 +592,12 @@ void Terminal::pause(bool pause)
     m_pauseAct->setChecked(pause);
 
     if(pause)
-    {
-        m_pause_lines = m_lines;
-        m_cursor_pause_pos = m_cursor_pos;
-    }
-    else
-        m_pause_lines.clear();
+        m_pause_hex_end = m_data.end();
 
-    m_changed = true;
-    updateScrollBars();
+    parsePending();
+    m_screen.freeze(pause);
+
+    refresh();
 
     emit paused(pause);
 }
@@ -748,24 +605,23 @@ void Terminal::pause(bool pause)
 void Terminal::clear()
 {
     m_data.clear();
-    m_data.reserve(512);
+    m_screen.clear();
 
-    m_last_esc = NULL;
-    m_esc_seq.clear();
-    m_escapes.clear();
-    m_lines.clear();
-    m_pause_lines.clear();
-    m_cursor_pos = m_cursor_pause_pos = QPoint(0, 0);
-    m_hex_pos = 0;
+    m_parsed = 0;
+    m_view_first = 0;
+    m_view_hex = 0;
+    m_pause_hex_end = 0;
 
-    m_changed = true;
-    updateScrollBars();
+    refresh();
 }
 
 void Terminal::resizeEvent(QResizeEvent *)
 {
-    m_changed = true;
-    updateScrollBars();
+    // \f and cursor escape sequences move within the visible rows
+    if(viewport()->height() >= m_char_height)
+        m_screen.setHeight(viewport()->height()/m_char_height);
+
+    refresh();
 }
 
 void Terminal::mousePressEvent(QMouseEvent *event)
@@ -854,16 +710,22 @@ void Terminal::setFmt(int fmt)
         m_fmt_act[i]->setChecked(i == fmt);
 
     m_fmt = fmt;
-    redrawAll();
+    m_sel_start = m_sel_stop = m_sel_begin = QPoint();
+
+    refresh();
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
 
     emit fmtSelected(fmt);
 }
 
 void Terminal::writeToFile(QFile *file)
 {
-    for(quint32 i = 0; i < lines().size(); ++i)
+    parsePending();
+
+    const int count = lineCount();
+    for(int i = 0; i < count; ++i)
     {
-        file->write(lines()[i].toUtf8());
+        file->write(lineText(i).toUtf8());
         file->write("\n");
     }
 }
@@ -891,6 +753,7 @@ QString Terminal::getSettingsData()
 
     res += "|" + QString::number(m_fmt);
     res += "|" + QString::number(m_input);
+    res += QString("|%1;%2;").arg(m_settings.scrollback).arg(m_settings.dataLimit);
     return res;
 }
 
@@ -927,6 +790,17 @@ void Terminal::loadSettings(const QString& data)
 
     if(lst.size() >= 6)
         setInput(lst[5].toUInt());
+
+    if(lst.size() >= 7)
+    {
+        QStringList limits = lst[6].split(';', QString::SkipEmptyParts);
+        if(limits.size() >= 2)
+        {
+            m_settings.scrollback = limits[0].toUInt();
+            m_settings.dataLimit = limits[1].toUInt();
+            applyLimits();
+        }
+    }
 }
 
 void Terminal::setFont(const QFont &f)
@@ -938,9 +812,11 @@ void Terminal::setFont(const QFont &f)
 
     m_cursor.setSize(QSize(m_char_width, m_char_height));
 
-    m_changed = true;
+    if(viewport()->height() >= m_char_height)
+        m_screen.setHeight(viewport()->height()/m_char_height);
+
     m_settings.font = f;
-    updateScrollBars();
+    refresh();
 }
 
 void Terminal::showSettings()
@@ -954,6 +830,10 @@ void Terminal::showSettings()
 
 void Terminal::applySettings(const terminal_settings& set)
 {
+    // Only handling of control characters changes the text lines
+    const bool reparse = set.tabReplace != m_settings.tabReplace ||
+            memcmp(set.chars, m_settings.chars, sizeof(set.chars)) != 0;
+
     m_settings.copy(set);
     setFont(set.font);
 
@@ -962,31 +842,25 @@ void Terminal::applySettings(const terminal_settings& set)
     p.setColor(QPalette::Text, m_settings.colors[COLOR_TEXT]);
     setPalette(p);
 
-    redrawAll();
+    applyLimits();
+    if(reparse)
+        redrawAll();
 
     emit settingsChanged();
 }
 
 void Terminal::redrawAll()
 {
-    m_lines.clear();
-    m_escapes.clear();
-    m_last_esc = NULL;
-    m_esc_seq.clear();
-    m_hex_pos = 0;
-    m_cursor_pos = m_cursor_pause_pos = QPoint(0, 0);
-
     bool paused = m_paused;
     pause(false);
 
-    switch(m_fmt)
-    {
-        case FMT_TEXT: addLines(QString::fromUtf8(m_data.data(), m_data.size())); break;
-        case FMT_HEX:  addHex();         break;
-    }
+    m_screen.clear();
+    m_view_first = 0;
+    m_parsed = m_data.begin();
+    parsePending();
+    m_screen.takeBell();
 
-    m_changed = true;
-    updateScrollBars();
+    refresh();
     pause(paused);
 }
 
@@ -1037,101 +911,3 @@ void Terminal::endBlink()
 
     update();
 }
-
-void Terminal::handleEscSeq()
-{
-    EscBlock blk;
-    if(m_last_esc)
-        blk = *m_last_esc;
-
-    if(m_esc_seq[m_esc_seq.size()-1] != 'm')
-        return;
-
-    QString cnt = m_esc_seq.mid(2, m_esc_seq.size()-3);
-    QStringList parts = cnt.split(';');
-    bool ok = false;
-    for(int i = 0; i < parts.length(); ++i) {
-        int code = parts[i].toInt(&ok);
-        if(!ok)
-            continue;
-
-        switch(code) {
-        case 0:
-            blk = EscBlock();
-            break;
-        case 1:
-            blk.flags = EscFlags(blk.flags | ESC_BOLD);
-            break;
-        case 21:
-            blk.flags = EscFlags(blk.flags & ~ESC_BOLD);
-            break;
-        case 39:
-            blk.color = QColor();
-            break;
-        case 49:
-            blk.background = QColor();
-            break;
-
-        case 30: blk.color = Qt::black; break;
-        case 31: blk.color = Qt::darkRed; break;
-        case 32: blk.color = Qt::darkGreen; break;
-        case 33: blk.color = Qt::darkYellow; break;
-        case 34: blk.color = Qt::darkBlue; break;
-        case 35: blk.color = Qt::darkMagenta; break;
-        case 36: blk.color = Qt::darkCyan; break;
-        case 37: blk.color = Qt::lightGray; break;
-        case 90: blk.color = Qt::darkGray; break;
-        case 91: blk.color = Qt::red; break;
-        case 92: blk.color = Qt::green; break;
-        case 93: blk.color = Qt::yellow; break;
-        case 94: blk.color = Qt::blue; break;
-        case 95: blk.color = Qt::magenta; break;
-        case 96: blk.color = Qt::cyan; break;
-        case 97: blk.color = Qt::white; break;
-
-        case 40:  blk.background = Qt::black; break;
-        case 41:  blk.background = Qt::darkRed; break;
-        case 42:  blk.background = Qt::darkGreen; break;
-        case 43:  blk.background = Qt::darkYellow; break;
-        case 44:  blk.background = Qt::darkBlue; break;
-        case 45:  blk.background = Qt::darkMagenta; break;
-        case 46:  blk.background = Qt::darkCyan; break;
-        case 47:  blk.background = Qt::lightGray; break;
-        case 100: blk.background = Qt::darkGray; break;
-        case 101: blk.background = Qt::red; break;
-        case 102: blk.background = Qt::green; break;
-        case 103: blk.background = Qt::yellow; break;
-        case 104: blk.background = Qt::blue; break;
-        case 105: blk.background = Qt::magenta; break;
-        case 106: blk.background = Qt::cyan; break;
-        case 107: blk.background = Qt::white; break;
-
-        case 38:
-        case 48: {
-            if(i+2 >= parts.length())
-                break;
-
-            i += 2;
-            if(parts[i-1] != "5")
-                break;
-
-            uint clridx = parts[i].toUInt(&ok);
-            if(!ok || clridx >= sizeof_array(term256colors))
-                break;
-            if(code == 38)
-                blk.color = term256colors[clridx];
-            else
-                blk.background = term256colors[clridx];
-            break;
-        }
-        }
-    }
-
-    if(!blk.isEmpty() || m_last_esc) {
-        m_escapes[m_cursor_pos.y()][m_cursor_pos.x()] = blk;
-        if(!blk.isEmpty())
-            m_last_esc = &m_escapes[m_cursor_pos.y()][m_cursor_pos.x()];
-        else
-            m_last_esc = NULL;
-    }
-}
@@ -14,12 +14,14 @@
 #include <QPoint>
 #include <QTime>
 #include <QTimer>
-#include <unordered_map>
-#include <map>
+
+#include "terminaldata.h"
+#include "terminalscreen.h"
 
 class QMenu;
 class QByteArray;
 class QFile;
+class QPainter;
 struct terminal_settings;
 
 enum settings
@@ -93,6 +95,8 @@ struct terminal_settings
         chars[SET_ENTER_SEND] = NLS_RN;
         chars[SET_HANDLE_ESCAPE] = 1;
         tabReplace = 4;
+        scrollback = 100000;
+        dataLimit = 64;
 
         colors[COLOR_BG] = Qt::black;
         colors[COLOR_TEXT] = Qt::white;
@@ -108,11 +112,15 @@ struct terminal_settings
             colors[i] = set.colors[i];
 
         tabReplace = set.tabReplace;
+        scrollback = set.scrollback;
+        dataLimit = set.dataLimit;
         font = set.font;
     }
 
     quint8 chars[SET_MAX];
     quint8 tabReplace;
+    quint32 scrollback; // lines, 0 means unlimited
+    quint32 dataLimit; // received bytes kept, in MB, 0 means unlimited
     QColor colors[COLOR_MAX];
     QFont font;
 };
@@ -133,10 +141,14 @@ public:
 
     void writeToFile(QFile *file);
 
+    // Only the bytes within data limit are kept, see terminal_settings
     QByteArray getData()
     {
-        return QByteArray(m_data.data(), m_data.size());
+        return m_data.toByteArray();
     }
+    // True if older bytes were dropped because of data limit
+    bool isDataTrimmed() const { return m_data.begin() != 0; }
+    quint32 getDataLimit() const { return m_settings.dataLimit; }
 
     int getFmt() { return m_fmt; }
     int getInput() { return m_input; }
@@ -183,55 +195,43 @@ private slots:
 
 private:
     void handleInput(const QString &data, int key = 0);
-    void addLine(quint32 pos, QChar *&line_start, QChar *&line_end);
-    void newlineChar(quint8 option, quint32& pos);
-    void addLines(const QString& text);
-    void addHex();
+    void parsePending();
     void redrawAll();
+    void refresh();
+    void applyLimits();
+
+    // Lines of current format, hex rows are formatted from m_data on demand
+    int lineCount();
+    QString lineText(int idx);
+    QPoint cursorPos();
+    QString hexLine(quint64 offset) const;
+    quint64 hexEnd() const;
     QPoint mouseToTextPos(const QPoint& pos);
     QString getCurrNewlineStr(Qt::KeyboardModifiers modifiers);
-    void handleEscSeq();
+    void drawRun(QPainter& painter, int x, int y, const QString& text, const term_attr& attr, bool background);
 
     inline void adjustSelectionWidth(int &w, quint32 i, quint32 max, int len);
 
-    inline std::vector<QString>& lines()
-    {
-        return m_paused ? m_pause_lines : m_lines;
-    }
-
-    enum EscFlags {
-        ESC_BOLD      = 0x01,
-    };
-
-    struct EscBlock {
-        EscFlags flags;
-        QColor color;
-        QColor background;
-
-        bool isEmpty() const {
-            return !color.isValid() && !background.isValid() && flags == 0;
-        }
-    };
-
-    std::vector<QString> m_lines;
-    std::vector<QString> m_pause_lines;
-    std::vector<char> m_data;
-    std::unordered_map<int, std::map<int, EscBlock> > m_escapes;
-    QString m_esc_seq;
-    EscBlock *m_last_esc;
+    TerminalData m_data;
+    TerminalScreen m_screen;
+    quint64 m_parsed; // m_data offset up to which m_screen is up to date
+    // Screen line shown as row 0. It follows m_screen.firstLine() only
+    // in updateScrollBars(), so that view and selection move together.
+    quint64 m_view_first;
+    // m_data offset shown as hex row 0, follows m_data.begin() the same way
+    quint64 m_view_hex;
+    std::vector<term_run> m_runs;
 
     QString m_command;
 
     bool m_paused;
     quint8 m_fmt;
     quint8 m_input;
-    int m_hex_pos;
+    quint64 m_pause_hex_end;
 
     int m_char_height;
     int m_char_width;
 
-    QPoint m_cursor_pos;
-    QPoint m_cursor_pause_pos;
     QRect m_cursor;
 
     QPoint m_sel_start;
@@ -245,6 +245,7 @@ private:
     QTimer m_updateTimer;
 
     bool m_changed;
+    bool m_full_update; // otherwise only lines written to are repainted
 
     terminal_settings m_settings;
 };
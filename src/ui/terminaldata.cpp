@@ -0,0 +1,109 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "terminaldata.h"
+
+TerminalData::TerminalData()
+{
+    m_chunks_begin = 0;
+    m_begin = 0;
+    m_end = 0;
+    m_limit = 0;
+}
+
+TerminalData::~TerminalData()
+{
+    clear();
+}
+
+void TerminalData::clear()
+{
+    for(size_t i = 0; i < m_chunks.size(); ++i)
+        delete[] m_chunks[i];
+    m_chunks.clear();
+
+    m_chunks_begin = m_begin = m_end = 0;
+}
+
+void TerminalData::append(const char *data, quint32 len)
+{
+    while(len != 0)
+    {
+        if(m_end - m_chunks_begin == m_chunks.size()*quint64(CHUNK_SIZE))
+            m_chunks.push_back(new char[CHUNK_SIZE]);
+
+        const quint32 used = (m_end - m_chunks_begin) % CHUNK_SIZE;
+        const quint32 n = (std::min)(len, CHUNK_SIZE - used);
+        memcpy(m_chunks.back() + used, data, n);
+
+        data += n;
+        len -= n;
+        m_end += n;
+    }
+
+    while(m_limit != 0 && size() > m_limit && m_chunks.size() > 1)
+        dropFront();
+}
+
+void TerminalData::setLimit(quint64 bytes)
+{
+    m_limit = bytes;
+    while(m_limit != 0 && size() > m_limit && m_chunks.size() > 1)
+        dropFront();
+}
+
+void TerminalData::dropFront()
+{
+    delete[] m_chunks.front();
+    m_chunks.pop_front();
+
+    m_chunks_begin += CHUNK_SIZE;
+    m_begin = m_chunks_begin;
+}
+
+const char *TerminalData::at(quint64 pos, quint32& avail) const
+{
+    if(pos < m_begin || pos >= m_end)
+    {
+        avail = 0;
+        return NULL;
+    }
+
+    const quint64 rel = pos - m_chunks_begin;
+    const quint32 off = rel % CHUNK_SIZE;
+    avail = (std::min)(quint64(CHUNK_SIZE - off), m_end - pos);
+    return m_chunks[rel / CHUNK_SIZE] + off;
+}
+
+quint32 TerminalData::read(quint64 pos, char *out, quint32 len) const
+{
+    quint32 res = 0;
+    quint32 avail = 0;
+    while(res < len)
+    {
+        const char *src = at(pos, avail);
+        if(!src)
+            break;
+
+        const quint32 n = (std::min)(avail, len - res);
+        memcpy(out + res, src, n);
+        res += n;
+        pos += n;
+    }
+    return res;
+}
+
+QByteArray TerminalData::toByteArray() const
+{
+    QByteArray res;
+    res.resize(size());
+    read(m_begin, res.data(), res.size());
+    return res;
+}
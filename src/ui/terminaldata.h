@@ -0,0 +1,61 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef TERMINALDATA_H
+#define TERMINALDATA_H
+
+#include <deque>
+#include <QByteArray>
+
+// Bytes received by Terminal. They are stored in chunks of CHUNK_SIZE
+// bytes, when the limit is exceeded the oldest chunk is freed as a whole,
+// so nothing is ever moved or copied. Offsets are absolute, offset of
+// a byte stays the same after older bytes are dropped.
+class TerminalData
+{
+public:
+    enum { CHUNK_SIZE = 64*1024 };
+
+    TerminalData();
+    ~TerminalData();
+
+    void clear();
+    void append(const char *data, quint32 len);
+
+    // Offset of the oldest kept byte and of the next one to be appended
+    quint64 begin() const { return m_begin; }
+    quint64 end() const { return m_end; }
+    quint64 size() const { return m_end - m_begin; }
+    bool empty() const { return m_begin == m_end; }
+
+    // 0 means no limit. At least the last chunk is always kept.
+    quint64 getLimit() const { return m_limit; }
+    void setLimit(quint64 bytes);
+
+    // Returns pointer to byte at pos and number of bytes which follow it
+    // in the same chunk, NULL if pos is not kept
+    const char *at(quint64 pos, quint32& avail) const;
+
+    // Copies up to len bytes from pos, returns number of copied bytes
+    quint32 read(quint64 pos, char *out, quint32 len) const;
+
+    QByteArray toByteArray() const;
+
+private:
+    TerminalData(const TerminalData&);
+    TerminalData& operator=(const TerminalData&);
+
+    void dropFront();
+
+    std::deque<char*> m_chunks;
+    quint64 m_chunks_begin; // offset of m_chunks.front()
+    quint64 m_begin;
+    quint64 m_end;
+    quint64 m_limit;
+};
+
+#endif // TERMINALDATA_H
@@ -0,0 +1,768 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define TERMINAL_SSE2
+  #include <emmintrin.h>
+#endif
+
+#include "../common.h"
+#include "terminalscreen.h"
+#include "terminal.h"
+#include "termina-colors.h"
+
+// Bit for each of \0 \a \b \t \n \f \r \e
+#define CONTROL_CHARS 0x08003781
+
+static inline bool isControl(quint8 c)
+{
+    return c < 32 && ((CONTROL_CHARS >> c) & 1);
+}
+
+// Returns offset of the first control byte, len if there is none.
+// Other bytes below 32 are rare, so 16 bytes are skipped at once
+// unless there is any byte below 32 among them.
+static int findControl(const char *data, int len)
+{
+    int i = 0;
+#ifdef TERMINAL_SSE2
+    const __m128i max = _mm_set1_epi8(31);
+    for(; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, max), v)) == 0)
+            continue;
+
+        for(int x = 0; x < 16; ++x)
+            if(isControl(data[i+x]))
+                return i+x;
+    }
+#endif
+    for(; i < len; ++i)
+        if(isControl(data[i]))
+            return i;
+    return len;
+}
+
+TerminalScreen::TerminalScreen(const terminal_settings *settings)
+{
+    m_settings = settings;
+    m_scrollback = 0;
+    m_height = DEFAULT_HEIGHT;
+    m_frozen = false;
+
+    clear();
+}
+
+void TerminalScreen::clear()
+{
+    m_blocks.clear();
+    m_blocks_begin = m_sb_first = m_sb_end = 0;
+
+    m_rows.clear();
+    m_cur_x = m_cur_y = 0;
+
+    m_attrs.assign(1, term_attr());
+    m_cur_attr = 0;
+
+    m_esc_state = ESC_NONE;
+    m_esc_count = 0;
+    m_utf8_need = 0;
+
+    // Frozen view shows the empty screen
+    m_frozen_rows.clear();
+    m_frozen_sb_end = m_frozen_cur_line = 0;
+    m_frozen_cur_x = 0;
+
+    m_dirty_from = m_dirty_to = 0;
+    m_bell = false;
+    m_max_width = 0;
+}
+
+void TerminalScreen::setScrollback(quint32 lines)
+{
+    m_scrollback = lines;
+    trimScrollback();
+}
+
+void TerminalScreen::trimScrollback()
+{
+    if(m_scrollback != 0 && m_sb_end - m_sb_first > m_scrollback)
+        m_sb_first = m_sb_end - m_scrollback;
+
+    // Block is freed only when none of its lines is kept
+    while(m_sb_first - m_blocks_begin >= BLOCK_LINES)
+    {
+        m_blocks.pop_front();
+        m_blocks_begin += BLOCK_LINES;
+    }
+}
+
+void TerminalScreen::setHeight(int rows)
+{
+    m_height = std::max(1, rows);
+
+    while((int)m_rows.size() > m_height)
+        scrollUp();
+    m_cur_y = std::min(m_cur_y, m_height - 1);
+}
+
+void TerminalScreen::write(const char *data, int len)
+{
+    const char *end = data + len;
+    while(data != end)
+    {
+        // Escape sequences are ASCII, other bytes are eaten as well
+        if(m_esc_state != ESC_NONE)
+        {
+            const quint8 c = *data;
+            if(escape(QChar(ushort(c < 0x80 ? c : 0))))
+            {
+                ++data;
+                continue;
+            }
+        }
+
+        const int n = findControl(data, end - data);
+        if(n != 0)
+        {
+            putUtf8(data, n);
+            data += n;
+        }
+
+        if(data != end)
+        {
+            flushUtf8();
+            control(quint8(*data++));
+        }
+    }
+}
+
+void TerminalScreen::putUtf8(const char *data, int len)
+{
+    // Sequence left from previous call can add one character
+    if(m_decoded.size() < size_t(len) + 1)
+        m_decoded.resize(len + 1);
+
+    QChar *out = &m_decoded[0];
+    int i = 0;
+    while(i < len)
+    {
+#ifdef TERMINAL_SSE2
+        // Widen 16 ASCII characters at once
+        if(m_utf8_need == 0 && i + 16 <= len)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            if(_mm_movemask_epi8(v) == 0)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(v, zero));
+                out += 16;
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        const quint8 b = data[i++];
+        if(m_utf8_need != 0)
+        {
+            if((b & 0xC0) == 0x80)
+            {
+                m_utf8_cp = (m_utf8_cp << 6) | (b & 0x3F);
+                if(--m_utf8_need == 0)
+                    out = putCodePoint(out, m_utf8_cp);
+                continue;
+            }
+
+            // Sequence was cut short
+            *(out++) = QChar(ushort(0xFFFD));
+            m_utf8_need = 0;
+        }
+
+        if(b < 0x80)
+            *(out++) = QChar(ushort(b));
+        else if((b & 0xE0) == 0xC0)
+        {
+            m_utf8_cp = b & 0x1F;
+            m_utf8_min = 0x80;
+            m_utf8_need = 1;
+        }
+        else if((b & 0xF0) == 0xE0)
+        {
+            m_utf8_cp = b & 0x0F;
+            m_utf8_min = 0x800;
+            m_utf8_need = 2;
+        }
+        else if((b & 0xF8) == 0xF0)
+        {
+            m_utf8_cp = b & 0x07;
+            m_utf8_min = 0x10000;
+            m_utf8_need = 3;
+        }
+        else
+            *(out++) = QChar(ushort(0xFFFD));
+    }
+
+    if(out != &m_decoded[0])
+        putText(&m_decoded[0], out - &m_decoded[0]);
+}
+
+QChar *TerminalScreen::putCodePoint(QChar *out, quint32 cp) const
+{
+    // Overlong encodings and surrogates are invalid
+    if(cp < m_utf8_min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        *(out++) = QChar(ushort(0xFFFD));
+    else if(cp >= 0x10000)
+    {
+        cp -= 0x10000;
+        *(out++) = QChar(ushort(0xD800 + (cp >> 10)));
+        *(out++) = QChar(ushort(0xDC00 + (cp & 0x3FF)));
+    }
+    else
+        *(out++) = QChar(ushort(cp));
+    return out;
+}
+
+void TerminalScreen::flushUtf8()
+{
+    if(m_utf8_need == 0)
+        return;
+
+    m_utf8_need = 0;
+    const QChar replacement(ushort(0xFFFD));
+    putText(&replacement, 1);
+}
+
+void TerminalScreen::putText(const QChar *data, int len)
+{
+    row& r = curRow();
+
+    const int end = m_cur_x + len;
+    if((int)r.size() < end)
+        r.resize(end);
+
+    for(int i = 0; i < len; ++i)
+    {
+        r[m_cur_x + i].ch = data[i];
+        r[m_cur_x + i].attr = m_cur_attr;
+    }
+
+    m_cur_x = end;
+    m_max_width = std::max(m_max_width, (int)r.size());
+    markDirty(m_sb_end + m_cur_y);
+}
+
+void TerminalScreen::control(ushort c)
+{
+    const quint8 *chars = m_settings->chars;
+    switch(c)
+    {
+        case '\f':
+            if(chars[SET_FORMFEED])
+                m_cur_x = m_cur_y = 0;
+            break;
+        case '\r':
+            newline(chars[SET_RETURN]);
+            break;
+        case '\n':
+            newline(chars[SET_NEWLINE]);
+            break;
+        case '\b':
+            if(chars[SET_BACKSPACE])
+                backspace();
+            break;
+        case '\a':
+            if(chars[SET_ALARM])
+                m_bell = true;
+            break;
+        case '\t':
+        {
+            if(chars[SET_REPLACE_TAB])
+            {
+                const QString spaces(m_settings->tabReplace, QLatin1Char(' '));
+                putText(spaces.constData(), spaces.size());
+            }
+            else
+            {
+                const QChar tab(c);
+                putText(&tab, 1);
+            }
+            break;
+        }
+        case 0:
+        {
+            if(chars[SET_IGNORE_NULL])
+            {
+                const QChar dot(QLatin1Char('.'));
+                putText(&dot, 1);
+            }
+            break;
+        }
+        case 0x1B:
+        {
+            if(chars[SET_HANDLE_ESCAPE])
+                m_esc_state = ESC_START;
+            else
+            {
+                const QChar esc(c);
+                putText(&esc, 1);
+            }
+            break;
+        }
+    }
+}
+
+bool TerminalScreen::escape(QChar c)
+{
+    const ushort u = c.unicode();
+
+    if(m_esc_state == ESC_START)
+    {
+        // Only CSI sequences are supported, the character is not eaten
+        if(u != '[')
+        {
+            m_esc_state = ESC_NONE;
+            return false;
+        }
+
+        m_esc_state = ESC_CSI;
+        m_esc_params[0] = -1;
+        m_esc_count = 1;
+        return true;
+    }
+
+    if(u >= '0' && u <= '9')
+    {
+        int& p = m_esc_params[m_esc_count-1];
+        if(p < 0)
+            p = 0;
+        if(p < 100000)
+            p = p*10 + (u - '0');
+    }
+    else if(u == ';')
+    {
+        if(m_esc_count < MAX_ESC_PARAMS)
+            m_esc_params[m_esc_count++] = -1;
+    }
+    else if(c.isLetter())
+    {
+        m_esc_state = ESC_NONE;
+        handleEscSeq(c.toLatin1());
+    }
+    return true;
+}
+
+int TerminalScreen::escParam(int idx, int def) const
+{
+    if(idx >= m_esc_count || m_esc_params[idx] < 0)
+        return def;
+    return m_esc_params[idx];
+}
+
+void TerminalScreen::handleEscSeq(char cmd)
+{
+    switch(cmd)
+    {
+        case 'm':
+            handleSgr();
+            break;
+        case 'A':
+            m_cur_y = std::max(0, m_cur_y - std::max(1, escParam(0, 1)));
+            break;
+        case 'B':
+            m_cur_y = std::min(m_height - 1, m_cur_y + std::max(1, escParam(0, 1)));
+            break;
+        case 'C':
+            m_cur_x = std::min((int)MAX_COLUMN, m_cur_x + std::max(1, escParam(0, 1)));
+            break;
+        case 'D':
+            m_cur_x = std::max(0, m_cur_x - std::max(1, escParam(0, 1)));
+            break;
+        case 'H':
+        case 'f':
+            m_cur_y = std::min(m_height, std::max(1, escParam(0, 1))) - 1;
+            m_cur_x = std::min((int)MAX_COLUMN, std::max(1, escParam(1, 1))) - 1;
+            break;
+        case 'K':
+            eraseLine(escParam(0, 0));
+            break;
+        case 'J':
+            eraseScreen(escParam(0, 0));
+            break;
+    }
+}
+
+void TerminalScreen::handleSgr()
+{
+    term_attr blk = m_attrs[m_cur_attr];
+
+    for(int i = 0; i < m_esc_count; ++i)
+    {
+        const int code = escParam(i, 0);
+        switch(code)
+        {
+        case 0:
+            blk = term_attr();
+            break;
+        case 1:
+            blk.flags |= ATTR_BOLD;
+            break;
+        case 21:
+            blk.flags &= ~ATTR_BOLD;
+            break;
+        case 39:
+            blk.color = QColor();
+            break;
+        case 49:
+            blk.background = QColor();
+            break;
+
+        case 30: blk.color = Qt::black; break;
+        case 31: blk.color = Qt::darkRed; break;
+        case 32: blk.color = Qt::darkGreen; break;
+        case 33: blk.color = Qt::darkYellow; break;
+        case 34: blk.color = Qt::darkBlue; break;
+        case 35: blk.color = Qt::darkMagenta; break;
+        case 36: blk.color = Qt::darkCyan; break;
+        case 37: blk.color = Qt::lightGray; break;
+        case 90: blk.color = Qt::darkGray; break;
+        case 91: blk.color = Qt::red; break;
+        case 92: blk.color = Qt::green; break;
+        case 93: blk.color = Qt::yellow; break;
+        case 94: blk.color = Qt::blue; break;
+        case 95: blk.color = Qt::magenta; break;
+        case 96: blk.color = Qt::cyan; break;
+        case 97: blk.color = Qt::white; break;
+
+        case 40:  blk.background = Qt::black; break;
+        case 41:  blk.background = Qt::darkRed; break;
+        case 42:  blk.background = Qt::darkGreen; break;
+        case 43:  blk.background = Qt::darkYellow; break;
+        case 44:  blk.background = Qt::darkBlue; break;
+        case 45:  blk.background = Qt::darkMagenta; break;
+        case 46:  blk.background = Qt::darkCyan; break;
+        case 47:  blk.background = Qt::lightGray; break;
+        case 100: blk.background = Qt::darkGray; break;
+        case 101: blk.background = Qt::red; break;
+        case 102: blk.background = Qt::green; break;
+        case 103: blk.background = Qt::yellow; break;
+        case 104: blk.background = Qt::blue; break;
+        case 105: blk.background = Qt::magenta; break;
+        case 106: blk.background = Qt::cyan; break;
+        case 107: blk.background = Qt::white; break;
+
+        case 38:
+        case 48:
+        {
+            if(i+2 >= m_esc_count)
+                break;
+
+            i += 2;
+            if(escParam(i-1, -1) != 5)
+                break;
+
+            const int clridx = escParam(i, -1);
+            if(clridx < 0 || clridx >= (int)sizeof_array(term256colors))
+                break;
+            if(code == 38)
+                blk.color = term256colors[clridx];
+            else
+                blk.background = term256colors[clridx];
+            break;
+        }
+        }
+    }
+
+    m_cur_attr = attrIndex(blk);
+}
+
+quint16 TerminalScreen::attrIndex(const term_attr& a)
+{
+    // There are only a few distinct attributes in practice
+    for(size_t i = 0; i < m_attrs.size(); ++i)
+        if(m_attrs[i] == a)
+            return i;
+
+    if(m_attrs.size() > 0xFFFF)
+        return 0;
+
+    m_attrs.push_back(a);
+    return m_attrs.size() - 1;
+}
+
+void TerminalScreen::newline(quint8 option)
+{
+    switch(option)
+    {
+        case NL_NEWLINE_RETURN:
+            lineFeed();
+            m_cur_x = 0;
+            break;
+        case NL_NEWLINE:
+            lineFeed();
+            break;
+        case NL_RETURN:
+            m_cur_x = 0;
+            break;
+        case NL_NOTHING:
+            break;
+    }
+}
+
+void TerminalScreen::lineFeed()
+{
+    if(++m_cur_y < m_height)
+        return;
+
+    // Top row goes to scrollback, the cursor row is still created lazily
+    while((int)m_rows.size() < m_cur_y)
+        m_rows.push_back(row());
+
+    while(m_cur_y >= m_height)
+        scrollUp();
+}
+
+void TerminalScreen::backspace()
+{
+    if(m_cur_x == 0)
+        return;
+
+    --m_cur_x;
+    if(m_cur_y >= (int)m_rows.size())
+        return;
+
+    // Character at the end of line is deleted
+    row& r = m_rows[m_cur_y];
+    if(m_cur_x + 1 == (int)r.size())
+        r.pop_back();
+    markDirty(m_sb_end + m_cur_y);
+}
+
+void TerminalScreen::eraseLine(int mode)
+{
+    if(m_cur_y >= (int)m_rows.size())
+        return;
+
+    row& r = m_rows[m_cur_y];
+    switch(mode)
+    {
+        case 0:
+            if(m_cur_x < (int)r.size())
+                r.resize(m_cur_x);
+            break;
+        case 1:
+            std::fill(r.begin(), r.begin() + std::min((int)r.size(), m_cur_x + 1), cell());
+            break;
+        case 2:
+            r.clear();
+            break;
+    }
+    markDirty(m_sb_end + m_cur_y);
+}
+
+void TerminalScreen::eraseScreen(int mode)
+{
+    int from = 0;
+    int to = m_rows.size();
+    switch(mode)
+    {
+        case 0:
+            eraseLine(0);
+            from = m_cur_y + 1;
+            break;
+        case 1:
+            eraseLine(1);
+            to = std::min(to, m_cur_y);
+            break;
+    }
+
+    for(int i = from; i < to; ++i)
+    {
+        m_rows[i].clear();
+        markDirty(m_sb_end + i);
+    }
+}
+
+TerminalScreen::row& TerminalScreen::curRow()
+{
+    while((int)m_rows.size() <= m_cur_y)
+        m_rows.push_back(row());
+
+    while((int)m_rows.size() > m_height)
+        scrollUp();
+
+    return m_rows[m_cur_y];
+}
+
+void TerminalScreen::scrollUp()
+{
+    packRow(m_rows.front());
+    m_rows.pop_front();
+    m_cur_y = std::max(0, m_cur_y - 1);
+}
+
+void TerminalScreen::packRow(const row& r)
+{
+    if(m_blocks.empty() || m_blocks.back().starts.size() == BLOCK_LINES)
+        m_blocks.push_back(block());
+
+    block& b = m_blocks.back();
+    b.starts.push_back(b.text.size());
+    b.run_starts.push_back(b.runs.size());
+    b.text.append(rowText(r).toUtf8());
+    rowRuns(r, b.runs);
+
+    ++m_sb_end;
+    trimScrollback();
+}
+
+void TerminalScreen::markDirty(quint64 line)
+{
+    if(m_dirty_from >= m_dirty_to)
+    {
+        m_dirty_from = line;
+        m_dirty_to = line + 1;
+    }
+    else
+    {
+        m_dirty_from = std::min(m_dirty_from, line);
+        m_dirty_to = std::max(m_dirty_to, line + 1);
+    }
+}
+
+bool TerminalScreen::takeDirty(quint64& from, quint64& to)
+{
+    if(m_dirty_from >= m_dirty_to)
+        return false;
+
+    from = m_dirty_from;
+    to = m_dirty_to;
+    m_dirty_from = m_dirty_to = 0;
+
+    // Frozen view does not show the changes
+    return !m_frozen;
+}
+
+bool TerminalScreen::takeBell()
+{
+    const bool res = m_bell;
+    m_bell = false;
+    return res;
+}
+
+void TerminalScreen::freeze(bool freeze)
+{
+    if(freeze == m_frozen)
+        return;
+
+    m_frozen = freeze;
+    if(freeze)
+    {
+        m_frozen_rows = m_rows;
+        m_frozen_sb_end = m_sb_end;
+        m_frozen_cur_line = m_sb_end + m_cur_y;
+        m_frozen_cur_x = m_cur_x;
+    }
+    else
+        m_frozen_rows.clear();
+}
+
+quint64 TerminalScreen::firstLine() const
+{
+    // Scrollback lines can be dropped while frozen
+    if(m_frozen)
+        return std::min(m_sb_first, m_frozen_sb_end);
+    return m_sb_first;
+}
+
+quint64 TerminalScreen::endLine() const
+{
+    return screenLine() + rows().size();
+}
+
+void TerminalScreen::cursor(quint64& line, int& col) const
+{
+    if(m_frozen)
+    {
+        line = m_frozen_cur_line;
+        col = m_frozen_cur_x;
+    }
+    else
+    {
+        line = m_sb_end + m_cur_y;
+        col = m_cur_x;
+    }
+}
+
+QString TerminalScreen::lineText(quint64 line) const
+{
+    const quint64 screen = screenLine();
+    if(line >= screen)
+    {
+        const std::deque<row>& r = rows();
+        return (line - screen < r.size()) ? rowText(r[line - screen]) : QString();
+    }
+
+    if(line < m_sb_first)
+        return QString();
+
+    const quint64 rel = line - m_blocks_begin;
+    const block& b = m_blocks[rel / BLOCK_LINES];
+    const quint32 idx = rel % BLOCK_LINES;
+    const quint32 end = (idx + 1 < b.starts.size()) ? b.starts[idx+1] : b.text.size();
+    return QString::fromUtf8(b.text.constData() + b.starts[idx], end - b.starts[idx]);
+}
+
+void TerminalScreen::lineRuns(quint64 line, std::vector<term_run>& runs) const
+{
+    runs.clear();
+
+    const quint64 screen = screenLine();
+    if(line >= screen)
+    {
+        const std::deque<row>& r = rows();
+        if(line - screen < r.size())
+            rowRuns(r[line - screen], runs);
+        return;
+    }
+
+    if(line < m_sb_first)
+        return;
+
+    const quint64 rel = line - m_blocks_begin;
+    const block& b = m_blocks[rel / BLOCK_LINES];
+    const quint32 idx = rel % BLOCK_LINES;
+    const quint32 end = (idx + 1 < b.run_starts.size()) ? b.run_starts[idx+1] : b.runs.size();
+    runs.assign(b.runs.begin() + b.run_starts[idx], b.runs.begin() + end);
+}
+
+QString TerminalScreen::rowText(const row& r)
+{
+    QString res;
+    res.resize(r.size());
+
+    QChar *itr = res.data();
+    for(size_t i = 0; i < r.size(); ++i)
+        *(itr++) = r[i].ch;
+    return res;
+}
+
+void TerminalScreen::rowRuns(const row& r, std::vector<term_run>& runs)
+{
+    quint16 last = 0;
+    for(size_t i = 0; i < r.size(); ++i)
+    {
+        if(r[i].attr == last)
+            continue;
+
+        last = r[i].attr;
+        runs.push_back(term_run(i, last));
+    }
+}
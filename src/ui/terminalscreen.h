@@ -0,0 +1,195 @@
+/**********************************************
+**    This file is part of Lorris
+**    http://tasssadar.github.com/Lorris/
+**
+**    See README and COPYING
+***********************************************/
+
+#ifndef TERMINALSCREEN_H
+#define TERMINALSCREEN_H
+
+#include <deque>
+#include <vector>
+#include <QByteArray>
+#include <QString>
+#include <QColor>
+
+struct terminal_settings;
+
+enum term_attr_flags
+{
+    ATTR_BOLD = 0x01
+};
+
+// Text attributes set by SGR escape sequences
+struct term_attr
+{
+    term_attr() : flags(0) { }
+
+    bool isEmpty() const
+    {
+        return !color.isValid() && !background.isValid() && flags == 0;
+    }
+
+    bool operator ==(const term_attr& other) const
+    {
+        return flags == other.flags && color == other.color && background == other.background;
+    }
+
+    quint8 flags;
+    QColor color;
+    QColor background;
+};
+
+// Attribute attr is used from column col up to the next run
+struct term_run
+{
+    term_run(int c = 0, quint16 a = 0) : col(c), attr(a) { }
+
+    int col;
+    quint16 attr; // index to TerminalScreen::attr()
+};
+
+// Text content of Terminal. The last rows of output form the live screen,
+// a grid of character cells in which the cursor moves. When a row scrolls
+// off the top of the screen, it is packed to scrollback as UTF-8 text with
+// attribute runs and it never changes afterwards. Scrollback is stored
+// in blocks of BLOCK_LINES lines, block is freed once all its lines are
+// over the scrollback limit.
+//
+// Lines are addressed by absolute numbers, number of a line stays the same
+// when it moves to scrollback and after older lines are dropped.
+class TerminalScreen
+{
+public:
+    enum { BLOCK_LINES = 1024, DEFAULT_HEIGHT = 25, MAX_ESC_PARAMS = 16, MAX_COLUMN = 0xFFFF };
+
+    // Handling of control characters is taken from settings
+    explicit TerminalScreen(const terminal_settings *settings);
+
+    void clear();
+
+    // 0 means no limit
+    void setScrollback(quint32 lines);
+    void setHeight(int rows);
+
+    // Interprets UTF-8 text, control characters and escape sequences.
+    // Character split between two calls is decoded when the rest comes.
+    void write(const char *data, int len);
+
+    // Lines below keep showing content from the time of freezing,
+    // new output is still processed.
+    void freeze(bool freeze);
+
+    // Lines which can be shown, endLine() is one past the last one
+    quint64 firstLine() const;
+    quint64 endLine() const;
+    QString lineText(quint64 line) const;
+    // runs are empty if the whole line uses default attribute
+    void lineRuns(quint64 line, std::vector<term_run>& runs) const;
+    const term_attr& attr(quint16 idx) const { return m_attrs[idx]; }
+    void cursor(quint64& line, int& col) const;
+
+    // Longest line ever written, it does not shrink when lines are dropped
+    int maxWidth() const { return m_max_width; }
+
+    // Range [from, to) of lines written since the last call, returns
+    // false if there were none
+    bool takeDirty(quint64& from, quint64& to);
+    // Returns true if bell character was received since the last call
+    bool takeBell();
+
+private:
+    struct cell
+    {
+        cell() : ch(QLatin1Char(' ')), attr(0) { }
+
+        QChar ch;
+        quint16 attr;
+    };
+
+    typedef std::vector<cell> row;
+
+    struct block
+    {
+        QByteArray text;
+        std::vector<quint32> starts;     // offset of each line in text
+        std::vector<term_run> runs;
+        std::vector<quint32> run_starts; // first run of each line
+    };
+
+    enum esc_state
+    {
+        ESC_NONE,
+        ESC_START,
+        ESC_CSI
+    };
+
+    void putText(const QChar *data, int len);
+    void putUtf8(const char *data, int len);
+    void flushUtf8();
+    QChar *putCodePoint(QChar *out, quint32 cp) const;
+    void control(ushort c);
+    bool escape(QChar c);
+    void handleEscSeq(char cmd);
+    void handleSgr();
+    void newline(quint8 option);
+    void lineFeed();
+    void backspace();
+    void eraseLine(int mode);
+    void eraseScreen(int mode);
+
+    row& curRow();
+    void scrollUp();
+    void packRow(const row& r);
+    void trimScrollback();
+    void markDirty(quint64 line);
+    quint16 attrIndex(const term_attr& a);
+    int escParam(int idx, int def) const;
+
+    inline const std::deque<row>& rows() const { return m_frozen ? m_frozen_rows : m_rows; }
+    inline quint64 screenLine() const { return m_frozen ? m_frozen_sb_end : m_sb_end; }
+
+    static QString rowText(const row& r);
+    static void rowRuns(const row& r, std::vector<term_run>& runs);
+
+    const terminal_settings *m_settings;
+
+    std::deque<block> m_blocks;
+    quint64 m_blocks_begin; // number of the first line in m_blocks.front()
+    quint64 m_sb_first;
+    quint64 m_sb_end;       // also number of the first screen row
+    quint32 m_scrollback;
+
+    // Rows below the cursor are created when something is written there
+    std::deque<row> m_rows;
+    int m_height;
+    int m_cur_x;
+    int m_cur_y; // relative to the screen
+
+    std::vector<term_attr> m_attrs; // [0] is default, only clear() shrinks it
+    quint16 m_cur_attr;
+
+    // Unfinished UTF-8 sequence
+    quint32 m_utf8_cp;
+    quint32 m_utf8_min;
+    int m_utf8_need;
+    std::vector<QChar> m_decoded;
+
+    quint8 m_esc_state;
+    int m_esc_params[MAX_ESC_PARAMS];
+    int m_esc_count;
+
+    bool m_frozen;
+    std::deque<row> m_frozen_rows;
+    quint64 m_frozen_sb_end;
+    quint64 m_frozen_cur_line;
+    int m_frozen_cur_x;
+
+    quint64 m_dirty_from;
+    quint64 m_dirty_to;
+    bool m_bell;
+    int m_max_width;
+};
+
+#endif // TERMINALSCREEN_H